@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <glob.h>
+#include <sys/wait.h>
+
+#define OUTPUT_SIZE (1 << 22)
+
+static const char* sosu_path = "./sosu";
+static const char* workloads_dir = "bench/workloads";
+static const char* runtime_dir = ".";
+static const char* cc = "cc";
+static int runs = 5;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static int run_capture(char* const argv[], char* output, size_t* length) {
+    int pipe_fd[2];
+    if (pipe(pipe_fd) != 0) return -1;
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(pipe_fd[0]);
+        dup2(pipe_fd[1], STDOUT_FILENO);
+        dup2(pipe_fd[1], STDERR_FILENO);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    close(pipe_fd[1]);
+    
+    size_t total = 0;
+    ssize_t chunk;
+    while ((chunk = read(pipe_fd[0], output + total, OUTPUT_SIZE - 1 - total)) > 0) {
+        total += chunk;
+        if (total == OUTPUT_SIZE - 1) total = 0;
+    }
+    close(pipe_fd[0]);
+    output[total] = '\0';
+    if (length) *length = total;
+    
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/* Drops what legitimately differs between runs: GC sampling, wall time and the boot banner. */
+static void normalize(char* text) {
+    char* out = text;
+    char* line = text;
+    while (*line) {
+        char* end = strchr(line, '\n');
+        char* next = end ? end + 1 : line + strlen(line);
+        bool skip = strncmp(line, "[RUNTIME] Execution completed", 29) == 0 ||
+                    strncmp(line, "[BOOT] Loading", 14) == 0;
+        for (char* p = line; !skip && p < next; p++) {
+            if (strncmp(p, "[GC] Collecting garbage...", 26) == 0) {
+                char* close = strstr(p, "objects)\n");
+                if (close && close < next) {
+                    p = close + 8;
+                    continue;
+                }
+            }
+            *out++ = *p;
+        }
+        line = next;
+    }
+    *out = '\0';
+}
+
+static double median_run(char* const argv[], char* output) {
+    double times[64];
+    for (int i = 0; i < runs; i++) {
+        double start = now_ms();
+        run_capture(argv, output, NULL);
+        times[i] = now_ms() - start;
+    }
+    qsort(times, runs, sizeof(double), compare_doubles);
+    return times[runs / 2];
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--runs=", 7) == 0) runs = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--sosu=", 7) == 0) sosu_path = argv[i] + 7;
+        else if (strncmp(argv[i], "--workloads=", 12) == 0) workloads_dir = argv[i] + 12;
+        else if (strncmp(argv[i], "--runtime=", 10) == 0) runtime_dir = argv[i] + 10;
+        else if (strncmp(argv[i], "--cc=", 5) == 0) cc = argv[i] + 5;
+        else {
+            fprintf(stderr, "Usage: %s [--runs=N] [--sosu=PATH] [--workloads=DIR] [--runtime=DIR] [--cc=CC]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (runs < 1) runs = 1;
+    if (runs > 64) runs = 64;
+    
+    char pattern[4096];
+    snprintf(pattern, sizeof(pattern), "%s/*.sosu", workloads_dir);
+    glob_t found;
+    if (glob(pattern, 0, NULL, &found) != 0 || access(sosu_path, X_OK) != 0) {
+        fprintf(stderr, "No workloads in %s or %s missing (run make first)\n", workloads_dir, sosu_path);
+        return 1;
+    }
+    
+    char* interpreted = malloc(OUTPUT_SIZE);
+    char* compiled = malloc(OUTPUT_SIZE);
+    char include[4096];
+    snprintf(include, sizeof(include), "-I%s", runtime_dir);
+    int failures = 0;
+    
+    printf("%-18s %12s %12s %9s  %s\n", "workload", "interp ms", "aot ms", "speedup", "output");
+    for (size_t w = 0; w < found.gl_pathc; w++) {
+        const char* workload = found.gl_pathv[w];
+        const char* name = strrchr(workload, '/') ? strrchr(workload, '/') + 1 : workload;
+        
+        char c_path[4096], binary_path[4096], emit_arg[4200];
+        snprintf(c_path, sizeof(c_path), "/tmp/sosu-aot-%d-%.*s.c", (int)getpid(), (int)(strlen(name) - 5), name);
+        snprintf(binary_path, sizeof(binary_path), "%.*s", (int)(strlen(c_path) - 2), c_path);
+        snprintf(emit_arg, sizeof(emit_arg), "--emit-c=%s", c_path);
+        
+        char* emit[] = { (char*)sosu_path, (char*)workload, "--no-cache", emit_arg, NULL };
+        char* build[] = { (char*)cc, "-O2", "-pthread", include, c_path, "-o", binary_path, "-lm", NULL };
+        if (run_capture(emit, compiled, NULL) != 0 || run_capture(build, compiled, NULL) != 0) {
+            printf("%-18s %12s %12s %9s  build failed\n%s", name, "-", "-", "-", compiled);
+            failures++;
+            continue;
+        }
+        
+        char* interp_argv[] = { (char*)sosu_path, (char*)workload, "--no-cache", NULL };
+        char* aot_argv[] = { binary_path, NULL };
+        double interp_ms = median_run(interp_argv, interpreted);
+        double aot_ms = median_run(aot_argv, compiled);
+        normalize(interpreted);
+        normalize(compiled);
+        bool same = strcmp(interpreted, compiled) == 0;
+        if (!same) failures++;
+        
+        printf("%-18s %12.3f %12.3f %8.2fx  %s\n", name, interp_ms, aot_ms,
+               aot_ms > 0 ? interp_ms / aot_ms : 0, same ? "match" : "MISMATCH");
+        unlink(c_path);
+        unlink(binary_path);
+    }
+    
+    globfree(&found);
+    free(interpreted);
+    free(compiled);
+    return failures ? 1 : 0;
+}
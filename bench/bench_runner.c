@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/wait.h>
+
+#define MAX_WORKLOADS 64
+#define MAX_RUNS 1000
+
+typedef struct {
+    char name[128];
+    char path[512];
+    int runs;
+    double median_ms;
+    double p95_ms;
+    double min_ms;
+    unsigned long long instructions;
+    double ips;
+    bool failed;
+    double baseline_ms;
+} Workload;
+
+static Workload workloads[MAX_WORKLOADS];
+static int workload_count = 0;
+
+static const char* sosu_path = "./sosu";
+static const char* workload_dir = "bench/workloads";
+static const char* out_path = "bench/results.json";
+static const char* baseline_path = "bench/baseline.json";
+static int runs = 10;
+static double threshold = 10.0;
+static bool save_baseline = false;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static int compare_workloads(const void* a, const void* b) {
+    return strcmp(((const Workload*)a)->name, ((const Workload*)b)->name);
+}
+
+static void add_workload(const char* path) {
+    if (workload_count >= MAX_WORKLOADS) return;
+    
+    Workload* workload = &workloads[workload_count++];
+    memset(workload, 0, sizeof(*workload));
+    snprintf(workload->path, sizeof(workload->path), "%s", path);
+    
+    const char* base = strrchr(path, '/');
+    snprintf(workload->name, sizeof(workload->name), "%s", base ? base + 1 : path);
+    char* dot = strrchr(workload->name, '.');
+    if (dot) *dot = '\0';
+    workload->baseline_ms = -1;
+}
+
+static void find_workloads() {
+    DIR* dir = opendir(workload_dir);
+    if (!dir) {
+        fprintf(stderr, "Cannot open workload directory '%s'\n", workload_dir);
+        exit(1);
+    }
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length > 5 && strcmp(entry->d_name + length - 5, ".sosu") == 0) {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%s", workload_dir, entry->d_name);
+            add_workload(path);
+        }
+    }
+    closedir(dir);
+    qsort(workloads, workload_count, sizeof(Workload), compare_workloads);
+}
+
+static unsigned long long read_instructions(const char* metrics) {
+    FILE* in = fopen(metrics, "r");
+    if (!in) return 0;
+    
+    char line[512];
+    unsigned long long instructions = 0;
+    while (fgets(line, sizeof(line), in)) {
+        char* field = strstr(line, "\"instructions_total\":");
+        if (field) {
+            instructions = strtoull(field + 21, NULL, 10);
+            break;
+        }
+    }
+    fclose(in);
+    return instructions;
+}
+
+static double run_once(Workload* workload, const char* metrics) {
+    char metrics_arg[600];
+    snprintf(metrics_arg, sizeof(metrics_arg), "--metrics-file=%s", metrics);
+    
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        execl(sosu_path, sosu_path, workload->path, metrics_arg, (char*)NULL);
+        _exit(127);
+    }
+    
+    int status;
+    waitpid(pid, &status, 0);
+    double elapsed = now_ms() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+    return elapsed;
+}
+
+static void run_workload(Workload* workload) {
+    char metrics[64];
+    snprintf(metrics, sizeof(metrics), "/tmp/sosu_bench_%d.json", (int)getpid());
+    
+    double times[MAX_RUNS];
+    run_once(workload, metrics);
+    for (int i = 0; i < runs; i++) {
+        times[i] = run_once(workload, metrics);
+        if (times[i] < 0) {
+            workload->failed = true;
+            unlink(metrics);
+            return;
+        }
+    }
+    workload->instructions = read_instructions(metrics);
+    unlink(metrics);
+    
+    qsort(times, runs, sizeof(double), compare_doubles);
+    workload->runs = runs;
+    workload->min_ms = times[0];
+    workload->median_ms = runs % 2 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2;
+    workload->p95_ms = times[(int)ceil(runs * 0.95) - 1];
+    workload->ips = workload->median_ms > 0 ? workload->instructions / (workload->median_ms / 1e3) : 0;
+}
+
+static void load_baseline(const char* path) {
+    FILE* in = fopen(path, "r");
+    if (!in) return;
+    
+    char line[1024];
+    while (fgets(line, sizeof(line), in)) {
+        char* name = strstr(line, "\"name\": \"");
+        char* median = strstr(line, "\"median_ms\": ");
+        if (!name || !median) continue;
+        
+        name += 9;
+        char* end = strchr(name, '"');
+        if (!end) continue;
+        *end = '\0';
+        for (int i = 0; i < workload_count; i++) {
+            if (strcmp(workloads[i].name, name) == 0) {
+                workloads[i].baseline_ms = strtod(median + 13, NULL);
+            }
+        }
+    }
+    fclose(in);
+}
+
+static bool write_results(const char* path) {
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Cannot write '%s'\n", path);
+        return false;
+    }
+    
+    fprintf(out, "{\n  \"runs\": %d,\n  \"workloads\": [\n", runs);
+    for (int i = 0; i < workload_count; i++) {
+        Workload* workload = &workloads[i];
+        fprintf(out, "    {\"name\": \"%s\", \"failed\": %s, \"median_ms\": %.3f, \"p95_ms\": %.3f, \"min_ms\": %.3f, "
+                "\"instructions\": %llu, \"instructions_per_sec\": %.0f}%s\n",
+                workload->name, workload->failed ? "true" : "false",
+                workload->median_ms, workload->p95_ms, workload->min_ms,
+                workload->instructions, workload->ips,
+                i + 1 < workload_count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    fclose(out);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--runs=", 7) == 0) runs = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--sosu=", 7) == 0) sosu_path = argv[i] + 7;
+        else if (strncmp(argv[i], "--workloads=", 12) == 0) workload_dir = argv[i] + 12;
+        else if (strncmp(argv[i], "--out=", 6) == 0) out_path = argv[i] + 6;
+        else if (strncmp(argv[i], "--baseline=", 11) == 0) baseline_path = argv[i] + 11;
+        else if (strncmp(argv[i], "--threshold=", 12) == 0) threshold = atof(argv[i] + 12);
+        else if (strcmp(argv[i], "--save-baseline") == 0) save_baseline = true;
+        else if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: %s [--runs=N] [--sosu=PATH] [--workloads=DIR] [--out=FILE]\n"
+                            "       [--baseline=FILE] [--threshold=PCT] [--save-baseline] [workload.sosu...]\n", argv[0]);
+            return 1;
+        }
+        else add_workload(argv[i]);
+    }
+    if (runs < 1) runs = 1;
+    if (runs > MAX_RUNS) runs = MAX_RUNS;
+    if (access(sosu_path, X_OK) != 0) {
+        fprintf(stderr, "Interpreter '%s' not found (run make first)\n", sosu_path);
+        return 1;
+    }
+    if (workload_count == 0) find_workloads();
+    if (!save_baseline) load_baseline(baseline_path);
+    
+    printf("%-20s %10s %10s %14s %10s\n", "Workload", "Median ms", "P95 ms", "Instr/sec", "vs base");
+    printf("------------------------------------------------------------------\n");
+    
+    int regressions = 0;
+    for (int i = 0; i < workload_count; i++) {
+        Workload* workload = &workloads[i];
+        run_workload(workload);
+        if (workload->failed) {
+            printf("%-20s %10s\n", workload->name, "FAILED");
+            regressions++;
+            continue;
+        }
+        
+        char delta[32] = "-";
+        if (workload->baseline_ms > 0) {
+            double change = (workload->median_ms / workload->baseline_ms - 1.0) * 100.0;
+            bool regressed = change > threshold;
+            snprintf(delta, sizeof(delta), "%+.1f%%%s", change, regressed ? " REGRESSED" : "");
+            if (regressed) regressions++;
+        }
+        printf("%-20s %10.3f %10.3f %14.0f %10s\n",
+               workload->name, workload->median_ms, workload->p95_ms, workload->ips, delta);
+    }
+    
+    if (!write_results(save_baseline ? baseline_path : out_path)) return 1;
+    printf("\nResults written to %s\n", save_baseline ? baseline_path : out_path);
+    if (regressions > 0) {
+        printf("%d workload(s) regressed or failed (threshold %.1f%%)\n", regressions, threshold);
+        return 1;
+    }
+    return 0;
+}
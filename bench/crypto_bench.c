@@ -0,0 +1,91 @@
+#define SOSU_EMBEDDED
+#include "../kernel.c"
+
+#define BUFFER_SIZE (16 << 20)
+#define MESSAGE_SIZE 4096
+#define MIN_SECONDS 0.25
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned char* buffer;
+static unsigned char* digests;
+static volatile uint64_t sink;
+
+static void run_crc32c() { sink += crc32c(buffer, BUFFER_SIZE); }
+static void run_xxhash64() { sink += xxhash64(buffer, BUFFER_SIZE, 0); }
+static void run_sha256() { sha256(digests, buffer, BUFFER_SIZE); sink += digests[0]; }
+static void run_sha256_multi() { sha256_multi(digests, buffer, MESSAGE_SIZE, BUFFER_SIZE / MESSAGE_SIZE); sink += digests[0]; }
+
+/* Repeats one pass over the buffer until MIN_SECONDS have elapsed. */
+static double gigabytes_per_second(void (*run)()) {
+    run();
+    int passes = 0;
+    double start = now_seconds(), elapsed;
+    do {
+        run();
+        passes++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < MIN_SECONDS);
+    return (double)BUFFER_SIZE * passes / elapsed / 1e9;
+}
+
+static bool hex_equals(const unsigned char* digest, const char* hex) {
+    char text[65];
+    for (int i = 0; i < 32; i++) sprintf(text + 2 * i, "%02x", digest[i]);
+    return strcmp(text, hex) == 0;
+}
+
+/* Known-answer vectors plus a multi-buffer vs single-buffer cross check. */
+static bool self_test() {
+    unsigned char digest[32];
+    bool ok = crc32c((const unsigned char*)"123456789", 9) == 0xE3069283u;
+    ok &= xxhash64((const unsigned char*)"", 0, 0) == 0xEF46DB3751D8E999ULL;
+    ok &= xxhash64((const unsigned char*)"abc", 3, 0) == 0x44BC2CF5AD770999ULL;
+    sha256(digest, (const unsigned char*)"abc", 3);
+    ok &= hex_equals(digest, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    sha256(digest, (const unsigned char*)"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56);
+    ok &= hex_equals(digest, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    
+    for (size_t length = 0; length < 200 && ok; length += 13) {
+        sha256_multi(digests, buffer, length, 11);
+        for (size_t i = 0; i < 11 && ok; i++) {
+            sha256(digest, buffer + length * i, length);
+            ok = memcmp(digest, digests + 32 * i, 32) == 0;
+        }
+    }
+    return ok;
+}
+
+int main() {
+    buffer = malloc(BUFFER_SIZE);
+    digests = malloc(32 * (BUFFER_SIZE / MESSAGE_SIZE));
+    for (unsigned int i = 0; i < BUFFER_SIZE; i++) buffer[i] = (unsigned char)(i * 2654435761u >> 24);
+    
+    printf("\n=== SOSU CRYPTO THROUGHPUT (GB/s) ===\n");
+    printf("%d MB buffer | multi-buffer SHA-256 over %d byte messages\n", BUFFER_SIZE >> 20, MESSAGE_SIZE);
+    printf("%-8s %-10s %-10s %-10s %-10s %-10s\n", "Kernels", "CRC32C", "xxHash64", "SHA-256", "SHA-256xN", "Self-test");
+    printf("------------------------------------------------------------\n");
+    
+    int failures = 0;
+    for (int level = 0; level <= 2; level++) {
+        simd_limit = level;
+        const char* name = array_select_kernels();
+        if (level > 0 && array_kernels == &scalar_kernels) break;
+        if (level == 2 && array_kernels != &avx2_kernels) break;
+        
+        bool ok = self_test();
+        if (!ok) failures++;
+        printf("%-8s %-10.2f %-10.2f %-10.2f %-10.2f %-10s\n", name,
+               gigabytes_per_second(run_crc32c), gigabytes_per_second(run_xxhash64),
+               gigabytes_per_second(run_sha256), gigabytes_per_second(run_sha256_multi), ok ? "ok" : "FAILED");
+    }
+    printf("============================================================\n");
+    
+    free(buffer);
+    free(digests);
+    return failures ? 1 : 0;
+}
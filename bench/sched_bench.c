@@ -0,0 +1,149 @@
+#define SOSU_EMBEDDED
+#include "../kernel.c"
+
+#define FIB_N 25
+#define FIB_CUTOFF 16
+#define SUM_TASKS 64
+#define SUM_LENGTH 4000
+#define SMALL_TASKS 4096
+#define STRINGIFY(x) QUOTE(x)
+#define QUOTE(x) #x
+
+/* Every task runs interpreted SOSU code; the scheduler is only reached through async/join. */
+static const char* workload[] = {
+    "function fib(n) {",
+    "    n", "    2", "    <",
+    "    if {", "        return n", "    }",
+    "    n", "    1", "    -", "    fib()",
+    "    n", "    2", "    -", "    fib()",
+    "    +",
+    "    return",
+    "}",
+    "function pfib(n) {",
+    "    int64 child",
+    "    n", "    " STRINGIFY(FIB_CUTOFF), "    <",
+    "    if {", "        n", "        fib()", "        return", "    }",
+    "    n", "    1", "    -", "    async pfib 1;", "    child =",
+    "    n", "    2", "    -", "    pfib()",
+    "    child", "    async join;",
+    "    +",
+    "    return",
+    "}",
+    "function chunk(first) {",
+    "    int64 total=0",
+    "    for", "        int64 k=0", "    ;", "        k", "        " STRINGIFY(SUM_LENGTH), "        <",
+    "    ;", "        k", "        1", "        +", "        k =",
+    "    {",
+    "        total", "        first", "        k", "        +", "        +", "        total =",
+    "    }",
+    "    total",
+    "    return",
+    "}",
+    "function small(i) {",
+    "    i", "    3", "    *", "    1", "    +",
+    "    return",
+    "}",
+};
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void load_workload() {
+    static char source[8192];
+    size_t length = 0;
+    for (size_t i = 0; i < sizeof(workload) / sizeof(workload[0]); i++) {
+        length += snprintf(source + length, sizeof(source) - length, "%s\n", workload[i]);
+    }
+    init_sosu_os();
+    load_program(source, length);
+    first_pass();
+}
+
+/* Spawns count tasks of one function, each with its index as argument, and sums the results. */
+static double bench_tasks(int workers, const char* name, int count, int64_t* result) {
+    static int64_t handles[SMALL_TASKS];
+    int func_idx = find_function(name);
+    
+    sched_init(workers);
+    double start = now_seconds();
+    
+    for (int i = 0; i < count; i++) {
+        push_int64(i);
+        handles[i] = spawn_task(func_idx, 1);
+    }
+    int64_t total = 0;
+    for (int i = 0; i < count; i++) {
+        join_task(handles[i]);
+        total += pop_int64();
+    }
+    
+    double elapsed = now_seconds() - start;
+    sched_shutdown();
+    *result = total;
+    return elapsed;
+}
+
+static double bench_fib(int workers, int64_t* result) {
+    int func_idx = find_function("pfib");
+    
+    sched_init(workers);
+    double start = now_seconds();
+    
+    push_int64(FIB_N);
+    join_task(spawn_task(func_idx, 1));
+    *result = pop_int64();
+    
+    double elapsed = now_seconds() - start;
+    sched_shutdown();
+    return elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    int max_workers = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_workers < 1) max_workers = 1;
+    if (max_workers > MAX_WORKERS) max_workers = MAX_WORKERS;
+    
+    load_workload();
+    
+    printf("\n=== SOSU TASK SCHEDULER BENCHMARK ===\n");
+    printf("pfib(%d) cutoff %d | %d chunk tasks x %d iterations | %d small tasks (all interpreted)\n",
+           FIB_N, FIB_CUTOFF, SUM_TASKS, SUM_LENGTH, SMALL_TASKS);
+    printf("%-8s %-12s %-8s %-12s %-8s %-12s %-8s\n",
+           "Workers", "Fib (s)", "Speedup", "Sum (s)", "Speedup", "Tasks (s)", "Speedup");
+    printf("-------------------------------------------------------------------------\n");
+    
+    double fib_base = 0, sum_base = 0, task_base = 0;
+    int64_t fib_expected = 0, sum_expected = 0, task_expected = 0;
+    int failures = 0;
+    int workers = 1;
+    while (true) {
+        int64_t fib_result, sum_result, task_result;
+        double fib_time = bench_fib(workers, &fib_result);
+        double sum_time = bench_tasks(workers, "chunk", SUM_TASKS, &sum_result);
+        double task_time = bench_tasks(workers, "small", SMALL_TASKS, &task_result);
+    
+        if (workers == 1) {
+            fib_base = fib_time;
+            sum_base = sum_time;
+            task_base = task_time;
+            fib_expected = fib_result;
+            sum_expected = sum_result;
+            task_expected = task_result;
+        }
+        bool ok = fib_result == fib_expected && sum_result == sum_expected && task_result == task_expected;
+        if (!ok) failures++;
+        printf("%-8d %-12.4f %-8.2f %-12.4f %-8.2f %-12.4f %-8.2f%s\n",
+               workers, fib_time, fib_base / fib_time, sum_time, sum_base / sum_time,
+               task_time, task_base / task_time, ok ? "" : "  MISMATCH");
+    
+        if (workers == max_workers) break;
+        workers = workers * 2 > max_workers ? max_workers : workers * 2;
+    }
+    printf("=========================================================================\n");
+    printf("pfib(%d) = %ld\n", FIB_N, (long)fib_expected);
+    
+    return failures ? 1 : 0;
+}
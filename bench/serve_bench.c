@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define MAX_REQUESTS 10000
+
+static const char* sosu_path = "./sosu";
+static const char* kernel_path = "bench/workloads/startup.sosu";
+static int requests = 200;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double cold_launch() {
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        execl(sosu_path, sosu_path, kernel_path, (char*)NULL);
+        _exit(127);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? now_ms() - start : -1;
+}
+
+static int connect_socket(const char* path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static double warm_request(const char* socket_path, const char* kernel) {
+    double start = now_ms();
+    int fd = connect_socket(socket_path);
+    if (fd < 0) return -1;
+    
+    dprintf(fd, "RUN %s\n", kernel);
+    FILE* in = fdopen(fd, "r");
+    static char buffer[1 << 20];
+    char header[64];
+    bool shutdown = false;
+    int code = -1;
+    size_t length;
+    while (fgets(header, sizeof(header), in)) {
+        if (sscanf(header, "OUT %zu", &length) == 1 && length <= sizeof(buffer)) {
+            if (fread(buffer, 1, length, in) != length) break;
+            if (memmem(buffer, length, "Shutdown complete", 17)) shutdown = true;
+        } else {
+            sscanf(header, "EXIT %d", &code);
+            break;
+        }
+    }
+    fclose(in);
+    return shutdown && code == 0 ? now_ms() - start : -1;
+}
+
+static void report(const char* name, double* times, int count) {
+    qsort(times, count, sizeof(double), compare_doubles);
+    double total = 0;
+    for (int i = 0; i < count; i++) total += times[i];
+    printf("%-14s %10.3f %10.3f %10.3f %10.3f\n", name,
+           times[count / 2], times[(int)(count * 0.95)], times[0], total / count);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) requests = atoi(argv[1]);
+    if (argc > 2) kernel_path = argv[2];
+    if (argc > 3) sosu_path = argv[3];
+    if (requests < 1) requests = 1;
+    if (requests > MAX_REQUESTS) requests = MAX_REQUESTS;
+    
+    char kernel[4096];
+    if (!realpath(kernel_path, kernel) || access(sosu_path, X_OK) != 0) {
+        fprintf(stderr, "Usage: %s [requests] [kernel.sosu] [sosu binary] (run make first)\n", argv[0]);
+        return 1;
+    }
+    
+    char socket_path[108];
+    snprintf(socket_path, sizeof(socket_path), "/tmp/sosu-serve-bench-%d.sock", (int)getpid());
+    char serve_arg[128];
+    snprintf(serve_arg, sizeof(serve_arg), "--serve=%s", socket_path);
+    
+    pid_t daemon = fork();
+    if (daemon == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        execl(sosu_path, sosu_path, serve_arg, (char*)NULL);
+        _exit(127);
+    }
+    
+    int fd = -1;
+    for (int i = 0; i < 500 && fd < 0; i++) {
+        usleep(10000);
+        fd = connect_socket(socket_path);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Daemon did not start on %s\n", socket_path);
+        kill(daemon, SIGTERM);
+        return 1;
+    }
+    close(fd);
+    
+    static double cold[MAX_REQUESTS], warm[MAX_REQUESTS];
+    cold_launch();
+    warm_request(socket_path, kernel);
+    
+    int failures = 0;
+    for (int i = 0; i < requests; i++) {
+        cold[i] = cold_launch();
+        warm[i] = warm_request(socket_path, kernel);
+        if (cold[i] < 0 || warm[i] < 0) failures++;
+    }
+    
+    kill(daemon, SIGTERM);
+    waitpid(daemon, NULL, 0);
+    unlink(socket_path);
+    
+    if (failures > 0) {
+        fprintf(stderr, "%d request(s) failed\n", failures);
+        return 1;
+    }
+    
+    printf("Kernel: %s, %d requests each\n\n", kernel_path, requests);
+    printf("%-14s %10s %10s %10s %10s\n", "Mode", "Median ms", "P95 ms", "Min ms", "Mean ms");
+    printf("----------------------------------------------------------\n");
+    double cold_median, warm_median;
+    report("cold launch", cold, requests);
+    cold_median = cold[requests / 2];
+    report("warm daemon", warm, requests);
+    warm_median = warm[requests / 2];
+    printf("\nSpeedup (median): %.2fx\n", warm_median > 0 ? cold_median / warm_median : 0);
+    return 0;
+}
@@ -9,6 +9,25 @@
 #include <stdbool.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <errno.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
 
 #define STACK_SIZE 8192
 #define MEMORY_SIZE 2097152
@@ -16,10 +35,29 @@
 #define MAX_FUNCTIONS 512
 #define MAX_VARIABLES 2000
 #define MAX_STRUCTS 256
+#define MAX_FIELDS 64
 #define LINE_SIZE 2048
+#define MAX_PROGRAM_LINES 8000
+#define MAX_SOURCE_SIZE ((size_t)MAX_PROGRAM_LINES * LINE_SIZE)
 #define MAX_FILES 256
 #define MAX_CALL_STACK 1024
 #define MAX_MODULES 64
+#define MAX_THREADS 256
+#define MAX_WORKERS 64
+#define MAX_TASKS 16384
+#define MAX_TASK_ARGS 8
+#define MAX_SYNC_OBJECTS 1024
+#define MAX_OBJECTS 32768
+#define OBJECT_INDEX_SIZE 65536
+#define MAX_COROUTINES 4096
+#define COROUTINE_HANDLE_BASE 0x100000
+#define TASK_GENERATION_SHIFT 32
+#define COROUTINE_SAVE_MAX 32
+#define MAX_POOL_WORKERS 64
+#define POOL_MAX_IN_FLIGHT 256
+#define SYNC_SPIN_DEFAULT 100
+#define SYNC_SPIN_MAX 1000
+#define TASK_DEQUE_SIZE 4096
 
 typedef enum {
     TYPE_VOID,
@@ -48,11 +86,7 @@ union StackValue {
     void* ptr;
 };
 
-union StackValue stack[STACK_SIZE];
-DataType stack_types[STACK_SIZE];
-int sp = 0;
-
-unsigned char memory[MEMORY_SIZE];
+unsigned char memory[MEMORY_SIZE] __attribute__((aligned(4096)));
 int memory_size = MEMORY_SIZE;
 
 typedef struct {
@@ -63,7 +97,8 @@ typedef struct {
 } Label;
 
 Label labels[MAX_LABELS];
-int label_count = 0;
+_Atomic int label_count = 0;
+pthread_mutex_t labels_lock = PTHREAD_MUTEX_INITIALIZER;
 
 typedef struct {
     char name[256];
@@ -78,7 +113,8 @@ typedef struct {
 } Function;
 
 Function functions[MAX_FUNCTIONS];
-int function_count = 0;
+_Atomic int function_count = 0;
+pthread_mutex_t functions_lock = PTHREAD_MUTEX_INITIALIZER;
 
 typedef struct {
     char name[256];
@@ -90,32 +126,204 @@ typedef struct {
     bool is_static;
     int scope_level;
     int module_id;
+    int owner;
+    int decl_line;
 } Variable;
 
 Variable variables[MAX_VARIABLES];
-int variable_count = 0;
+_Atomic int variable_count = 0;
+pthread_mutex_t variables_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define VARIABLE_RELEASED -1
+
+int released_variables = 0;
 
 typedef struct {
     char name[128];
     int field_count;
-    char field_names[64][64];
-    DataType field_types[64];
-    unsigned int field_offsets[64];
+    char field_names[MAX_FIELDS][64];
+    DataType field_types[MAX_FIELDS];
+    unsigned int field_offsets[MAX_FIELDS];
     unsigned int total_size;
 } Struct;
 
 Struct structs[MAX_STRUCTS];
-int struct_count = 0;
+_Atomic int struct_count = 0;
+pthread_mutex_t structs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef enum {
+    FLOW_NONE,
+    FLOW_IF,
+    FLOW_ELSE,
+    FLOW_WHILE,
+    FLOW_LOOP,
+    FLOW_LOOP_END,
+    FLOW_FOR_TEST,
+    FLOW_FOR_NEXT,
+    FLOW_BREAK,
+    FLOW_CONTINUE,
+    FLOW_SWITCH,
+    FLOW_CASE,
+    FLOW_CALL,
+    FLOW_PARAM,
+    FLOW_PARAM_STORE,
+    FLOW_RETURN,
+    FLOW_TAIL_CALL,
+    FLOW_TRY,
+    FLOW_CATCH,
+    FLOW_STRUCT,
+    FLOW_FIELD,
+    FLOW_FIELD_STORE,
+    FLOW_ELEMENT,
+    FLOW_ELEMENT_STORE,
+    FLOW_FIELD_DYNAMIC,
+    FLOW_FIELD_DYNAMIC_STORE,
+    FLOW_METHOD,
+    FLOW_STRING,
+    FLOW_PRINTS
+} FlowKind;
 
 typedef struct {
     char line[LINE_SIZE];
     int line_number;
     int module_id;
+    int function_id;
+    int opcode;
+    int flow;
+    int jump;
+    int link;
 } ProgramLine;
 
-ProgramLine program[8000];
+#define MAX_SWITCHES 512
+#define MAX_SWITCH_CASES 16384
+
+typedef struct {
+    int64_t low;
+    int32_t count;
+    int32_t dense;
+    int32_t first;
+    int32_t fallback;
+} SwitchTable;
+
+typedef struct {
+    int64_t value;
+    int32_t target;
+} SwitchCase;
+
+SwitchTable switch_tables[MAX_SWITCHES];
+int switch_count = 0;
+SwitchCase switch_cases[MAX_SWITCH_CASES];
+int switch_case_count = 0;
+
+#define MAX_HANDLERS 1024
+#define MAX_TRY_NESTING 16
+
+typedef struct {
+    int32_t start;
+    int32_t end;
+    int32_t parent;
+    int32_t depth;
+    int32_t nesting;
+} Handler;
+
+Handler handlers[MAX_HANDLERS];
+int handler_count = 0;
+
+ProgramLine program_storage[MAX_PROGRAM_LINES];
+ProgramLine* program = program_storage;
+
+#define MAX_INLINE_CACHES 4096
+#define INLINE_CACHE_WAYS 4
+
+/* Per-site cache for dynamic field and method sites; an entry packs (struct id + 1) << 32 | field or function. */
+typedef struct {
+    _Atomic uint64_t entries[INLINE_CACHE_WAYS];
+    _Atomic bool megamorphic;
+} InlineCache;
+
+InlineCache inline_caches[MAX_INLINE_CACHES];
+int inline_cache_count = 0;
+
+/* String literals live below the heap in pages that are read-only once the kernel is loaded. */
+#define STRING_POOL_BASE 0x20000
+#define STRING_POOL_SIZE 0x20000
+#define HEAP_BASE (STRING_POOL_BASE + STRING_POOL_SIZE)
+#define STRING_TABLE_SIZE 8192
+
+typedef struct {
+    uint32_t address;
+    uint32_t length;
+} StringConstant;
+
+StringConstant string_table[STRING_TABLE_SIZE];
+int string_constant_count = 0;
+unsigned int string_pool_used = 0;
+unsigned int string_pool_sealed = 0;
 int program_size = 0;
 
+#define IMAGE_MAGIC "SOSUIMG1"
+#define IMAGE_LAYOUT "sosu 3.0 layout 2"      // bump whenever the meaning of a cached record changes
+
+typedef struct {
+    char magic[8];
+    char build[32];
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint32_t record_sizes[7];
+    uint32_t program_size;
+    uint32_t label_count;
+    uint32_t function_count;
+    uint32_t struct_count;
+    uint32_t switch_count;
+    uint32_t switch_case_count;
+    uint32_t handler_count;
+    uint64_t program_offset;
+    uint64_t label_offset;
+    uint64_t function_offset;
+    uint64_t struct_offset;
+    uint64_t switch_offset;
+    uint64_t switch_case_offset;
+    uint64_t handler_offset;
+    uint64_t image_size;
+} ImageHeader;
+
+bool image_cache = true;
+void* image_base = NULL;
+size_t image_length = 0;
+uint64_t kernel_hash = 0;
+
+#define AOT_STACK 16
+#define AOT_INLINE_LINES 12
+
+typedef int (*AotFunction)(void);
+
+AotFunction aot_functions[MAX_FUNCTIONS];
+char emit_c_path[256] = "";
+
+#define SNAPSHOT_MAGIC "SOSUSNP1"
+
+typedef struct {
+    char magic[8];
+    char build[32];
+    uint64_t source_hash;
+    uint32_t record_sizes[6];
+    uint32_t heap_start;
+    uint32_t variable_count;
+    uint32_t function_count;
+    uint32_t struct_count;
+    uint32_t label_count;
+    uint32_t sync_count;
+    uint32_t object_count;
+    int32_t sp;
+    int32_t current_scope;
+    uint64_t memory_offset;
+    uint64_t memory_length;
+    uint64_t snapshot_size;
+} SnapshotHeader;
+
+char snapshot_in[PATH_MAX] = "";
+char snapshot_out[PATH_MAX] = "";
+
 union {
     struct {
         uint64_t rax, rbx, rcx, rdx;
@@ -142,13 +350,185 @@ CPUFlags cpu_flags = {0};
 typedef struct {
     int return_address;
     int base_pointer;
-    char function_name[256];
+    int function;
     int scope_level;
+    int variable_base;
     unsigned int stack_frame_size;
+    int coroutine;
+    int try_sp[MAX_TRY_NESTING];
 } CallFrame;
 
-CallFrame call_stack[MAX_CALL_STACK];
-int call_stack_ptr = 0;
+typedef struct VMThread {
+    union StackValue stack[STACK_SIZE];
+    DataType stack_types[STACK_SIZE];
+    int sp;
+    CallFrame call_stack[MAX_CALL_STACK];
+    int call_stack_ptr;
+    int pc;
+    int current_line;
+    int base_pointer;
+    int current_scope;
+    int try_sp[MAX_TRY_NESTING];
+    int id;
+    int owner;
+    Variable* locals;
+    int local_count;
+    int local_capacity;
+    uint64_t rng_state;
+    int entry_function;
+    jmp_buf* unwind;
+    pthread_t handle;
+    atomic_bool finished;
+    struct VMThread* next_spare;
+} VMThread;
+
+VMThread main_thread;
+__thread VMThread* vm = &main_thread;
+
+VMThread* threads[MAX_THREADS];
+int next_thread_id = 1;
+pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct Task {
+    int function;
+    void (*native)(struct Task*);
+    void* native_arg;
+    int argc;
+    union StackValue args[MAX_TASK_ARGS];
+    DataType arg_types[MAX_TASK_ARGS];
+    union StackValue result;
+    DataType result_type;
+    atomic_int done;
+    atomic_bool in_use;
+    atomic_uint generation;
+    struct Task* next;
+} Task;
+
+typedef struct {
+    atomic_long top;
+    char pad0[64 - sizeof(atomic_long)];
+    atomic_long bottom;
+    char pad1[64 - sizeof(atomic_long)];
+    _Atomic(Task*) buffer[TASK_DEQUE_SIZE];
+} TaskDeque;
+
+typedef struct {
+    TaskDeque deque;
+    int index;
+    pthread_t handle;
+    uint64_t rng_state;
+    VMThread* contexts[64];
+    int context_count;
+    Task* free_tasks;
+    int free_task_count;
+    unsigned long long executed;
+    unsigned long long stolen;
+} Worker;
+
+Worker* workers = NULL;
+int worker_count = 0;
+int requested_workers = 0;
+int simd_limit = 2;
+bool workers_started = false;
+atomic_bool sched_stop = false;
+atomic_long sched_pending = 0;
+atomic_uint sched_epoch = 0;
+atomic_int sched_sleepers = 0;
+pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t sched_cond = PTHREAD_COND_INITIALIZER;
+Task* inject_head = NULL;
+Task* inject_tail = NULL;
+atomic_int inject_count = 0;
+unsigned long long tasks_executed = 0;
+unsigned long long tasks_stolen = 0;
+__thread Worker* current_worker = NULL;
+
+typedef enum {
+    SYNC_MUTEX,
+    SYNC_SEMAPHORE,
+    SYNC_CONDVAR
+} SyncKind;
+
+typedef struct {
+    atomic_uint word;       // mutex state (0 free, 1 locked, 2 waiters), semaphore count, condvar sequence
+    atomic_uint aux;        // mutex adaptive spin budget, semaphore sleeping waiters
+    atomic_uint contended;
+    atomic_uint waits;
+} SyncObject;
+
+typedef struct {
+    unsigned int address;
+    SyncKind kind;
+} SyncRecord;
+
+SyncRecord sync_registry[MAX_SYNC_OBJECTS];
+atomic_int sync_count = 0;
+
+typedef enum {
+    OBJECT_ARRAY = 1,
+    OBJECT_STRUCT,
+    OBJECT_COLLECTION
+} ObjectKind;
+
+/* Shapes of arrays and structs live host-side, so nothing a script writes to VM memory can forge them. */
+typedef struct {
+    unsigned int address;
+    uint16_t kind;
+    uint16_t type;          // array element kind or struct id
+    uint32_t length;
+    uint32_t layout;
+} ObjectRecord;
+
+ObjectRecord object_registry[MAX_OBJECTS];
+atomic_int object_count = 0;
+atomic_int object_index[OBJECT_INDEX_SIZE];     // open addressing by address, record + 1
+pthread_mutex_t sync_init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+    int function;
+    int resume_pc;
+    int scope;
+    int owner;
+    int saved_count;
+    int try_sp[MAX_TRY_NESTING];
+    union StackValue saved[COROUTINE_SAVE_MAX];
+    DataType saved_types[COROUTINE_SAVE_MAX];
+    union StackValue result;
+    DataType result_type;
+    bool finished;
+    atomic_bool running;
+} Coroutine;
+
+Coroutine* coroutines[MAX_COROUTINES];
+int free_owner_ids[MAX_COROUTINES];
+int free_owner_count = 0;
+pthread_mutex_t coroutines_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+    union StackValue value;
+    int32_t type;
+    int32_t worker;
+} PoolMessage;
+
+typedef struct {
+    pid_t pid;
+    int request_fd;
+    int result_fd;
+    int in_flight;
+} PoolWorker;
+
+PoolWorker pool_workers[MAX_POOL_WORKERS];
+int pool_size = 0;
+int pool_in_flight = 0;
+PoolMessage* pool_results = NULL;
+int pool_result_count = 0;
+int pool_result_capacity = 0;
+
+Task task_pool[MAX_TASKS];
+atomic_int task_pool_next = 0;
+Task* task_free_list = NULL;
+VMThread* spare_contexts = NULL;
+pthread_mutex_t task_pool_lock = PTHREAD_MUTEX_INITIALIZER;
 
 typedef struct {
     char name[256];
@@ -160,12 +540,9 @@ typedef struct {
 Module modules[MAX_MODULES];
 int module_count = 0;
 
-int current_line = 0;
-int base_pointer = 0;
-int current_scope = 0;
 int current_module = 0;
-bool running = true;
-unsigned int heap_start = 0x40000;
+atomic_bool running = true;
+_Atomic unsigned int heap_start = HEAP_BASE;
 
 #define SYS_EXIT        1
 #define SYS_PRINT       2
@@ -196,6 +573,92 @@ unsigned int heap_start = 0x40000;
 #define SYS_RANDOM      27
 #define SYS_CRYPTO      28
 
+#define CRYPTO_CRC32C   0
+#define CRYPTO_XXHASH64 1
+#define CRYPTO_SHA256   2
+#define CRYPTO_SHA256_MULTI 3
+
+#define THREAD_SPAWN    0
+#define THREAD_JOIN     1
+#define THREAD_SELF     2
+#define THREAD_YIELD    3
+
+#define SYS_TASK        29
+
+#define TASK_SPAWN      0
+#define TASK_JOIN       1
+#define TASK_WORKER     2
+#define TASK_WORKERS    3
+
+#define SYS_CONDVAR     30
+
+#define MUTEX_INIT      0
+#define MUTEX_LOCK      1
+#define MUTEX_UNLOCK    2
+#define MUTEX_TRYLOCK   3
+
+#define SEM_INIT        0
+#define SEM_WAIT        1
+#define SEM_POST        2
+#define SEM_TRYWAIT     3
+#define SEM_VALUE       4
+
+#define COND_INIT       0
+#define COND_WAIT       1
+#define COND_SIGNAL     2
+#define COND_BROADCAST  3
+
+#define SYS_COROUTINE   31
+
+#define CO_CREATE       0
+#define CO_RESUME       1
+#define CO_DONE         2
+#define CO_DESTROY      3
+
+#define SYS_ARRAY       32
+
+#define ARRAY_NEW       0
+#define ARRAY_LENGTH    1
+#define ARRAY_GET       2
+#define ARRAY_SET       3
+#define ARRAY_FILL      4
+#define ARRAY_ADD       5
+#define ARRAY_SUB       6
+#define ARRAY_MUL       7
+#define ARRAY_MIN       8
+#define ARRAY_MAX       9
+#define ARRAY_LT        10
+#define ARRAY_EQ        11
+#define ARRAY_DOT       12
+#define ARRAY_SUM       13
+#define ARRAY_PREFIX_SUM 14
+#define ARRAY_BINARY_OPS 7
+
+#define ARRAY_INT64     0
+#define ARRAY_FLOAT64   1
+
+#define SYS_STRING      33
+
+#define STR_COMPARE     0
+#define STR_EQUALS      1
+#define STR_CONCAT      2
+#define STR_FIND        3
+
+#define SYS_MEMORY      34
+
+#define MEM_COPY        0
+#define MEM_MOVE        1
+#define MEM_FILL        2
+#define MEM_COMPARE     3
+#define MEM_FIND        4
+#define MEM_COUNT       5
+
+#define FORK_PROCESS    0
+#define FORK_POOL_START 1
+#define FORK_POOL_SUBMIT 2
+#define FORK_POOL_COLLECT 3
+#define FORK_POOL_STOP  4
+
 typedef struct {
     int fd;
     bool used;
@@ -217,6 +680,7 @@ typedef struct {
 GCObject gc_objects[1000];
 int gc_object_count = 0;
 bool gc_enabled = true;
+pthread_mutex_t gc_lock = PTHREAD_MUTEX_INITIALIZER;
 
 typedef struct {
     char function_name[256];
@@ -226,17 +690,193 @@ typedef struct {
 
 JITEntry jit_cache[256];
 int jit_count = 0;
+pthread_mutex_t jit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define PROFILE_TOPLEVEL MAX_FUNCTIONS
 
 typedef struct {
-    char function_name[256];
     unsigned long long call_count;
-    unsigned long long total_time;
-    unsigned long long average_time;
+    uint64_t total_time;
+    uint64_t self_time;
 } ProfileEntry;
 
-ProfileEntry profile_data[512];
-int profile_count = 0;
+typedef struct {
+    int function;
+    uint64_t start;
+    uint64_t child_time;
+} ProfileFrame;
+
+typedef struct ProfileThread {
+    ProfileEntry entries[MAX_FUNCTIONS + 1];
+    ProfileFrame frames[MAX_CALL_STACK];
+    int depth;
+    unsigned long long tail_calls;
+    unsigned long long cache_hits;
+    unsigned long long cache_misses;
+    struct ProfileThread* next;
+} ProfileThread;
+
+__thread ProfileThread* profile_local = NULL;
+ProfileThread* profile_threads = NULL;
+double profile_ns_per_tick = 1.0;
+uint64_t profile_epoch_ticks = 0;
+struct timespec profile_epoch;
 bool profiling_enabled = false;
+pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define SAMPLE_DEPTH 32
+#define MAX_SAMPLES 65536
+
+typedef struct {
+    int32_t line;
+    int32_t depth;
+    int32_t functions[SAMPLE_DEPTH];
+} Sample;
+
+Sample* samples = NULL;
+_Atomic unsigned int sample_next = 0;
+_Atomic unsigned int samples_dropped = 0;
+int sample_hz = 0;
+char sample_path[256] = "sosu.folded";
+timer_t sample_timer;
+volatile sig_atomic_t sampling = 0;
+
+static const char* opcode_names[] = {
+    "<empty>", "<label>", "<literal>", "<funcref>", "<identifier>",
+    "namespace", "using", "struct", "class", "enum", "public", "private", "protected",
+    "static", "extern", "inline", "int8", "int16", "int32", "int64", "uint8", "uint16",
+    "uint32", "uint64", "float32", "float64", "char", "bool", "void", "const", "{", "}",
+    "if", "while", "for", "switch", "try", "function", "new", "delete", "sizeof", "typeof",
+    "cast", "import", "export", "async", "thread", "lock", "unlock", "unsafe", "fixed",
+    "stackalloc", "yield", "coroutine", "resume", "await", "throw", "assert", "debug",
+    "trace", "benchmark", "gc", "jit", "print", "prints", "syscall", "asm", "halt", "hlt",
+    "nop", "break", "continue", "return", "+", "-", "*", "/", "%", "==", "!=", "<", ">",
+    "<=", ">=", "&&", "||", "!", "&", "|", "^", "~", "<<", ">>"
+};
+
+#define OP_COUNT (int)(sizeof(opcode_names) / sizeof(opcode_names[0]))
+#define OP_EMPTY 0
+#define OP_LABEL 1
+#define OP_LITERAL 2
+#define OP_FUNCREF 3
+#define OP_IDENTIFIER 4
+
+typedef struct {
+    uint64_t count;
+    uint64_t cycles;
+} LineCounter;
+
+typedef struct HotspotThread {
+    LineCounter lines[MAX_PROGRAM_LINES];
+    struct HotspotThread* next;
+} HotspotThread;
+
+#define METRICS_SYSCALLS 64
+#define METRICS_BUCKETS 8
+#define METRICS_BATCH 1024
+
+static const double metrics_bounds[METRICS_BUCKETS - 1] = { 1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1.0 };
+
+typedef struct {
+    _Atomic uint64_t buckets[METRICS_BUCKETS];
+    _Atomic uint64_t sum_ns;
+    _Atomic uint64_t count;
+} Histogram;
+
+typedef struct {
+    _Atomic uint64_t instructions;
+    _Atomic uint64_t allocations;
+    _Atomic uint64_t allocated_bytes;
+    _Atomic uint64_t gc_cycles;
+    _Atomic uint64_t jit_compilations;
+    Histogram gc_pause;
+    Histogram syscalls[METRICS_SYSCALLS + 1];
+} Metrics;
+
+Metrics metrics;
+__thread unsigned int metrics_pending = 0;
+char metrics_path[256] = "";
+bool metrics_json = false;
+int metrics_interval = 0;
+pthread_t metrics_thread;
+bool metrics_thread_started = false;
+atomic_bool metrics_finished = false;
+pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t metrics_cond = PTHREAD_COND_INITIALIZER;
+bool metrics_stop = false;
+
+#define TRACE_MAGIC "SOSUTRC1"
+#define TRACE_RING_SIZE 65536
+#define MAX_TRACE_BUFFERS 256
+
+typedef enum {
+    TRACE_LINE,
+    TRACE_SYSCALL_ENTER,
+    TRACE_SYSCALL_EXIT,
+    TRACE_GC,
+    TRACE_MARK
+} TraceKind;
+
+typedef struct {
+    uint64_t timestamp;
+    int32_t line;
+    int32_t sp;
+    int32_t arg;
+    uint16_t opcode;
+    uint8_t kind;
+    uint8_t thread;
+} TraceEvent;
+
+typedef struct {
+    char magic[8];
+    uint32_t event_size;
+    uint32_t buffer_count;
+    double ns_per_tick;
+    uint64_t event_count;
+} TraceHeader;
+
+typedef struct {
+    _Atomic uint64_t head;
+    int index;
+    TraceEvent events[TRACE_RING_SIZE];
+} TraceBuffer;
+
+TraceBuffer* trace_buffers[MAX_TRACE_BUFFERS];
+_Atomic int trace_buffer_count = 0;
+__thread TraceBuffer* trace_local = NULL;
+bool tracing = false;
+char trace_path[256] = "sosu.trace";
+
+LineCounter line_counters[MAX_PROGRAM_LINES];
+__thread HotspotThread* hotspot_local = NULL;
+HotspotThread* hotspot_threads = NULL;
+pthread_mutex_t hotspot_lock = PTHREAD_MUTEX_INITIALIZER;
+bool hotspots_enabled = false;
+bool hotspot_cycles = false;
+int hotspot_top = 20;
+char annotate_path[256] = "";
+
+int vm_run(int start_line);
+int execute_command(char* line, int line_number);
+
+typedef enum {
+    EXC_DIVISION_BY_ZERO = -1,
+    EXC_STACK = -2,
+    EXC_TYPE = -3,
+    EXC_OUT_OF_MEMORY = -4,
+    EXC_RUNTIME = -5,
+    EXC_ASSERTION = -6
+} ExceptionCode;
+
+void runtime_error(int64_t code, const char* format, ...) __attribute__((format(printf, 2, 3), noreturn));
+
+const char* array_select_kernels();
+void profile_calibrate();
+DataType parse_type(const char* type_str);
+void fork_prepare();
+void fork_parent();
+void fork_child();
+bool in_coroutine();
 
 void init_sosu_os() {
     for (int i = 0; i < MAX_FILES; i++) {
@@ -261,10 +901,14 @@ void init_sosu_os() {
     memset(&cpu_registers, 0, sizeof(cpu_registers));
     cpu_registers.rsp = MEMORY_SIZE - 1024;
     
-    sp = 0;
-    base_pointer = 0;
-    call_stack_ptr = 0;
-    current_scope = 0;
+    vm->sp = 0;
+    vm->base_pointer = 0;
+    vm->call_stack_ptr = 0;
+    vm->current_scope = 0;
+    vm->id = 0;
+    vm->owner = 0;
+    vm->rng_state = (uint64_t)time(NULL) | 1;
+    threads[0] = vm;
     current_module = 0;
     
     strcpy(modules[0].name, "main");
@@ -272,16 +916,21 @@ void init_sosu_os() {
     modules[0].is_loaded = true;
     module_count = 1;
     
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+    
     printf("[SOSU OS KERNEL v3.0] Initializing...\n");
     printf("[MEMORY] %d KB available\n", MEMORY_SIZE / 1024);
     printf("[CPU] Registers initialized\n");
     printf("[FS] File system ready\n");
     printf("[GC] Garbage collector enabled\n");
     printf("[JIT] JIT compiler ready\n");
+    printf("[SIMD] %s array kernels\n", array_select_kernels());
+    profile_calibrate();
     printf("[PROFILER] Performance monitoring active\n");
 }
 
 void gc_mark_object(unsigned int address, unsigned int size) {
+    pthread_mutex_lock(&gc_lock);
     if (gc_object_count < 1000) {
         gc_objects[gc_object_count].address = address;
         gc_objects[gc_object_count].size = size;
@@ -289,6 +938,66 @@ void gc_mark_object(unsigned int address, unsigned int size) {
         gc_objects[gc_object_count].allocated_time = time(NULL);
         gc_object_count++;
     }
+    pthread_mutex_unlock(&gc_lock);
+}
+
+static inline uint64_t metrics_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void metrics_observe(Histogram* histogram, uint64_t ns) {
+    int bucket = 0;
+    while (bucket < METRICS_BUCKETS - 1 && ns > metrics_bounds[bucket] * 1e9) bucket++;
+    atomic_fetch_add_explicit(&histogram->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+}
+
+static inline void metrics_count_instruction() {
+    if (++metrics_pending == METRICS_BATCH) {
+        atomic_fetch_add_explicit(&metrics.instructions, METRICS_BATCH, memory_order_relaxed);
+        metrics_pending = 0;
+    }
+}
+
+void metrics_flush() {
+    atomic_fetch_add_explicit(&metrics.instructions, metrics_pending, memory_order_relaxed);
+    metrics_pending = 0;
+}
+
+static inline uint64_t profile_clock();
+
+TraceBuffer* trace_buffer() {
+    if (!trace_local) {
+        int index = atomic_fetch_add(&trace_buffer_count, 1);
+        if (index >= MAX_TRACE_BUFFERS) {
+            atomic_fetch_sub(&trace_buffer_count, 1);
+            return NULL;
+        }
+        trace_local = calloc(1, sizeof(TraceBuffer));
+        if (!trace_local) return NULL;
+        trace_local->index = index;
+        trace_buffers[index] = trace_local;
+    }
+    return trace_local;
+}
+
+void trace_event(TraceKind kind, int line, int arg) {
+    TraceBuffer* buffer = trace_local ? trace_local : trace_buffer();
+    if (!buffer) return;
+    
+    uint64_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    TraceEvent* event = &buffer->events[head & (TRACE_RING_SIZE - 1)];
+    event->timestamp = profile_clock();
+    event->line = line;
+    event->sp = vm->sp;
+    event->arg = arg;
+    event->opcode = line >= 0 && line < program_size ? program[line].opcode : 0;
+    event->kind = kind;
+    event->thread = (uint8_t)buffer->index;
+    atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
 }
 
 void gc_collect() {
@@ -297,18 +1006,30 @@ void gc_collect() {
     static time_t last_gc = 0;
     time_t now = time(NULL);
     
+    pthread_mutex_lock(&gc_lock);
     if (gc_object_count > 800 || (now - last_gc) > 30) {
-        printf("[GC] Collecting garbage... (%d objects)\n", gc_object_count);
+        uint64_t start = metrics_now();
+        int collected = gc_object_count;
+        printf("[GC] Collecting garbage... (%d objects)\n", collected);
         
         gc_object_count = 0;
         last_gc = now;
+        atomic_fetch_add_explicit(&metrics.gc_cycles, 1, memory_order_relaxed);
+        if (tracing) trace_event(TRACE_GC, vm->current_line, collected);
+        metrics_observe(&metrics.gc_pause, metrics_now() - start);
     }
+    pthread_mutex_unlock(&gc_lock);
 }
 
 void* jit_compile_function(const char* name) {
+    void* code = NULL;
+    
+    pthread_mutex_lock(&jit_lock);
     for (int i = 0; i < jit_count; i++) {
         if (strcmp(jit_cache[i].function_name, name) == 0) {
-            return jit_cache[i].compiled_code;
+            code = jit_cache[i].compiled_code;
+            pthread_mutex_unlock(&jit_lock);
+            return code;
         }
     }
     
@@ -317,1096 +1038,6649 @@ void* jit_compile_function(const char* name) {
         jit_cache[jit_count].compiled_code = NULL;
         jit_cache[jit_count].is_compiled = true;
         jit_count++;
+        atomic_fetch_add_explicit(&metrics.jit_compilations, 1, memory_order_relaxed);
     }
+    pthread_mutex_unlock(&jit_lock);
     
-    return NULL;
+    return code;
 }
 
-void profile_start(const char* function_name) {
-    if (!profiling_enabled) return;
-    
-    for (int i = 0; i < profile_count; i++) {
-        if (strcmp(profile_data[i].function_name, function_name) == 0) {
-            profile_data[i].call_count++;
-            return;
-        }
-    }
-    
-    if (profile_count < 512) {
-        strcpy(profile_data[profile_count].function_name, function_name);
-        profile_data[profile_count].call_count = 1;
-        profile_data[profile_count].total_time = 0;
-        profile_data[profile_count].average_time = 0;
-        profile_count++;
-    }
+static inline uint64_t profile_clock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
 }
 
-void profile_report() {
-    if (!profiling_enabled || profile_count == 0) return;
-    
-    printf("\n=== SOSU OS PERFORMANCE REPORT ===\n");
-    printf("%-30s %-10s %-15s %-15s\n", "Function", "Calls", "Total Time", "Avg Time");
-    printf("-----------------------------------------------\n");
-    
-    for (int i = 0; i < profile_count; i++) {
-        printf("%-30s %-10llu %-15llu %-15llu\n",
-               profile_data[i].function_name,
-               profile_data[i].call_count,
-               profile_data[i].total_time,
-               profile_data[i].average_time);
-    }
-    printf("===============================================\n");
+/* Takes one clock/TSC reading at boot; profile_tick_scale() measures the rate against it
+   whenever a report needs nanoseconds, so calibrating never stalls the program. */
+void profile_calibrate() {
+    clock_gettime(CLOCK_MONOTONIC, &profile_epoch);
+    profile_epoch_ticks = profile_clock();
 }
 
-void push_int64(int64_t value) {
-    if (sp >= STACK_SIZE) {
-        fprintf(stderr, "[KERNEL PANIC] Stack overflow at line %d\n", current_line);
-        profile_report();
-        exit(1);
-    }
-    stack[sp].i64 = value;
-    stack_types[sp] = TYPE_INT64;
-    sp++;
+double profile_tick_scale() {
+#if defined(__x86_64__) || defined(__i386__)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ticks = profile_clock() - profile_epoch_ticks;
+    double elapsed = (now.tv_sec - profile_epoch.tv_sec) * 1e9 + (now.tv_nsec - profile_epoch.tv_nsec);
+    if (profile_epoch_ticks && ticks > 0) profile_ns_per_tick = elapsed / ticks;
+#endif
+    return profile_ns_per_tick;
 }
 
-void push_float64(double value) {
-    if (sp >= STACK_SIZE) {
-        fprintf(stderr, "[KERNEL PANIC] Stack overflow at line %d\n", current_line);
-        profile_report();
-        exit(1);
+ProfileThread* profile_thread() {
+    if (!profile_local) {
+        profile_local = calloc(1, sizeof(ProfileThread));
+        if (!profile_local) {
+            fprintf(stderr, "[OUT OF MEMORY] Cannot allocate profiler state\n");
+            exit(1);
+        }
+        pthread_mutex_lock(&profile_lock);
+        profile_local->next = profile_threads;
+        profile_threads = profile_local;
+        pthread_mutex_unlock(&profile_lock);
     }
-    stack[sp].f64 = value;
-    stack_types[sp] = TYPE_FLOAT64;
-    sp++;
+    return profile_local;
 }
 
-void push_bool(bool value) {
-    if (sp >= STACK_SIZE) {
-        fprintf(stderr, "[KERNEL PANIC] Stack overflow at line %d\n", current_line);
-        profile_report();
-        exit(1);
-    }
-    stack[sp].b = value;
-    stack_types[sp] = TYPE_BOOL;
-    sp++;
+void profile_enter(int function) {
+    ProfileThread* profile = profile_thread();
+    if (profile->depth >= MAX_CALL_STACK) return;
+    
+    ProfileFrame* frame = &profile->frames[profile->depth++];
+    frame->function = function < 0 ? PROFILE_TOPLEVEL : function;
+    frame->child_time = 0;
+    frame->start = profile_clock();
 }
 
-void push_ptr(void* value) {
-    if (sp >= STACK_SIZE) {
-        fprintf(stderr, "[KERNEL PANIC] Stack overflow at line %d\n", current_line);
-        profile_report();
-        exit(1);
+void profile_exit() {
+    uint64_t now = profile_clock();
+    ProfileThread* profile = profile_local;
+    if (!profile || profile->depth == 0) return;
+    
+    ProfileFrame* frame = &profile->frames[--profile->depth];
+    uint64_t elapsed = now - frame->start;
+    ProfileEntry* entry = &profile->entries[frame->function];
+    entry->call_count++;
+    entry->self_time += elapsed - frame->child_time;
+    
+    bool recursive = false;
+    for (int i = 0; i < profile->depth; i++) {
+        if (profile->frames[i].function == frame->function) {
+            recursive = true;
+            break;
+        }
     }
-    stack[sp].ptr = value;
-    stack_types[sp] = TYPE_POINTER;
-    sp++;
+    if (!recursive) entry->total_time += elapsed;
+    if (profile->depth > 0) profile->frames[profile->depth - 1].child_time += elapsed;
 }
 
-union StackValue pop_value() {
-    if (sp <= 0) {
-        fprintf(stderr, "[KERNEL PANIC] Stack underflow at line %d\n", current_line);
-        profile_report();
-        exit(1);
-    }
-    return stack[--sp];
+int sample_function(int line) {
+    return line >= 0 && line < program_size ? program[line].function_id : -1;
 }
 
-int64_t pop_int64() {
-    if (sp <= 0) {
-        fprintf(stderr, "[TYPE ERROR] Stack empty at line %d\n", current_line);
-        profile_report();
-        exit(1);
-    }
-    
-    DataType type = stack_types[sp-1];
-    switch (type) {
-        case TYPE_INT8: return (int64_t)stack[--sp].i8;
-        case TYPE_INT16: return (int64_t)stack[--sp].i16;
-        case TYPE_INT32: return (int64_t)stack[--sp].i32;
-        case TYPE_INT64: return stack[--sp].i64;
-        case TYPE_UINT8: return (int64_t)stack[--sp].u8;
-        case TYPE_UINT16: return (int64_t)stack[--sp].u16;
-        case TYPE_UINT32: return (int64_t)stack[--sp].u32;
-        case TYPE_UINT64: return (int64_t)stack[--sp].u64;
-        case TYPE_CHAR: return (int64_t)stack[--sp].c;
-        case TYPE_BOOL: return (int64_t)stack[--sp].b;
-        case TYPE_FLOAT32: return (int64_t)stack[--sp].f32;
-        case TYPE_FLOAT64: return (int64_t)stack[--sp].f64;
-        default:
-            fprintf(stderr, "[TYPE ERROR] Cannot convert to int64 at line %d\n", current_line);
-            profile_report();
-            exit(1);
-    }
+/* Opens profiler frames for the calls already in progress when `benchmark` turns profiling
+   on mid-run, so they are timed from this point instead of being dropped on return. */
+void profile_resume(int line) {
+    ProfileThread* profile = profile_thread();
+    profile->depth = 0;
+    profile_enter(sample_function(vm->call_stack_ptr > 0 ? vm->call_stack[0].return_address : line));
+    for (int i = 0; i < vm->call_stack_ptr; i++) profile_enter(vm->call_stack[i].function);
 }
 
-double pop_float64() {
-    if (sp <= 0) {
-        fprintf(stderr, "[TYPE ERROR] Stack empty at line %d\n", current_line);
-        profile_report();
-        exit(1);
+void sample_signal(int sig) {
+    (void)sig;
+    VMThread* thread = vm;
+    if (!sampling || !thread) return;
+    
+    unsigned int index = atomic_fetch_add_explicit(&sample_next, 1, memory_order_relaxed);
+    if (index >= MAX_SAMPLES) {
+        atomic_fetch_add_explicit(&samples_dropped, 1, memory_order_relaxed);
+        return;
     }
     
-    DataType type = stack_types[sp-1];
-    switch (type) {
-        case TYPE_INT8: return (double)stack[--sp].i8;
-        case TYPE_INT16: return (double)stack[--sp].i16;
-        case TYPE_INT32: return (double)stack[--sp].i32;
-        case TYPE_INT64: return (double)stack[--sp].i64;
-        case TYPE_UINT8: return (double)stack[--sp].u8;
-        case TYPE_UINT16: return (double)stack[--sp].u16;
-        case TYPE_UINT32: return (double)stack[--sp].u32;
-        case TYPE_UINT64: return (double)stack[--sp].u64;
-        case TYPE_FLOAT32: return (double)stack[--sp].f32;
-        case TYPE_FLOAT64: return stack[--sp].f64;
-        default:
-            fprintf(stderr, "[TYPE ERROR] Cannot convert to float64 at line %d\n", current_line);
-            profile_report();
-            exit(1);
+    Sample* sample = &samples[index];
+    int depth = thread->call_stack_ptr;
+    if (depth < 0) depth = 0;
+    if (depth > MAX_CALL_STACK) depth = MAX_CALL_STACK;
+    
+    int count = 0;
+    for (int i = depth > SAMPLE_DEPTH - 1 ? depth - (SAMPLE_DEPTH - 1) : 0; i < depth; i++) {
+        sample->functions[count++] = sample_function(thread->call_stack[i].return_address);
     }
+    sample->line = thread->current_line;
+    sample->functions[count++] = sample_function(sample->line);
+    sample->depth = count;
 }
 
-bool pop_bool() {
-    if (sp <= 0) {
-        fprintf(stderr, "[TYPE ERROR] Stack empty at line %d\n", current_line);
-        profile_report();
-        exit(1);
+void sample_stop();
+
+void sample_start() {
+    if (sample_hz <= 0) return;
+    
+    samples = calloc(MAX_SAMPLES, sizeof(Sample));
+    if (!samples) {
+        fprintf(stderr, "[OUT OF MEMORY] Cannot allocate sample buffer\n");
+        return;
     }
     
-    DataType type = stack_types[sp-1];
-    switch (type) {
-        case TYPE_BOOL: return stack[--sp].b;
-        case TYPE_INT8: return stack[--sp].i8 != 0;
-        case TYPE_INT16: return stack[--sp].i16 != 0;
-        case TYPE_INT32: return stack[--sp].i32 != 0;
-        case TYPE_INT64: return stack[--sp].i64 != 0;
-        default:
-            fprintf(stderr, "[TYPE ERROR] Cannot convert to bool at line %d\n", current_line);
-            profile_report();
-            exit(1);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = sample_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+    
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGPROF;
+    if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &event, &sample_timer) != 0) {
+        fprintf(stderr, "[PROFILER] Cannot create sampling timer: %s\n", strerror(errno));
+        return;
     }
+    
+    long interval = 1000000000L / sample_hz;
+    struct itimerspec spec = {
+        .it_interval = { interval / 1000000000L, interval % 1000000000L },
+        .it_value = { interval / 1000000000L, interval % 1000000000L }
+    };
+    sampling = 1;
+    timer_settime(sample_timer, 0, &spec, NULL);
+    atexit(sample_stop);
+    printf("[PROFILER] Sampling at %d Hz\n", sample_hz);
 }
 
-void* pop_ptr() {
-    if (sp <= 0 || stack_types[sp-1] != TYPE_POINTER) {
-        fprintf(stderr, "[TYPE ERROR] Expected pointer at line %d\n", current_line);
-        profile_report();
-        exit(1);
-    }
-    return stack[--sp].ptr;
+int compare_strings(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
 }
 
-unsigned int malloc_sosu(unsigned int size) {
-    unsigned int addr = heap_start;
-    heap_start += size;
+void sample_stop() {
+    if (!sampling) return;
+    sampling = 0;
+    timer_delete(sample_timer);
     
-    if (heap_start >= memory_size) {
-        fprintf(stderr, "[OUT OF MEMORY] Cannot allocate %u bytes\n", size);
-        profile_report();
-        exit(1);
+    unsigned int count = atomic_load(&sample_next);
+    if (count > MAX_SAMPLES) count = MAX_SAMPLES;
+    
+    FILE* out = fopen(sample_path, "w");
+    if (!out) {
+        fprintf(stderr, "[PROFILER] Cannot write '%s': %s\n", sample_path, strerror(errno));
+        return;
     }
     
-    if (gc_enabled) {
-        gc_mark_object(addr, size);
+    char** stacks = malloc((count ? count : 1) * sizeof(char*));
+    for (unsigned int i = 0; i < count; i++) {
+        Sample* sample = &samples[i];
+        char buffer[SAMPLE_DEPTH * 64 + 32];
+        int length = 0;
+        for (int j = 0; j < sample->depth; j++) {
+            int function = sample->functions[j];
+            const char* name = function >= 0 ? functions[function].name : "<toplevel>";
+            length += snprintf(buffer + length, sizeof(buffer) - length, "%s%.60s", j ? ";" : "", name);
+        }
+        int line = sample->line >= 0 && sample->line < program_size ? program[sample->line].line_number : 0;
+        snprintf(buffer + length, sizeof(buffer) - length, ":%d", line);
+        stacks[i] = strdup(buffer);
     }
+    qsort(stacks, count, sizeof(char*), compare_strings);
     
-    return addr;
+    for (unsigned int i = 0; i < count; ) {
+        unsigned int j = i + 1;
+        while (j < count && strcmp(stacks[i], stacks[j]) == 0) j++;
+        fprintf(out, "%s %u\n", stacks[i], j - i);
+        i = j;
+    }
+    for (unsigned int i = 0; i < count; i++) free(stacks[i]);
+    free(stacks);
+    fclose(out);
+    
+    printf("[PROFILER] %u samples written to '%s' (%u dropped)\n", count, sample_path, atomic_load(&samples_dropped));
 }
 
-void free_sosu(unsigned int address) {
+int decode_opcode(const char* line) {
+    while (*line == ' ' || *line == '\t') line++;
+    
+    char token[64];
+    int length = 0;
+    while (line[length] && line[length] != ' ' && line[length] != '\t' && length < (int)sizeof(token) - 1) {
+        token[length] = line[length];
+        length++;
+    }
+    while (length > 1 && token[length - 1] == ';') length--;
+    token[length] = '\0';
+    
+    if (length == 0 || token[0] == ';' || strncmp(token, "//", 2) == 0) return OP_EMPTY;
+    for (int i = OP_IDENTIFIER + 1; i < OP_COUNT; i++) {
+        if (strcmp(token, opcode_names[i]) == 0) return i;
+    }
+    if (token[length - 1] == ':') return OP_LABEL;
+    if (isdigit(token[0]) || (token[0] == '-' && isdigit(token[1]))) return OP_LITERAL;
+    if (token[0] == '&') return OP_FUNCREF;
+    return OP_IDENTIFIER;
 }
 
-int find_variable(const char* name) {
-    for (int i = variable_count - 1; i >= 0; i--) {
-        if (strcmp(variables[i].name, name) == 0) {
-            if (variables[i].scope_level <= current_scope || variables[i].is_global) {
-                return i;
-            }
+HotspotThread* hotspot_thread() {
+    if (!hotspot_local) {
+        hotspot_local = calloc(1, sizeof(HotspotThread));
+        if (!hotspot_local) {
+            fprintf(stderr, "[OUT OF MEMORY] Cannot allocate hotspot counters\n");
+            exit(1);
         }
+        pthread_mutex_lock(&hotspot_lock);
+        hotspot_local->next = hotspot_threads;
+        hotspot_threads = hotspot_local;
+        pthread_mutex_unlock(&hotspot_lock);
     }
-    return -1;
+    return hotspot_local;
 }
 
-unsigned int get_variable_address(const char* name) {
-    int index = find_variable(name);
-    if (index != -1) {
-        return variables[index].address;
-    }
-    fprintf(stderr, "[RUNTIME ERROR] Undefined variable '%s' at line %d\n", name, current_line);
-    profile_report();
-    exit(1);
+/* Each OS thread counts into its own table, merged by hotspot_report. Reading the cycle
+   counter twice per line costs more than most lines, so timing is only on with
+   --hotspot-cycles. */
+int execute_counted(int line) {
+    LineCounter* counter = &hotspot_thread()->lines[line];
+    counter->count++;
+    if (!hotspot_cycles) return execute_command(program[line].line, line);
+    
+    uint64_t start = profile_clock();
+    int result = execute_command(program[line].line, line);
+    counter->cycles += profile_clock() - start;
+    return result;
 }
 
-DataType get_variable_type(const char* name) {
-    int index = find_variable(name);
-    if (index != -1) {
-        return variables[index].type;
-    }
-    return TYPE_VOID;
+int compare_hot_lines(const void* a, const void* b) {
+    const LineCounter* x = &line_counters[*(const int*)a];
+    const LineCounter* y = &line_counters[*(const int*)b];
+    if (x->cycles != y->cycles) return x->cycles < y->cycles ? 1 : -1;
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
 }
 
-void declare_variable(const char* name, DataType type, bool is_global, bool is_const, bool is_static) {
-    if (variable_count >= MAX_VARIABLES) {
-        fprintf(stderr, "[KERNEL PANIC] Too many variables\n");
-        profile_report();
-        exit(1);
+void hotspot_report() {
+    if (!hotspots_enabled) return;
+    
+    uint64_t total_count = 0, total_cycles = 0;
+    uint64_t opcode_counts[OP_COUNT] = { 0 };
+    uint64_t opcode_cycles[OP_COUNT] = { 0 };
+    int* order = malloc((program_size ? program_size : 1) * sizeof(int));
+    int hot = 0;
+    
+    memset(line_counters, 0, sizeof(line_counters));
+    pthread_mutex_lock(&hotspot_lock);
+    for (HotspotThread* counters = hotspot_threads; counters; counters = counters->next) {
+        for (int i = 0; i < program_size; i++) {
+            line_counters[i].count += counters->lines[i].count;
+            line_counters[i].cycles += counters->lines[i].cycles;
+        }
     }
+    pthread_mutex_unlock(&hotspot_lock);
     
-    for (int i = variable_count - 1; i >= 0; i--) {
-        if (strcmp(variables[i].name, name) == 0 && 
-            variables[i].scope_level == current_scope &&
-            variables[i].module_id == current_module) {
-            fprintf(stderr, "[COMPILE ERROR] Variable '%s' already declared at line %d\n", name, current_line);
-            profile_report();
-            exit(1);
-        }
-        if (variables[i].scope_level < current_scope) break;
+    for (int i = 0; i < program_size; i++) {
+        if (line_counters[i].count == 0) continue;
+        order[hot++] = i;
+        total_count += line_counters[i].count;
+        total_cycles += line_counters[i].cycles;
+        opcode_counts[program[i].opcode] += line_counters[i].count;
+        opcode_cycles[program[i].opcode] += line_counters[i].cycles;
     }
+    qsort(order, hot, sizeof(int), compare_hot_lines);
     
-    unsigned int size = 0;
-    switch (type) {
-        case TYPE_INT8: case TYPE_UINT8: case TYPE_CHAR: size = 1; break;
-        case TYPE_INT16: case TYPE_UINT16: size = 2; break;
-        case TYPE_INT32: case TYPE_UINT32: case TYPE_FLOAT32: size = 4; break;
-        case TYPE_INT64: case TYPE_UINT64: case TYPE_FLOAT64: case TYPE_POINTER: size = 8; break;
-        case TYPE_BOOL: size = 1; break;
-        default: size = 8; break;
+    printf("\n=== SOSU OS HOTSPOTS (top %d of %d lines) ===\n", hot < hotspot_top ? hot : hotspot_top, hot);
+    printf("%-6s %-12s %-14s %-7s %s\n", "Line", "Count", hotspot_cycles ? "Cycles" : "", "%", "Source");
+    printf("-----------------------------------------------\n");
+    for (int i = 0; i < hot && i < hotspot_top; i++) {
+        int line = order[i];
+        const char* text = program[line].line;
+        while (*text == ' ' || *text == '\t') text++;
+        char cycles[24] = "";
+        if (hotspot_cycles) snprintf(cycles, sizeof(cycles), "%llu", (unsigned long long)line_counters[line].cycles);
+        printf("%-6d %-12llu %-14s %-7.2f %s\n",
+               program[line].line_number,
+               (unsigned long long)line_counters[line].count, cycles,
+               hotspot_cycles ? 100.0 * line_counters[line].cycles / (total_cycles ? total_cycles : 1)
+                              : 100.0 * line_counters[line].count / total_count,
+               text);
     }
     
-    unsigned int addr = malloc_sosu(size);
+    printf("-----------------------------------------------\n");
+    printf("%-14s %-12s %-14s %-10s\n", "Opcode", "Count", hotspot_cycles ? "Cycles" : "", hotspot_cycles ? "Cyc/Op" : "");
+    for (int n = 0; n < OP_COUNT; n++) {
+        int best = -1;
+        for (int i = 0; i < OP_COUNT; i++) {
+            if (opcode_counts[i] && (best == -1 || opcode_counts[i] > opcode_counts[best])) best = i;
+        }
+        if (best == -1) break;
+        if (hotspot_cycles) {
+            printf("%-14s %-12llu %-14llu %-10.1f\n", opcode_names[best],
+                   (unsigned long long)opcode_counts[best],
+                   (unsigned long long)opcode_cycles[best],
+                   (double)opcode_cycles[best] / opcode_counts[best]);
+        } else {
+            printf("%-14s %-12llu\n", opcode_names[best], (unsigned long long)opcode_counts[best]);
+        }
+        opcode_counts[best] = 0;
+    }
+    if (hotspot_cycles) {
+        printf("Total: %llu instructions, %llu cycles\n", (unsigned long long)total_count, (unsigned long long)total_cycles);
+    } else {
+        printf("Total: %llu instructions (--hotspot-cycles adds cycle counts)\n", (unsigned long long)total_count);
+    }
+    printf("===============================================\n");
+    free(order);
     
-    strcpy(variables[variable_count].name, name);
-    variables[variable_count].address = addr;
-    variables[variable_count].type = type;
-    variables[variable_count].size = size;
-    variables[variable_count].is_global = is_global;
-    variables[variable_count].is_const = is_const;
-    variables[variable_count].is_static = is_static;
-    variables[variable_count].scope_level = current_scope;
-    variables[variable_count].module_id = current_module;
-    variable_count++;
+    if (annotate_path[0]) {
+        FILE* out = fopen(annotate_path, "w");
+        if (!out) {
+            fprintf(stderr, "[PROFILER] Cannot write '%s': %s\n", annotate_path, strerror(errno));
+            return;
+        }
+        for (int i = 0; i < program_size; i++) {
+            if (line_counters[i].count) {
+                char cycles[24] = "";
+                if (hotspot_cycles) snprintf(cycles, sizeof(cycles), "%llu", (unsigned long long)line_counters[i].cycles);
+                fprintf(out, "%12llu %14s %6.2f%% | %5d: %s\n",
+                        (unsigned long long)line_counters[i].count, cycles,
+                        hotspot_cycles ? 100.0 * line_counters[i].cycles / (total_cycles ? total_cycles : 1)
+                                       : 100.0 * line_counters[i].count / total_count,
+                        program[i].line_number, program[i].line);
+            } else {
+                fprintf(out, "%12s %14s %7s | %5d: %s\n", "", "", "", program[i].line_number, program[i].line);
+            }
+        }
+        fclose(out);
+        printf("[PROFILER] Annotated source written to '%s'\n", annotate_path);
+    }
 }
 
-int find_function(const char* name) {
-    for (int i = 0; i < function_count; i++) {
-        if (strcmp(functions[i].name, name) == 0) {
-            return i;
+void metrics_write_histogram(FILE* out, const char* name, const char* labels, Histogram* histogram) {
+    uint64_t cumulative = 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        cumulative += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        if (i < METRICS_BUCKETS - 1) {
+            fprintf(out, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, labels[0] ? "," : "",
+                    metrics_bounds[i], (unsigned long long)cumulative);
+        } else {
+            fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, labels[0] ? "," : "",
+                    (unsigned long long)cumulative);
         }
     }
-    return -1;
+    fprintf(out, "%s_sum%s%s%s %.9f\n", name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "",
+            atomic_load_explicit(&histogram->sum_ns, memory_order_relaxed) / 1e9);
+    fprintf(out, "%s_count%s%s%s %llu\n", name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "",
+            (unsigned long long)atomic_load_explicit(&histogram->count, memory_order_relaxed));
 }
 
-void declare_function(const char* name, int line_number, DataType return_type, bool is_external, bool is_inline) {
-    if (function_count >= MAX_FUNCTIONS) {
-        fprintf(stderr, "[KERNEL PANIC] Too many functions\n");
-        profile_report();
-        exit(1);
+void metrics_write_histogram_json(FILE* out, Histogram* histogram) {
+    fprintf(out, "{\"buckets\": [");
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        fprintf(out, "%s%llu", i ? ", " : "",
+                (unsigned long long)atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed));
     }
-    
-    strcpy(functions[function_count].name, name);
-    functions[function_count].line_number = line_number;
-    functions[function_count].return_type = return_type;
-    functions[function_count].param_count = 0;
-    functions[function_count].is_external = is_external;
-    functions[function_count].is_inline = is_inline;
-    functions[function_count].module_id = current_module;
-    function_count++;
+    fprintf(out, "], \"sum_seconds\": %.9f, \"count\": %llu}",
+            atomic_load_explicit(&histogram->sum_ns, memory_order_relaxed) / 1e9,
+            (unsigned long long)atomic_load_explicit(&histogram->count, memory_order_relaxed));
 }
 
-int find_struct(const char* name) {
-    for (int i = 0; i < struct_count; i++) {
-        if (strcmp(structs[i].name, name) == 0) {
-            return i;
-        }
-    }
-    return -1;
+/* Syscall numbers outside the table share the last bucket. */
+Histogram* metrics_syscall(int64_t number) {
+    return &metrics.syscalls[number >= 0 && number < METRICS_SYSCALLS ? number : METRICS_SYSCALLS];
 }
 
-void declare_struct(const char* name) {
-    if (struct_count >= MAX_STRUCTS) {
-        fprintf(stderr, "[KERNEL PANIC] Too many structs\n");
-        profile_report();
-        exit(1);
+const char* metrics_syscall_label(int index) {
+    static char labels[METRICS_SYSCALLS][4];
+    if (index == METRICS_SYSCALLS) return "other";
+    snprintf(labels[index], sizeof(labels[index]), "%d", index);
+    return labels[index];
+}
+
+void metrics_write(FILE* out) {
+    unsigned long long executed = tasks_executed, stolen = tasks_stolen;
+    if (workers && executed == 0) {
+        for (int i = 0; i < worker_count; i++) {
+            executed += workers[i].executed;
+            stolen += workers[i].stolen;
+        }
+    }
+    unsigned long long values[] = {
+        atomic_load(&metrics.instructions),
+        atomic_load(&metrics.allocations),
+        atomic_load(&metrics.allocated_bytes),
+        atomic_load(&heap_start) - HEAP_BASE,
+        atomic_load(&metrics.gc_cycles),
+        atomic_load(&metrics.jit_compilations),
+        executed,
+        stolen
+    };
+    static const char* names[] = {
+        "sosu_instructions_total", "sosu_allocations_total", "sosu_allocated_bytes_total",
+        "sosu_heap_used_bytes", "sosu_gc_cycles_total", "sosu_jit_compilations_total",
+        "sosu_tasks_executed_total", "sosu_tasks_stolen_total"
+    };
+    int value_count = sizeof(values) / sizeof(values[0]);
+    
+    if (metrics_json) {
+        fprintf(out, "{\n");
+        for (int i = 0; i < value_count; i++) {
+            fprintf(out, "  \"%s\": %llu,\n", names[i] + 5, values[i]);
+        }
+        fprintf(out, "  \"gc_pause_seconds\": ");
+        metrics_write_histogram_json(out, &metrics.gc_pause);
+        fprintf(out, ",\n  \"bucket_bounds_seconds\": [");
+        for (int i = 0; i < METRICS_BUCKETS - 1; i++) {
+            fprintf(out, "%s%g", i ? ", " : "", metrics_bounds[i]);
+        }
+        fprintf(out, "],\n  \"syscalls\": {");
+        bool first = true;
+        for (int i = 0; i <= METRICS_SYSCALLS; i++) {
+            if (atomic_load_explicit(&metrics.syscalls[i].count, memory_order_relaxed) == 0) continue;
+            fprintf(out, "%s\n    \"%s\": ", first ? "" : ",", metrics_syscall_label(i));
+            metrics_write_histogram_json(out, &metrics.syscalls[i]);
+            first = false;
+        }
+        fprintf(out, "%s}\n}\n", first ? "" : "\n  ");
+        return;
     }
     
-    strcpy(structs[struct_count].name, name);
-    structs[struct_count].field_count = 0;
-    structs[struct_count].total_size = 0;
-    struct_count++;
+    for (int i = 0; i < value_count; i++) {
+        bool gauge = strstr(names[i], "_total") == NULL;
+        fprintf(out, "# TYPE %s %s\n%s %llu\n", names[i], gauge ? "gauge" : "counter", names[i], values[i]);
+    }
+    fprintf(out, "# TYPE sosu_gc_pause_seconds histogram\n");
+    metrics_write_histogram(out, "sosu_gc_pause_seconds", "", &metrics.gc_pause);
+    fprintf(out, "# TYPE sosu_syscalls_total counter\n");
+    for (int i = 0; i <= METRICS_SYSCALLS; i++) {
+        uint64_t count = atomic_load_explicit(&metrics.syscalls[i].count, memory_order_relaxed);
+        if (count) fprintf(out, "sosu_syscalls_total{syscall=\"%s\"} %llu\n", metrics_syscall_label(i), (unsigned long long)count);
+    }
+    fprintf(out, "# TYPE sosu_syscall_duration_seconds histogram\n");
+    for (int i = 0; i <= METRICS_SYSCALLS; i++) {
+        if (atomic_load_explicit(&metrics.syscalls[i].count, memory_order_relaxed) == 0) continue;
+        char labels[32];
+        snprintf(labels, sizeof(labels), "syscall=\"%.8s\"", metrics_syscall_label(i));
+        metrics_write_histogram(out, "sosu_syscall_duration_seconds", labels, &metrics.syscalls[i]);
+    }
 }
 
-int find_label(const char* name) {
-    for (int i = 0; i < label_count; i++) {
-        if (strcmp(labels[i].name, name) == 0) {
-            return labels[i].line_number;
-        }
+void metrics_dump() {
+    if (!metrics_path[0]) return;
+    
+    char temp_path[300];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", metrics_path);
+    FILE* out = fopen(temp_path, "w");
+    if (!out) {
+        fprintf(stderr, "[METRICS] Cannot write '%s': %s\n", temp_path, strerror(errno));
+        return;
     }
-    return -1;
+    metrics_write(out);
+    fclose(out);
+    rename(temp_path, metrics_path);
 }
 
-void add_label(const char* name, int line_number) {
-    if (label_count >= MAX_LABELS) {
-        fprintf(stderr, "[KERNEL PANIC] Too many labels\n");
-        profile_report();
-        exit(1);
+void* metrics_thread_main(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&metrics_lock);
+    while (!metrics_stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += metrics_interval;
+        pthread_cond_timedwait(&metrics_cond, &metrics_lock, &deadline);
+        if (!metrics_stop) metrics_dump();
     }
-    
-    strcpy(labels[label_count].name, name);
-    labels[label_count].line_number = line_number;
-    labels[label_count].return_type = TYPE_VOID;
-    labels[label_count].module_id = current_module;
-    label_count++;
+    pthread_mutex_unlock(&metrics_lock);
+    return NULL;
 }
 
-bool system_call(int64_t call_num) {
-    switch (call_num) {
-        case SYS_EXIT:
-            {
-                int64_t exit_code = pop_int64();
-                printf("[SYSTEM] Process terminated with code %ld\n", exit_code);
-                if (profiling_enabled) profile_report();
-                exit((int)exit_code);
-                break;
-            }
-        case SYS_PRINT:
-            {
-                int64_t addr = pop_int64();
-                int64_t len = pop_int64();
-                if (len > 0 && addr + len <= memory_size) {
-                    for (int64_t i = 0; i < len; i++) {
-                        putchar(memory[addr + i]);
-                    }
-                    fflush(stdout);
-                }
-                break;
-            }
-        case SYS_PUTCHAR:
-            {
-                char ch = (char)pop_int64();
-                putchar(ch);
-                fflush(stdout);
-                break;
-            }
-        case SYS_GETCHAR:
-            {
-                int ch = getchar();
-                push_int64(ch);
-                break;
-            }
-        case SYS_MALLOC:
-            {
-                int64_t size = pop_int64();
-                unsigned int addr = malloc_sosu((unsigned int)size);
-                push_int64((int64_t)addr);
-                break;
-            }
-        case SYS_FREE:
-            {
-                unsigned int addr = (unsigned int)pop_int64();
-                free_sosu(addr);
-                break;
-            }
-        case SYS_TIME:
-            {
-                push_int64((int64_t)time(NULL));
-                break;
-            }
-        case SYS_SLEEP:
-            {
-                int64_t seconds = pop_int64();
-                sleep((unsigned int)seconds);
-                break;
-            }
-        case SYS_RANDOM:
-            {
-                static bool seeded = false;
-                if (!seeded) {
-                    srand((unsigned int)time(NULL));
-                    seeded = true;
-                }
-                push_int64((int64_t)rand());
-                break;
-            }
-        case SYS_GETENV:
-            {
-                int64_t addr = pop_int64();
-                char* env_var = getenv((char*)(memory + addr));
-                if (env_var) {
-                    push_int64((int64_t)malloc_sosu(strlen(env_var) + 1));
-                    strcpy((char*)(memory + stack[sp-1].i64), env_var);
-                } else {
-                    push_int64(0);
-                }
-                break;
-            }
-        default:
-            fprintf(stderr, "[KERNEL PANIC] Unknown system call %ld at line %d\n", call_num, current_line);
-            profile_report();
-            exit(1);
+void metrics_shutdown() {
+    if (atomic_exchange(&metrics_finished, true)) return;
+    if (metrics_thread_started) {
+        pthread_mutex_lock(&metrics_lock);
+        metrics_stop = true;
+        pthread_cond_signal(&metrics_cond);
+        pthread_mutex_unlock(&metrics_lock);
+        pthread_join(metrics_thread, NULL);
+        metrics_thread_started = false;
     }
-    return true;
+    metrics_flush();
+    metrics_dump();
 }
 
-DataType parse_type(const char* type_str) {
-    if (strcmp(type_str, "void") == 0) return TYPE_VOID;
-    if (strcmp(type_str, "int8") == 0 || strcmp(type_str, "byte") == 0) return TYPE_INT8;
-    if (strcmp(type_str, "int16") == 0 || strcmp(type_str, "short") == 0) return TYPE_INT16;
-    if (strcmp(type_str, "int32") == 0 || strcmp(type_str, "int") == 0) return TYPE_INT32;
-    if (strcmp(type_str, "int64") == 0 || strcmp(type_str, "long") == 0) return TYPE_INT64;
-    if (strcmp(type_str, "uint8") == 0 || strcmp(type_str, "ubyte") == 0) return TYPE_UINT8;
-    if (strcmp(type_str, "uint16") == 0 || strcmp(type_str, "ushort") == 0) return TYPE_UINT16;
-    if (strcmp(type_str, "uint32") == 0 || strcmp(type_str, "uint") == 0) return TYPE_UINT32;
-    if (strcmp(type_str, "uint64") == 0 || strcmp(type_str, "ulong") == 0) return TYPE_UINT64;
-    if (strcmp(type_str, "float32") == 0 || strcmp(type_str, "float") == 0) return TYPE_FLOAT32;
-    if (strcmp(type_str, "float64") == 0 || strcmp(type_str, "double") == 0) return TYPE_FLOAT64;
-    if (strcmp(type_str, "char") == 0) return TYPE_CHAR;
-    if (strcmp(type_str, "bool") == 0) return TYPE_BOOL;
-    if (strstr(type_str, "*") != NULL) return TYPE_POINTER;
-    if (strstr(type_str, "[") != NULL) return TYPE_ARRAY;
+void metrics_start() {
+    if (!metrics_path[0]) return;
     
-    int struct_idx = find_struct(type_str);
-    if (struct_idx != -1) return TYPE_STRUCT;
+    size_t length = strlen(metrics_path);
+    if (length > 5 && strcmp(metrics_path + length - 5, ".json") == 0) metrics_json = true;
     
-    return TYPE_VOID;
+    atexit(metrics_shutdown);
+    if (metrics_interval > 0 && pthread_create(&metrics_thread, NULL, metrics_thread_main, NULL) == 0) {
+        metrics_thread_started = true;
+    }
 }
 
-int execute_command(char* line, int line_number) {
-    char command[LINE_SIZE];
-    char tokens[16][LINE_SIZE];
-    int token_count = 0;
-    
-    current_line = line_number;
+bool trace_write_all(int fd, const void* data, size_t size) {
+    const char* bytes = data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool trace_dump() {
+    int fd = open(trace_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
     
-    while (*line == ' ' || *line == '\t') line++;
+    int count = atomic_load(&trace_buffer_count);
+    if (count > MAX_TRACE_BUFFERS) count = MAX_TRACE_BUFFERS;
     
-    if (*line == '\0' || *line == ';' || (*line == '/' && *(line+1) == '/')) return 1;
-    if (strncmp(line, "/*", 2) == 0) return 1;
-    if (strncmp(line, "*/", 2) == 0) return 1;
+    TraceHeader header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.event_size = sizeof(TraceEvent);
+    header.buffer_count = 0;
+    header.ns_per_tick = profile_tick_scale();
+    header.event_count = 0;
     
-    char* token = strtok(line, " \t\n\r");
-    while (token != NULL && token_count < 16) {
-        strcpy(tokens[token_count], token);
-        token_count++;
-        token = strtok(NULL, " \t\n\r");
+    uint64_t heads[MAX_TRACE_BUFFERS];
+    for (int i = 0; i < count; i++) {
+        if (!trace_buffers[i]) {
+            heads[i] = 0;
+            continue;
+        }
+        heads[i] = atomic_load_explicit(&trace_buffers[i]->head, memory_order_acquire);
+        header.event_count += heads[i] < TRACE_RING_SIZE ? heads[i] : TRACE_RING_SIZE;
+        header.buffer_count++;
     }
     
-    if (token_count == 0) return 1;
+    bool ok = trace_write_all(fd, &header, sizeof(header));
+    for (int i = 0; i < count && ok; i++) {
+        if (!trace_buffers[i] || heads[i] == 0) continue;
+        TraceEvent* events = trace_buffers[i]->events;
+        if (heads[i] <= TRACE_RING_SIZE) {
+            ok = trace_write_all(fd, events, heads[i] * sizeof(TraceEvent));
+        } else {
+            size_t split = heads[i] & (TRACE_RING_SIZE - 1);
+            ok = trace_write_all(fd, events + split, (TRACE_RING_SIZE - split) * sizeof(TraceEvent)) &&
+                 trace_write_all(fd, events, split * sizeof(TraceEvent));
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+void trace_signal(int sig) {
+    trace_dump();
+    if (sig == SIGUSR1) return;
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void trace_shutdown() {
+    if (!tracing) return;
+    tracing = false;
+    if (trace_dump()) {
+        printf("[TRACE] Trace written to '%s'\n", trace_path);
+    } else {
+        fprintf(stderr, "[TRACE] Cannot write '%s': %s\n", trace_path, strerror(errno));
+    }
+}
+
+void trace_start() {
+    static bool installed = false;
+    if (!tracing || installed) return;
+    installed = true;
     
-    strcpy(command, tokens[0]);
+    trace_buffer();
     
-    if (jit_count < 256 && rand() % 100 < 5) {
-        jit_compile_function(command);
-    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = trace_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+    action.sa_flags = SA_RESETHAND;
+    sigaction(SIGSEGV, &action, NULL);
+    sigaction(SIGBUS, &action, NULL);
+    sigaction(SIGFPE, &action, NULL);
+    sigaction(SIGABRT, &action, NULL);
+    atexit(trace_shutdown);
+}
+
+void profile_report() {
+    if (!profiling_enabled) return;
     
-    if (rand() % 1000 < 10) {
-        gc_collect();
+    while (profile_local && profile_local->depth > 0) profile_exit();
+    double ns_per_tick = profile_tick_scale();
+    static ProfileEntry totals[MAX_FUNCTIONS + 1];
+    memset(totals, 0, sizeof(totals));
+    unsigned long long tail_calls = 0, cache_hits = 0, cache_misses = 0;
+    pthread_mutex_lock(&profile_lock);
+    for (ProfileThread* profile = profile_threads; profile; profile = profile->next) {
+        tail_calls += profile->tail_calls;
+        cache_hits += profile->cache_hits;
+        cache_misses += profile->cache_misses;
+        for (int i = 0; i <= MAX_FUNCTIONS; i++) {
+            totals[i].call_count += profile->entries[i].call_count;
+            totals[i].total_time += profile->entries[i].total_time;
+            totals[i].self_time += profile->entries[i].self_time;
+        }
     }
+    pthread_mutex_unlock(&profile_lock);
     
-    profile_start(command);
+    printf("\n=== SOSU OS PERFORMANCE REPORT ===\n");
+    printf("%-30s %-10s %-15s %-15s %-15s\n", "Function", "Calls", "Incl (us)", "Excl (us)", "Avg (us)");
+    printf("-----------------------------------------------\n");
     
-    if (strcmp(command, "namespace") == 0) {
-        if (token_count >= 2) {
-        }
+    int count = atomic_load(&function_count);
+    for (int i = 0; i <= MAX_FUNCTIONS; i++) {
+        if (totals[i].call_count == 0) continue;
+        const char* name = i == PROFILE_TOPLEVEL ? "<toplevel>" : i < count ? functions[i].name : "?";
+        double total = totals[i].total_time * ns_per_tick / 1000.0;
+        printf("%-30s %-10llu %-15.3f %-15.3f %-15.3f\n",
+               name,
+               totals[i].call_count,
+               total,
+               totals[i].self_time * ns_per_tick / 1000.0,
+               total / totals[i].call_count);
     }
-    else if (strcmp(command, "using") == 0) {
-        if (token_count >= 2) {
-        }
+    if (tail_calls > 0) {
+        printf("-----------------------------------------------\n");
+        printf("Tail calls eliminated: %llu\n", tail_calls);
     }
-    else if (strcmp(command, "struct") == 0) {
-        if (token_count >= 2) {
-            declare_struct(tokens[1]);
+    if (cache_hits + cache_misses > 0) {
+        int sites[3] = { 0, 0, 0 };
+        for (int i = 0; i < program_size; i++) {
+            if (program[i].flow < FLOW_FIELD_DYNAMIC) continue;
+            InlineCache* cache = &inline_caches[program[i].jump];
+            int ways = 0;
+            while (ways < INLINE_CACHE_WAYS && atomic_load(&cache->entries[ways]) != 0) ways++;
+            if (ways > 0) sites[atomic_load(&cache->megamorphic) ? 2 : ways > 1]++;
         }
+        printf("-----------------------------------------------\n");
+        printf("Inline caches: %llu hits, %llu misses (%.1f%% hit rate)\n", cache_hits, cache_misses,
+               100.0 * cache_hits / (cache_hits + cache_misses));
+        printf("Sites: %d monomorphic, %d polymorphic, %d megamorphic\n", sites[0], sites[1], sites[2]);
     }
-    else if (strcmp(command, "class") == 0) {
-        if (token_count >= 2) {
-            declare_struct(tokens[1]);
-        }
+    if (tasks_executed > 0) {
+        printf("-----------------------------------------------\n");
+        printf("Tasks executed: %llu, stolen: %llu\n", tasks_executed, tasks_stolen);
     }
-    else if (strcmp(command, "enum") == 0) {
-        if (token_count >= 2) {
+    
+    int sync_total = sync_count < MAX_SYNC_OBJECTS ? sync_count : MAX_SYNC_OBJECTS;
+    if (sync_total > 0) {
+        static const char* kind_names[] = { "mutex", "semaphore", "condvar" };
+        printf("-----------------------------------------------\n");
+        printf("%-12s %-10s %-12s %-12s %-8s\n", "Lock", "Type", "Contended", "Futex Waits", "Spin");
+        for (int i = 0; i < sync_total; i++) {
+            SyncObject* object = (SyncObject*)(memory + sync_registry[i].address);
+            printf("0x%-10x %-10s %-12u %-12u %-8u\n",
+                   sync_registry[i].address,
+                   kind_names[sync_registry[i].kind],
+                   atomic_load(&object->contended),
+                   atomic_load(&object->waits),
+                   sync_registry[i].kind == SYNC_MUTEX ? atomic_load(&object->aux) : 0);
         }
     }
-    else if (strcmp(command, "public") == 0 || strcmp(command, "private") == 0 || 
-             strcmp(command, "protected") == 0 || strcmp(command, "static") == 0) {
-        if (token_count >= 2) {
-            char new_line[LINE_SIZE] = "";
-            for (int i = 1; i < token_count; i++) {
-                strcat(new_line, tokens[i]);
-                if (i < token_count - 1) strcat(new_line, " ");
-            }
-            return execute_command(new_line, line_number);
-        }
+    printf("===============================================\n");
+}
+
+void push_int64(int64_t value) {
+    if (vm->sp >= STACK_SIZE) {
+        runtime_error(EXC_STACK, "[KERNEL PANIC] Stack overflow at line %d\n", vm->current_line);
     }
-    else if (strcmp(command, "extern") == 0) {
-        if (token_count >= 3) {
-            DataType return_type = parse_type(tokens[1]);
-            declare_function(tokens[2], line_number, return_type, true, false);
-        }
+    vm->stack[vm->sp].i64 = value;
+    vm->stack_types[vm->sp] = TYPE_INT64;
+    vm->sp++;
+}
+
+void push_float64(double value) {
+    if (vm->sp >= STACK_SIZE) {
+        runtime_error(EXC_STACK, "[KERNEL PANIC] Stack overflow at line %d\n", vm->current_line);
     }
-    else if (strcmp(command, "inline") == 0) {
-        if (token_count >= 3) {
-            DataType return_type = parse_type(tokens[1]);
-            declare_function(tokens[2], line_number, return_type, false, true);
-        }
+    vm->stack[vm->sp].f64 = value;
+    vm->stack_types[vm->sp] = TYPE_FLOAT64;
+    vm->sp++;
+}
+
+void push_bool(bool value) {
+    if (vm->sp >= STACK_SIZE) {
+        runtime_error(EXC_STACK, "[KERNEL PANIC] Stack overflow at line %d\n", vm->current_line);
     }
-    else if (strcmp(command, "int8") == 0 || strcmp(command, "int16") == 0 || 
-             strcmp(command, "int32") == 0 || strcmp(command, "int64") == 0 ||
-             strcmp(command, "uint8") == 0 || strcmp(command, "uint16") == 0 ||
-             strcmp(command, "uint32") == 0 || strcmp(command, "uint64") == 0 ||
-             strcmp(command, "float32") == 0 || strcmp(command, "float64") == 0 ||
-             strcmp(command, "char") == 0 || strcmp(command, "bool") == 0 ||
-             strcmp(command, "void") == 0) {
-        DataType type = parse_type(command);
-        if (token_count >= 2) {
-            for (int i = 1; i < token_count; i++) {
-                if (strcmp(tokens[i], ";") == 0) break;
-                if (strcmp(tokens[i], ",") == 0) continue;
-                
-                char* equals = strchr(tokens[i], '=');
-                if (equals) {
-                    *equals = '\0';
-                    char var_name[256];
-                    strcpy(var_name, tokens[i]);
-                    declare_variable(var_name, type, false, false, false);
-                    
-                    char* value_str = equals + 1;
-                    if (isdigit(value_str[0]) || value_str[0] == '-') {
-                        if (type >= TYPE_INT8 && type <= TYPE_INT64) {
-                            push_int64(atoll(value_str));
-                        } else if (type >= TYPE_UINT8 && type <= TYPE_UINT64) {
-                            push_int64(atoll(value_str));
-                        } else if (type == TYPE_FLOAT32 || type == TYPE_FLOAT64) {
-                            push_float64(atof(value_str));
-                        } else if (type == TYPE_BOOL) {
-                            push_bool(strcmp(value_str, "true") == 0 || atoi(value_str) != 0);
-                        }
-                        
-                        unsigned int addr = get_variable_address(var_name);
-                        switch (type) {
-                            case TYPE_INT8: memory[addr] = (int8_t)pop_int64(); break;
-                            case TYPE_INT16: *(int16_t*)(memory + addr) = (int16_t)pop_int64(); break;
-                            case TYPE_INT32: *(int32_t*)(memory + addr) = (int32_t)pop_int64(); break;
-                            case TYPE_INT64: *(int64_t*)(memory + addr) = pop_int64(); break;
-                            case TYPE_FLOAT32: *(float*)(memory + addr) = (float)pop_float64(); break;
-                            case TYPE_FLOAT64: *(double*)(memory + addr) = pop_float64(); break;
-                            case TYPE_BOOL: memory[addr] = pop_bool(); break;
-                            default: break;
-                        }
-                    }
-                } else {
-                    if (tokens[i][0] != ';' && tokens[i][0] != ',') {
-                        declare_variable(tokens[i], type, false, false, false);
-                    }
-                }
-            }
-        }
-    }
-    else if (strcmp(command, "const") == 0) {
-        if (token_count >= 3) {
-            DataType type = parse_type(tokens[1]);
-            declare_variable(tokens[2], type, false, true, false);
-        }
-    }
-    else if (strcmp(command, "{") == 0) {
-        current_scope++;
-    }
-    else if (strcmp(command, "}") == 0) {
-        if (current_scope > 0) current_scope--;
-    }
-    else if (strcmp(command, "if") == 0) {
-        bool condition = pop_bool();
-    }
-    else if (strcmp(command, "while") == 0) {
-    }
-    else if (strcmp(command, "for") == 0) {
-    }
-    else if (strcmp(command, "switch") == 0) {
+    vm->stack[vm->sp].b = value;
+    vm->stack_types[vm->sp] = TYPE_BOOL;
+    vm->sp++;
+}
+
+void push_ptr(void* value) {
+    if (vm->sp >= STACK_SIZE) {
+        runtime_error(EXC_STACK, "[KERNEL PANIC] Stack overflow at line %d\n", vm->current_line);
     }
-    else if (strcmp(command, "try") == 0) {
+    vm->stack[vm->sp].ptr = value;
+    vm->stack_types[vm->sp] = TYPE_POINTER;
+    vm->sp++;
+}
+
+void push_value(union StackValue value, DataType type) {
+    if (vm->sp >= STACK_SIZE) {
+        runtime_error(EXC_STACK, "[KERNEL PANIC] Stack overflow at line %d\n", vm->current_line);
     }
-    else if (strcmp(command, "function") == 0 || 
-             (find_function(command) != -1 && token_count >= 2 && strcmp(tokens[1], "(") == 0)) {
-        int func_idx = find_function(command);
-        if (func_idx != -1) {
-        }
+    vm->stack[vm->sp] = value;
+    vm->stack_types[vm->sp] = type;
+    vm->sp++;
+}
+
+void push_function(int index) {
+    if (vm->sp >= STACK_SIZE) {
+        runtime_error(EXC_STACK, "[KERNEL PANIC] Stack overflow at line %d\n", vm->current_line);
     }
-    else if (find_variable(command) != -1) {
-        if (token_count >= 3 && strcmp(tokens[1], "=") == 0) {
-            unsigned int addr = get_variable_address(command);
-            DataType var_type = get_variable_type(command);
-            
-            if (isdigit(tokens[2][0]) || tokens[2][0] == '-') {
-                switch (var_type) {
-                    case TYPE_INT8: memory[addr] = (int8_t)atoll(tokens[2]); break;
-                    case TYPE_INT16: *(int16_t*)(memory + addr) = (int16_t)atoll(tokens[2]); break;
-                    case TYPE_INT32: *(int32_t*)(memory + addr) = (int32_t)atoll(tokens[2]); break;
-                    case TYPE_INT64: *(int64_t*)(memory + addr) = atoll(tokens[2]); break;
-                    case TYPE_FLOAT32: *(float*)(memory + addr) = (float)atof(tokens[2]); break;
-                    case TYPE_FLOAT64: *(double*)(memory + addr) = atof(tokens[2]); break;
-                    case TYPE_BOOL: memory[addr] = (strcmp(tokens[2], "true") == 0); break;
-                    default: break;
-                }
-            } else if (find_variable(tokens[2]) != -1) {
-                unsigned int src_addr = get_variable_address(tokens[2]);
-                DataType src_type = get_variable_type(tokens[2]);
-                memcpy(memory + addr, memory + src_addr, variables[find_variable(command)].size);
-            }
-        }
+    vm->stack[vm->sp].i64 = index;
+    vm->stack_types[vm->sp] = TYPE_FUNCTION_PTR;
+    vm->sp++;
+}
+
+union StackValue pop_value() {
+    if (vm->sp <= 0) {
+        runtime_error(EXC_STACK, "[KERNEL PANIC] Stack underflow at line %d\n", vm->current_line);
     }
-    else if (strcmp(command, "new") == 0) {
-        if (token_count >= 2) {
-        }
+    return vm->stack[--vm->sp];
+}
+
+int64_t pop_int64() {
+    if (vm->sp <= 0) {
+        runtime_error(EXC_TYPE, "[TYPE ERROR] Stack empty at line %d\n", vm->current_line);
     }
-    else if (strcmp(command, "delete") == 0) {
+    
+    DataType type = vm->stack_types[vm->sp-1];
+    switch (type) {
+        case TYPE_INT8: return (int64_t)vm->stack[--vm->sp].i8;
+        case TYPE_INT16: return (int64_t)vm->stack[--vm->sp].i16;
+        case TYPE_INT32: return (int64_t)vm->stack[--vm->sp].i32;
+        case TYPE_INT64: return vm->stack[--vm->sp].i64;
+        case TYPE_UINT8: return (int64_t)vm->stack[--vm->sp].u8;
+        case TYPE_UINT16: return (int64_t)vm->stack[--vm->sp].u16;
+        case TYPE_UINT32: return (int64_t)vm->stack[--vm->sp].u32;
+        case TYPE_UINT64: return (int64_t)vm->stack[--vm->sp].u64;
+        case TYPE_CHAR: return (int64_t)vm->stack[--vm->sp].c;
+        case TYPE_BOOL: return (int64_t)vm->stack[--vm->sp].b;
+        case TYPE_FLOAT32: return (int64_t)vm->stack[--vm->sp].f32;
+        case TYPE_FLOAT64: return (int64_t)vm->stack[--vm->sp].f64;
+        default:
+            runtime_error(EXC_TYPE, "[TYPE ERROR] Cannot convert to int64 at line %d\n", vm->current_line);
     }
-    else if (strcmp(command, "sizeof") == 0) {
-        if (token_count >= 2) {
-            DataType type = parse_type(tokens[1]);
-            unsigned int size = 0;
-            switch (type) {
-                case TYPE_INT8: case TYPE_UINT8: case TYPE_CHAR: case TYPE_BOOL: size = 1; break;
-                case TYPE_INT16: case TYPE_UINT16: size = 2; break;
-                case TYPE_INT32: case TYPE_UINT32: case TYPE_FLOAT32: size = 4; break;
-                case TYPE_INT64: case TYPE_UINT64: case TYPE_FLOAT64: case TYPE_POINTER: size = 8; break;
-                default: size = 8; break;
-            }
-            push_int64(size);
-        }
+}
+
+double pop_float64() {
+    if (vm->sp <= 0) {
+        runtime_error(EXC_TYPE, "[TYPE ERROR] Stack empty at line %d\n", vm->current_line);
     }
-    else if (strcmp(command, "typeof") == 0) {
+    
+    DataType type = vm->stack_types[vm->sp-1];
+    switch (type) {
+        case TYPE_INT8: return (double)vm->stack[--vm->sp].i8;
+        case TYPE_INT16: return (double)vm->stack[--vm->sp].i16;
+        case TYPE_INT32: return (double)vm->stack[--vm->sp].i32;
+        case TYPE_INT64: return (double)vm->stack[--vm->sp].i64;
+        case TYPE_UINT8: return (double)vm->stack[--vm->sp].u8;
+        case TYPE_UINT16: return (double)vm->stack[--vm->sp].u16;
+        case TYPE_UINT32: return (double)vm->stack[--vm->sp].u32;
+        case TYPE_UINT64: return (double)vm->stack[--vm->sp].u64;
+        case TYPE_FLOAT32: return (double)vm->stack[--vm->sp].f32;
+        case TYPE_FLOAT64: return vm->stack[--vm->sp].f64;
+        default:
+            runtime_error(EXC_TYPE, "[TYPE ERROR] Cannot convert to float64 at line %d\n", vm->current_line);
     }
-    else if (strcmp(command, "cast") == 0) {
+}
+
+bool pop_bool() {
+    if (vm->sp <= 0) {
+        runtime_error(EXC_TYPE, "[TYPE ERROR] Stack empty at line %d\n", vm->current_line);
     }
-    else if (strcmp(command, "import") == 0) {
+    
+    DataType type = vm->stack_types[vm->sp-1];
+    switch (type) {
+        case TYPE_BOOL: return vm->stack[--vm->sp].b;
+        case TYPE_INT8: return vm->stack[--vm->sp].i8 != 0;
+        case TYPE_INT16: return vm->stack[--vm->sp].i16 != 0;
+        case TYPE_INT32: return vm->stack[--vm->sp].i32 != 0;
+        case TYPE_INT64: return vm->stack[--vm->sp].i64 != 0;
+        default:
+            runtime_error(EXC_TYPE, "[TYPE ERROR] Cannot convert to bool at line %d\n", vm->current_line);
     }
-    else if (strcmp(command, "export") == 0) {
+}
+
+void* pop_ptr() {
+    if (vm->sp <= 0 || vm->stack_types[vm->sp-1] != TYPE_POINTER) {
+        runtime_error(EXC_TYPE, "[TYPE ERROR] Expected pointer at line %d\n", vm->current_line);
     }
-    else if (strcmp(command, "async") == 0) {
+    return vm->stack[--vm->sp].ptr;
+}
+
+int pop_function() {
+    if (vm->sp <= 0) {
+        runtime_error(EXC_TYPE, "[TYPE ERROR] Stack empty at line %d\n", vm->current_line);
     }
-    else if (strcmp(command, "thread") == 0) {
+    
+    int64_t index = vm->stack_types[vm->sp-1] == TYPE_FUNCTION_PTR ? vm->stack[--vm->sp].i64 : pop_int64();
+    if (index < 0 || index >= function_count) {
+        runtime_error(EXC_TYPE, "[TYPE ERROR] Invalid function reference %ld at line %d\n", index, vm->current_line);
     }
-    else if (strcmp(command, "lock") == 0) {
+    return (int)index;
+}
+
+uint64_t vm_random() {
+    uint64_t x = vm->rng_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    vm->rng_state = x;
+    return x;
+}
+
+unsigned int heap_reserve(unsigned int size, unsigned int align) {
+    unsigned int start = atomic_load_explicit(&heap_start, memory_order_relaxed);
+    unsigned int addr;
+    
+    do {
+        addr = (start + align - 1) & ~(align - 1);
+        if (addr + size >= memory_size) return UINT_MAX;
+    } while (!atomic_compare_exchange_weak_explicit(&heap_start, &start, addr + size,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    return addr;
+}
+
+unsigned int heap_commit(unsigned int addr, unsigned int size) {
+    atomic_fetch_add_explicit(&metrics.allocations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&metrics.allocated_bytes, size, memory_order_relaxed);
+    
+    if (gc_enabled) {
+        gc_mark_object(addr, size);
     }
-    else if (strcmp(command, "unsafe") == 0) {
+    
+    return addr;
+}
+
+unsigned int malloc_sosu_aligned(unsigned int size, unsigned int align) {
+    unsigned int addr = heap_reserve(size, align);
+    if (addr == UINT_MAX) {
+        runtime_error(EXC_OUT_OF_MEMORY, "[OUT OF MEMORY] Cannot allocate %u bytes\n", size);
     }
-    else if (strcmp(command, "fixed") == 0) {
+    return heap_commit(addr, size);
+}
+
+unsigned int malloc_sosu(unsigned int size) {
+    return malloc_sosu_aligned(size, 1);
+}
+
+void free_sosu(unsigned int address) {
+}
+
+Variable* find_variable(const char* name) {
+    for (int i = vm->local_count - 1; i >= 0; i--) {
+        Variable* local = &vm->locals[i];
+        if (local->owner == vm->owner && local->scope_level <= vm->current_scope && strcmp(local->name, name) == 0) {
+            return local;
+        }
     }
-    else if (strcmp(command, "stackalloc") == 0) {
+    for (int i = variable_count - 1; i >= 0; i--) {
+        if (variables[i].owner != vm->owner && !variables[i].is_global) continue;
+        if (strcmp(variables[i].name, name) == 0) {
+            if (variables[i].scope_level <= vm->current_scope || variables[i].is_global) {
+                return &variables[i];
+            }
+        }
     }
-    else if (strcmp(command, "yield") == 0) {
+    return NULL;
+}
+
+Variable* require_variable(const char* name) {
+    Variable* variable = find_variable(name);
+    if (variable) {
+        return variable;
     }
-    else if (strcmp(command, "using") == 0) {
+    runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Undefined variable '%s' at line %d\n", name, vm->current_line);
+}
+
+unsigned int get_variable_address(const char* name) {
+    return require_variable(name)->address;
+}
+
+DataType get_variable_type(const char* name) {
+    Variable* variable = find_variable(name);
+    if (variable) {
+        return variable->type;
     }
-    else if (strcmp(command, "throw") == 0) {
+    return TYPE_VOID;
+}
+
+unsigned int type_size(DataType type) {
+    switch (type) {
+        case TYPE_INT8: case TYPE_UINT8: case TYPE_CHAR: case TYPE_BOOL: return 1;
+        case TYPE_INT16: case TYPE_UINT16: return 2;
+        case TYPE_INT32: case TYPE_UINT32: case TYPE_FLOAT32: return 4;
+        default: return 8;
     }
-    else if (strcmp(command, "assert") == 0) {
-        bool condition = pop_bool();
-        if (!condition) {
-            fprintf(stderr, "[ASSERTION FAILED] at line %d\n", line_number);
+}
+
+/* Variables declared in a function body live in the thread's own stack of locals and are
+   dropped with their frame; only top-level and coroutine-body variables, which outlive any
+   one frame, go to the shared table. Each local slot keeps its 8-byte storage when popped,
+   so the next local pushed there reuses it. */
+bool declares_local() {
+    int line = vm->current_line;
+    if (line < 0 || line >= program_size || program[line].function_id < 0) return false;
+    return !in_coroutine();
+}
+
+void declare_local(const char* name, DataType type, bool is_const, bool is_static) {
+    int base = vm->call_stack_ptr > 0 ? vm->call_stack[vm->call_stack_ptr - 1].variable_base : 0;
+    for (int i = vm->local_count - 1; i >= base; i--) {
+        Variable* local = &vm->locals[i];
+        if (strcmp(local->name, name) == 0 && local->scope_level == vm->current_scope &&
+            local->module_id == current_module) {
+            if (local->decl_line == vm->current_line && local->type == type) return;
+            fprintf(stderr, "[COMPILE ERROR] Variable '%s' already declared at line %d\n", name, vm->current_line);
             profile_report();
             exit(1);
         }
+        if (local->scope_level < vm->current_scope) break;
     }
-    else if (strcmp(command, "debug") == 0) {
-        printf("[DEBUG] Line %d: %s\n", line_number, line);
-    }
-    else if (strcmp(command, "trace") == 0) {
-        printf("[TRACE] Function: %s, Line: %d\n", 
-               call_stack_ptr > 0 ? call_stack[call_stack_ptr-1].function_name : "main", 
-               line_number);
-    }
-    else if (strcmp(command, "benchmark") == 0) {
-        profiling_enabled = !profiling_enabled;
-        printf("[BENCHMARK] Profiling %s\n", profiling_enabled ? "enabled" : "disabled");
-    }
-    else if (strcmp(command, "gc") == 0) {
-        if (token_count >= 2) {
-            if (strcmp(tokens[1], "collect") == 0) {
-                gc_collect();
-            } else if (strcmp(tokens[1], "enable") == 0) {
-                gc_enabled = true;
-            } else if (strcmp(tokens[1], "disable") == 0) {
-                gc_enabled = false;
-            }
+    
+    if (vm->local_count == vm->local_capacity) {
+        int capacity = vm->local_capacity ? vm->local_capacity * 2 : 64;
+        Variable* locals = realloc(vm->locals, capacity * sizeof(Variable));
+        if (!locals) {
+            fprintf(stderr, "[OUT OF MEMORY] Cannot allocate local variables\n");
+            profile_report();
+            exit(1);
         }
+        memset(locals + vm->local_capacity, 0, (capacity - vm->local_capacity) * sizeof(Variable));
+        vm->locals = locals;
+        vm->local_capacity = capacity;
     }
-    else if (strcmp(command, "jit") == 0) {
-        if (token_count >= 2) {
-            if (strcmp(tokens[1], "enable") == 0) {
-            } else if (strcmp(tokens[1], "disable") == 0) {
-                jit_count = 0;
-            }
+    
+    Variable* local = &vm->locals[vm->local_count];
+    if (local->address == 0) {
+        unsigned int addr = heap_reserve(8, 8);
+        if (addr == UINT_MAX) {
+            runtime_error(EXC_OUT_OF_MEMORY, "[OUT OF MEMORY] Cannot allocate %u bytes\n", 8);
         }
+        local->address = heap_commit(addr, 8);
     }
-    else if (strcmp(command, "print") == 0) {
-        if (sp > 0) {
-            DataType type = stack_types[sp-1];
-            switch (type) {
-                case TYPE_INT8: printf("%d\n", (int)pop_int64()); break;
-                case TYPE_INT16: printf("%d\n", (int)pop_int64()); break;
-                case TYPE_INT32: printf("%d\n", (int)pop_int64()); break;
-                case TYPE_INT64: printf("%ld\n", pop_int64()); break;
-                case TYPE_UINT8: printf("%u\n", (unsigned int)pop_int64()); break;
-                case TYPE_UINT16: printf("%u\n", (unsigned int)pop_int64()); break;
-                case TYPE_UINT32: printf("%u\n", (unsigned int)pop_int64()); break;
-                case TYPE_UINT64: printf("%lu\n", (unsigned long)pop_int64()); break;
-                case TYPE_FLOAT32: printf("%f\n", (float)pop_float64()); break;
-                case TYPE_FLOAT64: printf("%f\n", pop_float64()); break;
-                case TYPE_CHAR: printf("%c\n", (char)pop_int64()); break;
-                case TYPE_BOOL: printf("%s\n", pop_bool() ? "true" : "false"); break;
-                default: printf("<unknown>\n"); pop_value(); break;
-            }
-        }
+    memset(memory + local->address, 0, 8);
+    
+    snprintf(local->name, sizeof(local->name), "%s", name);
+    local->type = type;
+    local->size = type_size(type);
+    local->is_global = false;
+    local->is_const = is_const;
+    local->is_static = is_static;
+    local->scope_level = vm->current_scope;
+    local->module_id = current_module;
+    local->owner = vm->owner;
+    local->decl_line = vm->current_line;
+    vm->local_count++;
+}
+
+void declare_variable(const char* name, DataType type, bool is_global, bool is_const, bool is_static) {
+    if (!is_global && declares_local()) {
+        declare_local(name, type, is_const, is_static);
+        return;
     }
-    else if (strcmp(command, "prints") == 0) {
-        if (token_count >= 2 && tokens[1][0] == '"') {
-            char* start = tokens[1] + 1;
-            char* end = strrchr(start, '"');
-            if (end) {
-                *end = '\0';
-                printf("%s\n", start);
+    int line = vm->current_line;
+    if (line >= 0 && line < program_size && program[line].function_id < 0) is_global = true;
+    
+    pthread_mutex_lock(&variables_lock);
+    
+    int index = variable_count;
+    for (int i = index - 1; i >= 0; i--) {
+        if (variables[i].owner != vm->owner) continue;
+        if (strcmp(variables[i].name, name) == 0 && 
+            variables[i].scope_level == vm->current_scope &&
+            variables[i].module_id == current_module) {
+            if (variables[i].decl_line == vm->current_line && variables[i].type == type) {
+                pthread_mutex_unlock(&variables_lock);
+                return;
             }
+            fprintf(stderr, "[COMPILE ERROR] Variable '%s' already declared at line %d\n", name, vm->current_line);
+            profile_report();
+            exit(1);
         }
+        if (variables[i].scope_level < vm->current_scope) break;
     }
-    else if (strcmp(command, "syscall") == 0) {
-        int64_t syscall_num = pop_int64();
-        return system_call(syscall_num);
+    
+    for (int i = 0; i < index && released_variables > 0; i++) {
+        if (variables[i].owner != VARIABLE_RELEASED || variables[i].decl_line != vm->current_line ||
+            variables[i].type != type || variables[i].module_id != current_module ||
+            strcmp(variables[i].name, name) != 0) continue;
+        memset(memory + variables[i].address, 0, variables[i].size);
+        variables[i].is_global = is_global;
+        variables[i].is_const = is_const;
+        variables[i].is_static = is_static;
+        variables[i].scope_level = vm->current_scope;
+        __atomic_store_n(&variables[i].owner, vm->owner, __ATOMIC_RELEASE);
+        released_variables--;
+        pthread_mutex_unlock(&variables_lock);
+        return;
     }
-    else if (strcmp(command, "asm") == 0) {
+    
+    if (index >= MAX_VARIABLES) {
+        fprintf(stderr, "[KERNEL PANIC] Too many variables\n");
+        profile_report();
+        exit(1);
     }
-    else if (strcmp(command, "halt") == 0 || strcmp(command, "hlt") == 0) {
-        return -1;
+    
+    unsigned int size = type_size(type);
+    unsigned int addr = heap_reserve(size, size);
+    if (addr == UINT_MAX) {
+        pthread_mutex_unlock(&variables_lock);
+        runtime_error(EXC_OUT_OF_MEMORY, "[OUT OF MEMORY] Cannot allocate %u bytes\n", size);
     }
-    else if (strcmp(command, "nop") == 0) {
+    heap_commit(addr, size);
+    
+    strcpy(variables[index].name, name);
+    variables[index].address = addr;
+    variables[index].type = type;
+    variables[index].size = size;
+    variables[index].is_global = is_global;
+    variables[index].is_const = is_const;
+    variables[index].is_static = is_static;
+    variables[index].scope_level = vm->current_scope;
+    variables[index].module_id = current_module;
+    variables[index].owner = vm->owner;
+    variables[index].decl_line = vm->current_line;
+    atomic_store_explicit(&variable_count, index + 1, memory_order_release);
+    
+    pthread_mutex_unlock(&variables_lock);
+}
+
+/* Drops everything a finished coroutine declared before its owner id is reused. The shared
+   table stays append-only for lock-free readers: a released entry keeps its name and storage
+   and is only handed out again to the same declaration. */
+void release_variables(int owner) {
+    pthread_mutex_lock(&variables_lock);
+    for (int i = 0; i < variable_count; i++) {
+        if (variables[i].owner != owner) continue;
+        __atomic_store_n(&variables[i].owner, VARIABLE_RELEASED, __ATOMIC_RELEASE);
+        released_variables++;
     }
-    else if (strcmp(command, "break") == 0) {
-        printf("[BREAKPOINT] Execution paused at line %d\n", line_number);
+    pthread_mutex_unlock(&variables_lock);
+}
+
+void push_typed(unsigned int address, DataType type) {
+    unsigned char* value = memory + address;
+    switch (type) {
+        case TYPE_INT8: push_int64(*(int8_t*)value); break;
+        case TYPE_INT16: push_int64(*(int16_t*)value); break;
+        case TYPE_INT32: push_int64(*(int32_t*)value); break;
+        case TYPE_UINT8: push_int64(*(uint8_t*)value); break;
+        case TYPE_UINT16: push_int64(*(uint16_t*)value); break;
+        case TYPE_UINT32: push_int64(*(uint32_t*)value); break;
+        case TYPE_CHAR: push_int64(*(char*)value); break;
+        case TYPE_FLOAT32: push_float64(*(float*)value); break;
+        case TYPE_FLOAT64: push_float64(*(double*)value); break;
+        case TYPE_BOOL: push_bool(*(bool*)value); break;
+        default: push_int64(*(int64_t*)value); break;
     }
-    else if (strcmp(command, "continue") == 0) {
+}
+
+void store_typed(unsigned int address, DataType type) {
+    unsigned char* value = memory + address;
+    switch (type) {
+        case TYPE_INT8: case TYPE_UINT8: case TYPE_CHAR: *(int8_t*)value = (int8_t)pop_int64(); break;
+        case TYPE_INT16: case TYPE_UINT16: *(int16_t*)value = (int16_t)pop_int64(); break;
+        case TYPE_INT32: case TYPE_UINT32: *(int32_t*)value = (int32_t)pop_int64(); break;
+        case TYPE_FLOAT32: *(float*)value = (float)pop_float64(); break;
+        case TYPE_FLOAT64: *(double*)value = pop_float64(); break;
+        case TYPE_BOOL: *(bool*)value = pop_bool(); break;
+        default: *(int64_t*)value = pop_int64(); break;
     }
-    else if (strcmp(command, "return") == 0) {
-        if (call_stack_ptr > 0) {
-            CallFrame frame = call_stack[--call_stack_ptr];
-            current_scope = frame.scope_level;
-            return frame.return_address + 1;
-        } else {
-            return -1;
-        }
+}
+
+void push_variable(Variable* variable) {
+    push_typed(variable->address, variable->type);
+}
+
+void store_variable(Variable* variable) {
+    store_typed(variable->address, variable->type);
+}
+
+int find_function(const char* name) {
+    for (int i = 0; i < function_count; i++) {
+        if (strcmp(functions[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void declare_function(const char* name, int line_number, DataType return_type, bool is_external, bool is_inline) {
+    pthread_mutex_lock(&functions_lock);
+    
+    int index = function_count;
+    if (index >= MAX_FUNCTIONS) {
+        fprintf(stderr, "[KERNEL PANIC] Too many functions\n");
+        profile_report();
+        exit(1);
+    }
+    
+    strcpy(functions[index].name, name);
+    functions[index].line_number = line_number;
+    functions[index].return_type = return_type;
+    functions[index].param_count = 0;
+    functions[index].is_external = is_external;
+    functions[index].is_inline = is_inline;
+    functions[index].module_id = current_module;
+    atomic_store_explicit(&function_count, index + 1, memory_order_release);
+    
+    pthread_mutex_unlock(&functions_lock);
+}
+
+int find_struct(const char* name) {
+    for (int i = 0; i < struct_count; i++) {
+        if (strcmp(structs[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void declare_struct(const char* name) {
+    pthread_mutex_lock(&structs_lock);
+    
+    int index = struct_count;
+    if (index >= MAX_STRUCTS) {
+        fprintf(stderr, "[KERNEL PANIC] Too many structs\n");
+        profile_report();
+        exit(1);
+    }
+    
+    strcpy(structs[index].name, name);
+    structs[index].field_count = 0;
+    structs[index].total_size = 0;
+    atomic_store_explicit(&struct_count, index + 1, memory_order_release);
+    
+    pthread_mutex_unlock(&structs_lock);
+}
+
+int find_label(const char* name) {
+    for (int i = 0; i < label_count; i++) {
+        if (strcmp(labels[i].name, name) == 0) {
+            return labels[i].line_number;
+        }
+    }
+    return -1;
+}
+
+void add_label(const char* name, int line_number) {
+    pthread_mutex_lock(&labels_lock);
+    
+    int index = label_count;
+    if (index >= MAX_LABELS) {
+        fprintf(stderr, "[KERNEL PANIC] Too many labels\n");
+        profile_report();
+        exit(1);
+    }
+    
+    strcpy(labels[index].name, name);
+    labels[index].line_number = line_number;
+    labels[index].return_type = TYPE_VOID;
+    labels[index].module_id = current_module;
+    atomic_store_explicit(&label_count, index + 1, memory_order_release);
+    
+    pthread_mutex_unlock(&labels_lock);
+}
+
+void* vm_thread_main(void* arg) {
+    vm = (VMThread*)arg;
+    vm_run(functions[vm->entry_function].line_number + 1);
+    atomic_store(&vm->finished, true);
+    return NULL;
+}
+
+int64_t spawn_thread(int func_idx, int argc) {
+    if (argc < 0 || argc > vm->sp) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Thread expects %d arguments on the stack at line %d\n", argc, vm->current_line);
+    }
+    
+    VMThread* thread = calloc(1, sizeof(VMThread));
+    if (!thread) {
+        fprintf(stderr, "[OUT OF MEMORY] Cannot allocate thread context\n");
+        profile_report();
+        exit(1);
+    }
+    
+    vm->sp -= argc;
+    memcpy(thread->stack, vm->stack + vm->sp, argc * sizeof(union StackValue));
+    memcpy(thread->stack_types, vm->stack_types + vm->sp, argc * sizeof(DataType));
+    thread->sp = argc;
+    thread->entry_function = func_idx;
+    
+    pthread_mutex_lock(&threads_lock);
+    int slot = -1;
+    for (int i = 1; i < MAX_THREADS; i++) {
+        if (!threads[i]) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot == -1) {
+        fprintf(stderr, "[KERNEL PANIC] Too many threads\n");
+        profile_report();
+        exit(1);
+    }
+    
+    thread->id = next_thread_id++;
+    thread->owner = thread->id;
+    thread->rng_state = ((uint64_t)thread->id << 32) ^ vm_random() ^ 1;
+    threads[slot] = thread;
+    
+    if (pthread_create(&thread->handle, NULL, vm_thread_main, thread) != 0) {
+        fprintf(stderr, "[KERNEL PANIC] Cannot create thread at line %d\n", vm->current_line);
+        profile_report();
+        exit(1);
+    }
+    pthread_mutex_unlock(&threads_lock);
+    
+    return thread->id;
+}
+
+VMThread* take_thread(int64_t id) {
+    VMThread* thread = NULL;
+    
+    pthread_mutex_lock(&threads_lock);
+    for (int i = 1; i < MAX_THREADS; i++) {
+        if (threads[i] && (id < 0 || threads[i]->id == id)) {
+            thread = threads[i];
+            threads[i] = NULL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&threads_lock);
+    
+    return thread;
+}
+
+void join_thread(int64_t id) {
+    VMThread* thread = take_thread(id);
+    if (!thread) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Unknown thread %ld at line %d\n", id, vm->current_line);
+    }
+    
+    pthread_join(thread->handle, NULL);
+    
+    if (thread->sp > 0) {
+        push_value(thread->stack[thread->sp-1], thread->stack_types[thread->sp-1]);
+    } else {
+        push_int64(0);
+    }
+    free(thread->locals);
+    free(thread);
+}
+
+void join_all_threads() {
+    VMThread* thread;
+    while ((thread = take_thread(-1)) != NULL) {
+        pthread_join(thread->handle, NULL);
+        free(thread->locals);
+        free(thread);
+    }
+}
+
+bool deque_push(TaskDeque* q, Task* task) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    if (b - t >= TASK_DEQUE_SIZE) return false;
+    
+    atomic_store_explicit(&q->buffer[b & (TASK_DEQUE_SIZE - 1)], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    return true;
+}
+
+Task* deque_pop(TaskDeque* q) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&q->top, memory_order_relaxed);
+    
+    if (t > b) {
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+    
+    Task* task = atomic_load_explicit(&q->buffer[b & (TASK_DEQUE_SIZE - 1)], memory_order_relaxed);
+    if (t == b) {
+        if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed)) {
+            task = NULL;
+        }
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+Task* deque_steal(TaskDeque* q) {
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+    
+    if (t >= b) return NULL;
+    
+    Task* task = atomic_load_explicit(&q->buffer[t & (TASK_DEQUE_SIZE - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return task;
+}
+
+VMThread* acquire_context() {
+    Worker* self = current_worker;
+    if (self && self->context_count > 0) {
+        return self->contexts[--self->context_count];
+    }
+    
+    pthread_mutex_lock(&task_pool_lock);
+    VMThread* ctx = spare_contexts;
+    if (ctx) spare_contexts = ctx->next_spare;
+    pthread_mutex_unlock(&task_pool_lock);
+    if (ctx) return ctx;
+    
+    ctx = calloc(1, sizeof(VMThread));
+    if (!ctx) {
+        fprintf(stderr, "[OUT OF MEMORY] Cannot allocate task context\n");
+        profile_report();
+        exit(1);
+    }
+    pthread_mutex_lock(&threads_lock);
+    ctx->id = next_thread_id++;
+    ctx->owner = ctx->id;
+    pthread_mutex_unlock(&threads_lock);
+    ctx->rng_state = ((uint64_t)ctx->id << 32) ^ (uint64_t)time(NULL) ^ 1;
+    return ctx;
+}
+
+void release_context(VMThread* ctx) {
+    Worker* self = current_worker;
+    if (self && self->context_count < 64) {
+        self->contexts[self->context_count++] = ctx;
+        return;
+    }
+    
+    pthread_mutex_lock(&task_pool_lock);
+    ctx->next_spare = spare_contexts;
+    spare_contexts = ctx;
+    pthread_mutex_unlock(&task_pool_lock);
+}
+
+Task* allocate_task() {
+    Worker* self = current_worker;
+    Task* task = NULL;
+    
+    if (self && self->free_tasks) {
+        task = self->free_tasks;
+        self->free_tasks = task->next;
+        self->free_task_count--;
+    } else {
+        pthread_mutex_lock(&task_pool_lock);
+        if (task_free_list) {
+            task = task_free_list;
+            task_free_list = task->next;
+        }
+        pthread_mutex_unlock(&task_pool_lock);
+        
+        if (!task) {
+            int index = atomic_fetch_add_explicit(&task_pool_next, 1, memory_order_relaxed);
+            if (index >= MAX_TASKS) {
+                fprintf(stderr, "[KERNEL PANIC] Too many tasks at line %d\n", vm->current_line);
+                profile_report();
+                exit(1);
+            }
+            task = &task_pool[index];
+        }
+    }
+    
+    unsigned int generation = (atomic_load_explicit(&task->generation, memory_order_relaxed) + 1) & INT_MAX;
+    memset(task, 0, sizeof(Task));
+    atomic_store_explicit(&task->generation, generation ? generation : 1, memory_order_relaxed);
+    atomic_store_explicit(&task->in_use, true, memory_order_release);
+    return task;
+}
+
+void free_task(Task* task) {
+    Worker* self = current_worker;
+    atomic_store_explicit(&task->in_use, false, memory_order_release);
+    
+    if (self && self->free_task_count < 256) {
+        task->next = self->free_tasks;
+        self->free_tasks = task;
+        self->free_task_count++;
+        return;
+    }
+    
+    pthread_mutex_lock(&task_pool_lock);
+    task->next = task_free_list;
+    task_free_list = task;
+    pthread_mutex_unlock(&task_pool_lock);
+}
+
+void task_execute(Task* task) {
+    if (task->native) {
+        task->native(task);
+    } else {
+        VMThread* saved = vm;
+        VMThread* ctx = acquire_context();
+        
+        memcpy(ctx->stack, task->args, task->argc * sizeof(union StackValue));
+        memcpy(ctx->stack_types, task->arg_types, task->argc * sizeof(DataType));
+        ctx->sp = task->argc;
+        ctx->call_stack_ptr = 0;
+        ctx->local_count = 0;
+        ctx->current_scope = 0;
+        ctx->base_pointer = 0;
+        ctx->entry_function = task->function;
+        
+        vm = ctx;
+        vm_run(functions[task->function].line_number + 1);
+        vm = saved;
+        
+        if (ctx->sp > 0) {
+            task->result = ctx->stack[ctx->sp-1];
+            task->result_type = ctx->stack_types[ctx->sp-1];
+        } else {
+            task->result.i64 = 0;
+            task->result_type = TYPE_INT64;
+        }
+        release_context(ctx);
+    }
+    
+    if (current_worker) current_worker->executed++;
+    atomic_store_explicit(&task->done, 1, memory_order_release);
+    atomic_fetch_sub_explicit(&sched_pending, 1, memory_order_acq_rel);
+}
+
+Task* sched_find_work() {
+    Worker* self = current_worker;
+    Task* task;
+    
+    if (self && (task = deque_pop(&self->deque)) != NULL) {
+        return task;
+    }
+    
+    if (atomic_load_explicit(&inject_count, memory_order_relaxed) > 0) {
+        pthread_mutex_lock(&sched_lock);
+        task = inject_head;
+        if (task) {
+            inject_head = task->next;
+            if (!inject_head) inject_tail = NULL;
+            atomic_fetch_sub_explicit(&inject_count, 1, memory_order_relaxed);
+        }
+        pthread_mutex_unlock(&sched_lock);
+        if (task) return task;
+    }
+    
+    if (worker_count > 1) {
+        uint64_t r = self ? (self->rng_state = self->rng_state * 6364136223846793005ULL + 1442695040888963407ULL)
+                          : vm_random();
+        int start = (int)((r >> 33) % (uint64_t)worker_count);
+        for (int i = 0; i < worker_count; i++) {
+            Worker* victim = &workers[(start + i) % worker_count];
+            if (victim == self) continue;
+            if ((task = deque_steal(&victim->deque)) != NULL) {
+                if (self) self->stolen++;
+                return task;
+            }
+        }
+    }
+    
+    return NULL;
+}
+
+void sched_notify() {
+    atomic_fetch_add_explicit(&sched_epoch, 1, memory_order_release);
+    if (atomic_load_explicit(&sched_sleepers, memory_order_acquire) > 0) {
+        pthread_mutex_lock(&sched_lock);
+        pthread_cond_signal(&sched_cond);
+        pthread_mutex_unlock(&sched_lock);
+    }
+}
+
+void* sched_worker_main(void* arg) {
+    current_worker = (Worker*)arg;
+    int idle_rounds = 0;
+    
+    while (!atomic_load_explicit(&sched_stop, memory_order_acquire)) {
+        unsigned int epoch = atomic_load_explicit(&sched_epoch, memory_order_acquire);
+        Task* task = sched_find_work();
+        if (task) {
+            task_execute(task);
+            idle_rounds = 0;
+            continue;
+        }
+        
+        if (++idle_rounds < 64) {
+            sched_yield();
+            continue;
+        }
+        
+        pthread_mutex_lock(&sched_lock);
+        atomic_fetch_add(&sched_sleepers, 1);
+        while (!atomic_load(&sched_stop) && atomic_load(&sched_epoch) == epoch) {
+            pthread_cond_wait(&sched_cond, &sched_lock);
+        }
+        atomic_fetch_sub(&sched_sleepers, 1);
+        pthread_mutex_unlock(&sched_lock);
+        idle_rounds = 0;
+    }
+    
+    return NULL;
+}
+
+void sched_init(int count) {
+    if (count <= 0) count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (count <= 0) count = 1;
+    if (count > MAX_WORKERS) count = MAX_WORKERS;
+    
+    workers = calloc(count, sizeof(Worker));
+    if (!workers) {
+        fprintf(stderr, "[OUT OF MEMORY] Cannot allocate scheduler\n");
+        exit(1);
+    }
+    for (int i = 0; i < count; i++) {
+        workers[i].index = i;
+        workers[i].rng_state = (uint64_t)(i + 1) * 0x9E3779B97F4A7C15ULL;
+    }
+    worker_count = count;
+    workers_started = false;
+    atomic_store(&sched_stop, false);
+    current_worker = &workers[0];
+}
+
+void sched_start_workers() {
+    pthread_mutex_lock(&sched_lock);
+    if (!workers_started) {
+        for (int i = 1; i < worker_count; i++) {
+            if (pthread_create(&workers[i].handle, NULL, sched_worker_main, &workers[i]) != 0) {
+                fprintf(stderr, "[KERNEL PANIC] Cannot start scheduler worker %d\n", i);
+                exit(1);
+            }
+        }
+        workers_started = true;
+        printf("[SCHED] %d workers started\n", worker_count);
+    }
+    pthread_mutex_unlock(&sched_lock);
+}
+
+void sched_spawn(Task* task) {
+    if (!workers) sched_init(requested_workers);
+    if (!workers_started) sched_start_workers();
+    
+    atomic_store_explicit(&task->done, 0, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sched_pending, 1, memory_order_relaxed);
+    
+    Worker* self = current_worker;
+    if (self && deque_push(&self->deque, task)) {
+        sched_notify();
+        return;
+    }
+    if (self) {
+        task_execute(task);
+        return;
+    }
+    
+    pthread_mutex_lock(&sched_lock);
+    task->next = NULL;
+    if (inject_tail) inject_tail->next = task;
+    else inject_head = task;
+    inject_tail = task;
+    atomic_fetch_add_explicit(&inject_count, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&sched_lock);
+    sched_notify();
+}
+
+void sched_join(Task* task) {
+    while (!atomic_load_explicit(&task->done, memory_order_acquire)) {
+        Task* other = sched_find_work();
+        if (other) {
+            task_execute(other);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+void sched_shutdown() {
+    if (!workers) return;
+    
+    while (atomic_load_explicit(&sched_pending, memory_order_acquire) > 0) {
+        Task* task = sched_find_work();
+        if (task) task_execute(task);
+        else sched_yield();
+    }
+    
+    if (workers_started) {
+        pthread_mutex_lock(&sched_lock);
+        atomic_store(&sched_stop, true);
+        pthread_cond_broadcast(&sched_cond);
+        pthread_mutex_unlock(&sched_lock);
+        for (int i = 1; i < worker_count; i++) {
+            pthread_join(workers[i].handle, NULL);
+        }
+    }
+    
+    for (int i = 0; i < worker_count; i++) {
+        tasks_executed += workers[i].executed;
+        tasks_stolen += workers[i].stolen;
+        for (int j = 0; j < workers[i].context_count; j++) {
+            free(workers[i].contexts[j]);
+        }
+    }
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+    workers_started = false;
+    current_worker = NULL;
+}
+
+int64_t spawn_task(int func_idx, int argc) {
+    if (argc < 0 || argc > MAX_TASK_ARGS || argc > vm->sp) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Task expects %d arguments on the stack at line %d\n", argc, vm->current_line);
+    }
+    
+    Task* task = allocate_task();
+    vm->sp -= argc;
+    memcpy(task->args, vm->stack + vm->sp, argc * sizeof(union StackValue));
+    memcpy(task->arg_types, vm->stack_types + vm->sp, argc * sizeof(DataType));
+    task->argc = argc;
+    task->function = func_idx;
+    
+    int64_t handle = ((int64_t)atomic_load_explicit(&task->generation, memory_order_relaxed) << TASK_GENERATION_SHIFT) |
+                     (task - task_pool);
+    sched_spawn(task);
+    return handle;
+}
+
+/* A handle carries the generation of its pool slot, so a handle kept after its task was joined
+   is rejected even once the slot is reused. Of two joins racing on one handle only the one that
+   clears in_use gets the result. */
+void join_task(int64_t handle) {
+    int64_t index = handle & ((1LL << TASK_GENERATION_SHIFT) - 1);
+    unsigned int generation = (unsigned int)(handle >> TASK_GENERATION_SHIFT);
+    Task* task = handle > 0 && index < MAX_TASKS ? &task_pool[index] : NULL;
+    if (!task || !atomic_load_explicit(&task->in_use, memory_order_acquire) ||
+        atomic_load_explicit(&task->generation, memory_order_acquire) != generation) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Unknown task %ld at line %d\n", handle, vm->current_line);
+    }
+    
+    sched_join(task);
+    bool expected = true;
+    if (atomic_load_explicit(&task->generation, memory_order_acquire) != generation ||
+        !atomic_compare_exchange_strong_explicit(&task->in_use, &expected, false, memory_order_acq_rel, memory_order_acquire)) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Task %ld already joined at line %d\n", handle, vm->current_line);
+    }
+    push_value(task->result, task->result_type);
+    free_task(task);
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+long futex_wait(atomic_uint* word, unsigned int expected) {
+    return syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+long futex_wake(atomic_uint* word, int count) {
+    return syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+SyncObject* sync_object(int64_t address) {
+    if (address < 0 || address % 4 != 0 || address + (int64_t)sizeof(SyncObject) > memory_size) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Invalid synchronization object 0x%lx at line %d\n", address, vm->current_line);
+    }
+    return (SyncObject*)(memory + address);
+}
+
+unsigned int sync_create(SyncKind kind, unsigned int initial) {
+    unsigned int addr = malloc_sosu_aligned(sizeof(SyncObject), 8);
+    SyncObject* object = (SyncObject*)(memory + addr);
+    
+    atomic_store_explicit(&object->word, initial, memory_order_relaxed);
+    atomic_store_explicit(&object->aux, kind == SYNC_MUTEX ? SYNC_SPIN_DEFAULT : 0, memory_order_relaxed);
+    atomic_store_explicit(&object->contended, 0, memory_order_relaxed);
+    atomic_store_explicit(&object->waits, 0, memory_order_relaxed);
+    
+    int index = atomic_fetch_add_explicit(&sync_count, 1, memory_order_relaxed);
+    if (index < MAX_SYNC_OBJECTS) {
+        sync_registry[index].address = addr;
+        sync_registry[index].kind = kind;
+    }
+    return addr;
+}
+
+void mutex_lock_slow(SyncObject* mutex) {
+    atomic_fetch_add_explicit(&mutex->contended, 1, memory_order_relaxed);
+    
+    unsigned int budget = atomic_load_explicit(&mutex->aux, memory_order_relaxed);
+    unsigned int limit = budget * 2 + 10;
+    if (limit > SYNC_SPIN_MAX) limit = SYNC_SPIN_MAX;
+    
+    for (unsigned int i = 0; i < limit; i++) {
+        unsigned int expected = 0;
+        if (atomic_load_explicit(&mutex->word, memory_order_relaxed) == 0 &&
+            atomic_compare_exchange_weak_explicit(&mutex->word, &expected, 1,
+                                                  memory_order_acquire, memory_order_relaxed)) {
+            atomic_store_explicit(&mutex->aux, budget + ((int)i - (int)budget) / 8, memory_order_relaxed);
+            return;
+        }
+        cpu_relax();
+    }
+    
+    atomic_store_explicit(&mutex->aux, budget + ((int)limit - (int)budget) / 8, memory_order_relaxed);
+    while (atomic_exchange_explicit(&mutex->word, 2, memory_order_acquire) != 0) {
+        atomic_fetch_add_explicit(&mutex->waits, 1, memory_order_relaxed);
+        futex_wait(&mutex->word, 2);
+    }
+}
+
+void mutex_lock(SyncObject* mutex) {
+    unsigned int expected = 0;
+    if (!atomic_compare_exchange_strong_explicit(&mutex->word, &expected, 1,
+                                                 memory_order_acquire, memory_order_relaxed)) {
+        mutex_lock_slow(mutex);
+    }
+}
+
+bool mutex_trylock(SyncObject* mutex) {
+    unsigned int expected = 0;
+    return atomic_compare_exchange_strong_explicit(&mutex->word, &expected, 1,
+                                                   memory_order_acquire, memory_order_relaxed);
+}
+
+void mutex_unlock(SyncObject* mutex) {
+    if (atomic_fetch_sub_explicit(&mutex->word, 1, memory_order_release) != 1) {
+        atomic_store_explicit(&mutex->word, 0, memory_order_release);
+        futex_wake(&mutex->word, 1);
+    }
+}
+
+bool semaphore_trywait(SyncObject* sem) {
+    unsigned int count = atomic_load_explicit(&sem->word, memory_order_relaxed);
+    while (count > 0) {
+        if (atomic_compare_exchange_weak_explicit(&sem->word, &count, count - 1,
+                                                  memory_order_acquire, memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void semaphore_wait(SyncObject* sem) {
+    if (semaphore_trywait(sem)) return;
+    
+    atomic_fetch_add_explicit(&sem->contended, 1, memory_order_relaxed);
+    for (int i = 0; i < SYNC_SPIN_DEFAULT; i++) {
+        cpu_relax();
+        if (semaphore_trywait(sem)) return;
+    }
+    
+    atomic_fetch_add_explicit(&sem->aux, 1, memory_order_seq_cst);
+    while (!semaphore_trywait(sem)) {
+        atomic_fetch_add_explicit(&sem->waits, 1, memory_order_relaxed);
+        futex_wait(&sem->word, 0);
+    }
+    atomic_fetch_sub_explicit(&sem->aux, 1, memory_order_relaxed);
+}
+
+void semaphore_post(SyncObject* sem) {
+    atomic_fetch_add_explicit(&sem->word, 1, memory_order_seq_cst);
+    if (atomic_load_explicit(&sem->aux, memory_order_seq_cst) > 0) {
+        futex_wake(&sem->word, 1);
+    }
+}
+
+void condvar_wait(SyncObject* cond, SyncObject* mutex) {
+    unsigned int seq = atomic_load_explicit(&cond->word, memory_order_relaxed);
+    
+    atomic_fetch_add_explicit(&cond->contended, 1, memory_order_relaxed);
+    mutex_unlock(mutex);
+    atomic_fetch_add_explicit(&cond->waits, 1, memory_order_relaxed);
+    futex_wait(&cond->word, seq);
+    
+    while (atomic_exchange_explicit(&mutex->word, 2, memory_order_acquire) != 0) {
+        atomic_fetch_add_explicit(&mutex->waits, 1, memory_order_relaxed);
+        futex_wait(&mutex->word, 2);
+    }
+}
+
+void condvar_signal(SyncObject* cond, int count) {
+    atomic_fetch_add_explicit(&cond->word, 1, memory_order_release);
+    futex_wake(&cond->word, count);
+}
+
+SyncObject* lock_variable(const char* name) {
+    Variable* variable = require_variable(name);
+    int64_t* slot = (int64_t*)(memory + variable->address);
+    
+    if (variable->size != 8) {
+        runtime_error(EXC_TYPE, "[TYPE ERROR] Lock variable '%s' must be 64-bit at line %d\n", name, vm->current_line);
+    }
+    
+    int64_t addr = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (addr == 0) {
+        pthread_mutex_lock(&sync_init_lock);
+        addr = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+        if (addr == 0) {
+            addr = sync_create(SYNC_MUTEX, 0);
+            __atomic_store_n(slot, addr, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&sync_init_lock);
+    }
+    return sync_object(addr);
+}
+
+Coroutine* get_coroutine(int64_t handle) {
+    int64_t index = handle - COROUTINE_HANDLE_BASE;
+    Coroutine* co = index >= 0 && index < MAX_COROUTINES ? coroutines[index] : NULL;
+    if (!co) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Unknown coroutine %ld at line %d\n", handle, vm->current_line);
+    }
+    return co;
+}
+
+int64_t create_coroutine(int func_idx, int argc) {
+    if (argc < 0 || argc > COROUTINE_SAVE_MAX || argc > vm->sp) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Coroutine expects %d arguments on the stack at line %d\n", argc, vm->current_line);
+    }
+    
+    Coroutine* co = calloc(1, sizeof(Coroutine));
+    if (!co) {
+        fprintf(stderr, "[OUT OF MEMORY] Cannot allocate coroutine frame\n");
+        profile_report();
+        exit(1);
+    }
+    
+    vm->sp -= argc;
+    memcpy(co->saved, vm->stack + vm->sp, argc * sizeof(union StackValue));
+    memcpy(co->saved_types, vm->stack_types + vm->sp, argc * sizeof(DataType));
+    co->saved_count = argc;
+    co->function = func_idx;
+    co->resume_pc = functions[func_idx].line_number + 1;
+    
+    pthread_mutex_lock(&coroutines_lock);
+    int slot = -1;
+    for (int i = 0; i < MAX_COROUTINES; i++) {
+        if (!coroutines[i]) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot == -1) {
+        fprintf(stderr, "[KERNEL PANIC] Too many coroutines\n");
+        profile_report();
+        exit(1);
+    }
+    coroutines[slot] = co;
+    if (free_owner_count > 0) {
+        co->owner = free_owner_ids[--free_owner_count];
+    } else {
+        pthread_mutex_lock(&threads_lock);
+        co->owner = next_thread_id++;
+        pthread_mutex_unlock(&threads_lock);
+    }
+    pthread_mutex_unlock(&coroutines_lock);
+    
+    return COROUTINE_HANDLE_BASE + slot;
+}
+
+void finish_coroutine(Coroutine* co) {
+    co->finished = true;
+    co->saved_count = 0;
+    release_variables(co->owner);
+    
+    pthread_mutex_lock(&coroutines_lock);
+    free_owner_ids[free_owner_count++] = co->owner;
+    pthread_mutex_unlock(&coroutines_lock);
+}
+
+void destroy_coroutine(int64_t handle) {
+    Coroutine* co = get_coroutine(handle);
+    if (atomic_load(&co->running)) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Cannot destroy running coroutine at line %d\n", vm->current_line);
+    }
+    if (!co->finished) finish_coroutine(co);
+    
+    pthread_mutex_lock(&coroutines_lock);
+    coroutines[handle - COROUTINE_HANDLE_BASE] = NULL;
+    pthread_mutex_unlock(&coroutines_lock);
+    free(co);
+}
+
+void resume_coroutine(int64_t handle) {
+    Coroutine* co = get_coroutine(handle);
+    if (co->finished) {
+        push_value(co->result, co->result_type);
+        return;
+    }
+    if (atomic_exchange(&co->running, true)) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Coroutine %ld is already running at line %d\n", handle, vm->current_line);
+    }
+    if (vm->call_stack_ptr >= MAX_CALL_STACK || vm->sp + co->saved_count > STACK_SIZE) {
+        runtime_error(EXC_STACK, "[KERNEL PANIC] Call stack overflow at line %d\n", vm->current_line);
+    }
+    
+    int depth = vm->call_stack_ptr;
+    CallFrame* frame = &vm->call_stack[vm->call_stack_ptr++];
+    frame->return_address = vm->current_line;
+    frame->base_pointer = vm->sp;
+    frame->scope_level = vm->current_scope;
+    frame->variable_base = vm->local_count;
+    frame->stack_frame_size = co->saved_count;
+    frame->coroutine = (int)(handle - COROUTINE_HANDLE_BASE);
+    frame->function = co->function;
+    memcpy(frame->try_sp, co->try_sp, sizeof(frame->try_sp));
+    
+    memcpy(vm->stack + vm->sp, co->saved, co->saved_count * sizeof(union StackValue));
+    memcpy(vm->stack_types + vm->sp, co->saved_types, co->saved_count * sizeof(DataType));
+    vm->sp += co->saved_count;
+    
+    int saved_pc = vm->pc;
+    int saved_owner = vm->owner;
+    vm->owner = co->owner;
+    vm->current_scope = co->scope;
+    vm->pc = co->resume_pc;
+    
+    bool profiled = profiling_enabled;
+    if (profiled) profile_enter(co->function);
+    
+    jmp_buf unwind;
+    jmp_buf* outer = vm->unwind;
+    vm->unwind = &unwind;
+    setjmp(unwind);
+    while (vm->call_stack_ptr > depth && vm->pc < program_size && running) {
+        int line = vm->pc++;
+        if ((hotspots_enabled ? execute_counted(line) : execute_command(program[line].line, line)) == -1) break;
+    }
+    
+    vm->unwind = outer;
+    if (profiled) profile_exit();
+    
+    if (vm->call_stack_ptr > depth) {
+        vm->sp = vm->call_stack[depth].base_pointer;
+        vm->current_scope = vm->call_stack[depth].scope_level;
+        vm->local_count = vm->call_stack[depth].variable_base;
+        vm->call_stack_ptr = depth;
+        co->result.i64 = 0;
+        co->result_type = TYPE_INT64;
+        finish_coroutine(co);
+        push_value(co->result, co->result_type);
+    }
+    
+    vm->pc = saved_pc;
+    vm->owner = saved_owner;
+    atomic_store(&co->running, false);
+}
+
+void leave_coroutine(bool finished) {
+    CallFrame* frame = &vm->call_stack[vm->call_stack_ptr - 1];
+    Coroutine* co = coroutines[frame->coroutine];
+    
+    union StackValue value = { .i64 = 0 };
+    DataType type = TYPE_INT64;
+    if (vm->sp > frame->base_pointer) {
+        type = vm->stack_types[vm->sp - 1];
+        value = pop_value();
+    }
+    
+    if (finished) {
+        co->result = value;
+        co->result_type = type;
+        finish_coroutine(co);
+    } else {
+        int live = vm->sp - frame->base_pointer;
+        if (live > COROUTINE_SAVE_MAX) {
+            fprintf(stderr, "[RUNTIME ERROR] Too many live values at yield on line %d\n", vm->current_line);
+            profile_report();
+            exit(1);
+        }
+        memcpy(co->saved, vm->stack + frame->base_pointer, live * sizeof(union StackValue));
+        memcpy(co->saved_types, vm->stack_types + frame->base_pointer, live * sizeof(DataType));
+        co->saved_count = live;
+        memcpy(co->try_sp, frame->try_sp, sizeof(co->try_sp));
+        co->resume_pc = vm->pc;
+        co->scope = vm->current_scope;
+    }
+    
+    vm->sp = frame->base_pointer;
+    vm->current_scope = frame->scope_level;
+    vm->local_count = frame->variable_base;
+    vm->call_stack_ptr--;
+    push_value(value, type);
+}
+
+bool in_coroutine() {
+    return vm->call_stack_ptr > 0 && vm->call_stack[vm->call_stack_ptr - 1].coroutine >= 0;
+}
+
+int frame_base() {
+    return vm->call_stack_ptr > 0 ? vm->call_stack[vm->call_stack_ptr - 1].base_pointer : vm->base_pointer;
+}
+
+DataType parameter_slot_type(DataType type) {
+    if (type == TYPE_FLOAT32 || type == TYPE_FLOAT64) return TYPE_FLOAT64;
+    if (type == TYPE_BOOL) return TYPE_BOOL;
+    return TYPE_INT64;
+}
+
+void coerce_argument(int slot, DataType type) {
+    type = parameter_slot_type(type);
+    if (vm->stack_types[slot] == type) return;
+    
+    int saved_sp = vm->sp;
+    vm->sp = slot + 1;
+    if (type == TYPE_FLOAT64) push_float64(pop_float64());
+    else if (type == TYPE_BOOL) push_bool(pop_bool());
+    else push_int64(pop_int64());
+    vm->sp = saved_sp;
+}
+
+void call_function(int function_id, int line_number) {
+    Function* function = &functions[function_id];
+    int argc = function->param_count;
+    if (vm->call_stack_ptr >= MAX_CALL_STACK) {
+        runtime_error(EXC_STACK, "[KERNEL PANIC] Call stack overflow at line %d\n", line_number);
+    }
+    if (vm->sp < argc) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Function '%s' expects %d arguments at line %d\n",
+                function->name, argc, line_number);
+    }
+    
+    CallFrame* frame = &vm->call_stack[vm->call_stack_ptr++];
+    frame->return_address = line_number;
+    frame->base_pointer = vm->sp - argc;
+    frame->function = function_id;
+    frame->scope_level = vm->current_scope;
+    frame->variable_base = vm->local_count;
+    frame->stack_frame_size = argc;
+    frame->coroutine = -1;
+    
+    for (int i = 0; i < argc; i++) coerce_argument(frame->base_pointer + i, function->param_types[i]);
+    
+    vm->current_scope++;
+    vm->pc = function->line_number + 1;
+    if (profiling_enabled) profile_enter(function_id);
+}
+
+/* Reuses the caller's frame for a call in tail position. Only taken when nothing but the
+   arguments sits above the caller's own parameters, so the result rule is unchanged. */
+bool tail_call(int function_id, int line_number) {
+    Function* function = &functions[function_id];
+    int argc = function->param_count;
+    if (vm->call_stack_ptr == 0 || in_coroutine()) return false;
+    
+    CallFrame* frame = &vm->call_stack[vm->call_stack_ptr - 1];
+    if (vm->sp - argc != frame->base_pointer + (int)frame->stack_frame_size) return false;
+    
+    memmove(vm->stack + frame->base_pointer, vm->stack + vm->sp - argc, argc * sizeof(union StackValue));
+    memmove(vm->stack_types + frame->base_pointer, vm->stack_types + vm->sp - argc, argc * sizeof(DataType));
+    vm->sp = frame->base_pointer + argc;
+    frame->function = function_id;
+    frame->stack_frame_size = argc;
+    vm->local_count = frame->variable_base;
+    vm->current_scope = frame->scope_level + 1;
+    vm->current_line = line_number;
+    
+    for (int i = 0; i < argc; i++) coerce_argument(frame->base_pointer + i, function->param_types[i]);
+    
+    vm->pc = function->line_number + 1;
+    if (profiling_enabled) {
+        profile_exit();
+        profile_enter(function_id);
+        profile_thread()->tail_calls++;
+    }
+    return true;
+}
+
+int function_return() {
+    if (in_coroutine()) {
+        leave_coroutine(true);
+        return 1;
+    }
+    if (vm->call_stack_ptr == 0) return -1;
+    
+    CallFrame* frame = &vm->call_stack[--vm->call_stack_ptr];
+    if (vm->sp > frame->base_pointer + (int)frame->stack_frame_size) {
+        vm->stack[frame->base_pointer] = vm->stack[vm->sp - 1];
+        vm->stack_types[frame->base_pointer] = vm->stack_types[vm->sp - 1];
+        vm->sp = frame->base_pointer + 1;
+    } else {
+        vm->sp = frame->base_pointer;
+    }
+    vm->local_count = frame->variable_base;
+    vm->current_scope = frame->scope_level;
+    vm->pc = frame->return_address + 1;
+    if (profiling_enabled) profile_exit();
+    return 1;
+}
+
+int find_handler(int line) {
+    int low = 0, high = handler_count - 1, found = -1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (handlers[mid].start <= line) {
+            found = mid;
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    while (found >= 0 && !(line > handlers[found].start && line < handlers[found].end)) found = handlers[found].parent;
+    return found;
+}
+
+/* Entering a try block only records how deep the frame's operand stack is, so a catch can
+   put back the values pushed before the try. */
+void enter_try(int line) {
+    int low = 0, high = handler_count - 1;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (handlers[mid].start < line) low = mid + 1;
+        else high = mid;
+    }
+    int* slots = vm->call_stack_ptr > 0 ? vm->call_stack[vm->call_stack_ptr - 1].try_sp : vm->try_sp;
+    slots[handlers[low].nesting] = vm->sp - frame_base();
+    vm->current_scope++;
+}
+
+/* Raises an exception. Handlers live in a range table built at load time, so entering a try
+   block only saves the stack depth: the throw looks up the current line, then each return
+   address down the call stack, and jumps into the first catch that covers it. Without a
+   handler the error is fatal, as before. Coroutine frames are not unwound. */
+void runtime_error(int64_t code, const char* format, ...) {
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    
+    if (vm && vm->unwind) {
+        int line = vm->current_line;
+        for (int depth = vm->call_stack_ptr; ; depth--) {
+            int handler = find_handler(line);
+            if (handler >= 0) {
+                if (vm->call_stack_ptr > depth) vm->local_count = vm->call_stack[depth].variable_base;
+                for (; vm->call_stack_ptr > depth; vm->call_stack_ptr--) {
+                    if (profiling_enabled) profile_exit();
+                }
+                CallFrame* frame = depth > 0 ? &vm->call_stack[depth - 1] : NULL;
+                vm->sp = frame_base() + (frame ? frame->try_sp : vm->try_sp)[handlers[handler].nesting];
+                vm->current_scope = (frame && frame->coroutine < 0 ? frame->scope_level + 1 : 0) + handlers[handler].depth;
+                vm->pc = handlers[handler].end + 1;
+                push_int64(code);
+                longjmp(*vm->unwind, 1);
+            }
+            if (depth == 0 || vm->call_stack[depth - 1].coroutine >= 0) break;
+            line = vm->call_stack[depth - 1].return_address;
+        }
+    }
+    
+    fputs(message, stderr);
+    profile_report();
+    exit(1);
+}
+
+void await_handle(int64_t handle) {
+    if (handle >> TASK_GENERATION_SHIFT) {
+        join_task(handle);
+        return;
+    }
+    
+    Coroutine* co = get_coroutine(handle);
+    while (true) {
+        resume_coroutine(handle);
+        if (co->finished) break;
+        
+        if (in_coroutine()) {
+            Coroutine* outer = coroutines[vm->call_stack[vm->call_stack_ptr - 1].coroutine];
+            vm->pc--;
+            leave_coroutine(false);
+            if (outer->saved_count >= COROUTINE_SAVE_MAX) {
+                fprintf(stderr, "[RUNTIME ERROR] Too many live values at await on line %d\n", vm->current_line);
+                profile_report();
+                exit(1);
+            }
+            outer->saved[outer->saved_count].i64 = handle;
+            outer->saved_types[outer->saved_count] = TYPE_INT64;
+            outer->saved_count++;
+            return;
+        }
+        pop_value();
+    }
+    
+    destroy_coroutine(handle);
+}
+
+pthread_mutex_t* fork_locks[] = {
+    &sync_init_lock, &coroutines_lock, &variables_lock, &functions_lock,
+    &structs_lock, &labels_lock, &threads_lock, &task_pool_lock,
+    &sched_lock, &jit_lock, &profile_lock, &gc_lock
+};
+
+void fork_prepare() {
+    for (size_t i = 0; i < sizeof(fork_locks) / sizeof(fork_locks[0]); i++) {
+        pthread_mutex_lock(fork_locks[i]);
+    }
+}
+
+void fork_parent() {
+    for (size_t i = sizeof(fork_locks) / sizeof(fork_locks[0]); i > 0; i--) {
+        pthread_mutex_unlock(fork_locks[i - 1]);
+    }
+}
+
+void fork_child() {
+    fork_parent();
+    
+    for (int i = 1; i < MAX_THREADS; i++) {
+        threads[i] = NULL;
+    }
+    
+    if (workers) {
+        for (int i = 0; i < worker_count; i++) {
+            atomic_store(&workers[i].deque.top, 0);
+            atomic_store(&workers[i].deque.bottom, 0);
+        }
+        workers_started = false;
+        atomic_store(&sched_pending, 0);
+        inject_head = inject_tail = NULL;
+        atomic_store(&inject_count, 0);
+    }
+    
+    for (int i = 0; i < pool_size; i++) {
+        close(pool_workers[i].request_fd);
+        close(pool_workers[i].result_fd);
+    }
+    pool_size = 0;
+    sampling = 0;
+    metrics_path[0] = '\0';
+    metrics_thread_started = false;
+    tracing = false;
+    pool_in_flight = 0;
+    pool_result_count = 0;
+}
+
+pid_t fork_process() {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "[KERNEL PANIC] fork failed at line %d: %s\n", vm->current_line, strerror(errno));
+        profile_report();
+        exit(1);
+    }
+    return pid;
+}
+
+void pool_worker_main(int func_idx, int request_fd, int result_fd, int index) {
+    VMThread* ctx = calloc(1, sizeof(VMThread));
+    if (!ctx) _exit(1);
+    ctx->id = vm->id;
+    ctx->owner = vm->owner;
+    ctx->rng_state = vm->rng_state ^ ((uint64_t)getpid() << 16);
+    vm = ctx;
+    
+    PoolMessage message;
+    while (read(request_fd, &message, sizeof(message)) == sizeof(message)) {
+        vm->sp = 0;
+        vm->call_stack_ptr = 0;
+        vm->local_count = 0;
+        vm->current_scope = 0;
+        vm->base_pointer = 0;
+        vm->entry_function = func_idx;
+        push_value(message.value, (DataType)message.type);
+        vm_run(functions[func_idx].line_number + 1);
+        
+        PoolMessage reply = { .type = TYPE_INT64, .worker = index };
+        if (vm->sp > 0) {
+            reply.value = vm->stack[vm->sp - 1];
+            reply.type = vm->stack_types[vm->sp - 1];
+        }
+        if (write(result_fd, &reply, sizeof(reply)) != sizeof(reply)) break;
+    }
+    
+    fflush(NULL);
+    _exit(0);
+}
+
+int pool_start(int func_idx, int count) {
+    if (pool_size > 0) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Worker pool already running at line %d\n", vm->current_line);
+    }
+    if (count <= 0) count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (count > MAX_POOL_WORKERS) count = MAX_POOL_WORKERS;
+    
+    for (int i = 0; i < count; i++) {
+        int request_pipe[2], result_pipe[2];
+        if (pipe(request_pipe) != 0 || pipe(result_pipe) != 0) {
+            fprintf(stderr, "[KERNEL PANIC] Cannot create worker pipes: %s\n", strerror(errno));
+            profile_report();
+            exit(1);
+        }
+        
+        pid_t pid = fork_process();
+        if (pid == 0) {
+            close(request_pipe[1]);
+            close(result_pipe[0]);
+            pool_worker_main(func_idx, request_pipe[0], result_pipe[1], i);
+        }
+        
+        close(request_pipe[0]);
+        close(result_pipe[1]);
+        pool_workers[i].pid = pid;
+        pool_workers[i].request_fd = request_pipe[1];
+        pool_workers[i].result_fd = result_pipe[0];
+        pool_workers[i].in_flight = 0;
+        pool_size = i + 1;
+    }
+    
+    printf("[FORK] %d pool workers started\n", pool_size);
+    return pool_size;
+}
+
+bool pool_receive(PoolMessage* message) {
+    struct pollfd fds[MAX_POOL_WORKERS];
+    for (int i = 0; i < pool_size; i++) {
+        fds[i].fd = pool_workers[i].result_fd;
+        fds[i].events = POLLIN;
+    }
+    
+    while (poll(fds, pool_size, -1) < 0) {
+        if (errno != EINTR) return false;
+    }
+    for (int i = 0; i < pool_size; i++) {
+        if (fds[i].revents & (POLLIN | POLLHUP)) {
+            if (read(fds[i].fd, message, sizeof(*message)) != sizeof(*message)) return false;
+            pool_workers[i].in_flight--;
+            pool_in_flight--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void pool_buffer_result() {
+    PoolMessage message;
+    if (!pool_receive(&message)) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Worker pool connection lost at line %d\n", vm->current_line);
+    }
+    if (pool_result_count == pool_result_capacity) {
+        pool_result_capacity = pool_result_capacity ? pool_result_capacity * 2 : 256;
+        pool_results = realloc(pool_results, pool_result_capacity * sizeof(PoolMessage));
+    }
+    pool_results[pool_result_count++] = message;
+}
+
+void pool_submit(union StackValue value, DataType type) {
+    if (pool_size == 0) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] No worker pool running at line %d\n", vm->current_line);
+    }
+    
+    int target = 0;
+    for (int i = 1; i < pool_size; i++) {
+        if (pool_workers[i].in_flight < pool_workers[target].in_flight) target = i;
+    }
+    while (pool_workers[target].in_flight >= POOL_MAX_IN_FLIGHT) {
+        pool_buffer_result();
+        for (int i = 0; i < pool_size; i++) {
+            if (pool_workers[i].in_flight < pool_workers[target].in_flight) target = i;
+        }
+    }
+    
+    PoolMessage message = { .value = value, .type = type, .worker = target };
+    if (write(pool_workers[target].request_fd, &message, sizeof(message)) != sizeof(message)) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Cannot submit work item at line %d: %s\n", vm->current_line, strerror(errno));
+    }
+    pool_workers[target].in_flight++;
+    pool_in_flight++;
+}
+
+void pool_collect() {
+    if (pool_result_count == 0) {
+        if (pool_in_flight == 0) {
+            runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] No pending work items at line %d\n", vm->current_line);
+        }
+        pool_buffer_result();
+    }
+    
+    PoolMessage message = pool_results[0];
+    memmove(pool_results, pool_results + 1, (--pool_result_count) * sizeof(PoolMessage));
+    push_value(message.value, (DataType)message.type);
+}
+
+void pool_stop() {
+    for (int i = 0; i < pool_size; i++) {
+        close(pool_workers[i].request_fd);
+    }
+    for (int i = 0; i < pool_size; i++) {
+        waitpid(pool_workers[i].pid, NULL, 0);
+        close(pool_workers[i].result_fd);
+    }
+    pool_size = 0;
+    pool_in_flight = 0;
+    pool_result_count = 0;
+}
+
+typedef void (*ArrayBinary)(void* dst, const void* a, const void* b, int n);
+typedef void (*ArrayScan)(void* dst, const void* a, int n);
+typedef union StackValue (*ArrayReduce)(const void* a, const void* b, int n);
+typedef void (*MemoryCopy)(unsigned char* dst, const unsigned char* src, size_t n);
+typedef void (*MemoryFill)(unsigned char* dst, int byte, size_t n);
+typedef int (*MemoryCompare)(const unsigned char* a, const unsigned char* b, size_t n);
+typedef int64_t (*MemoryScan)(const unsigned char* a, int byte, size_t n);
+
+typedef struct {
+    const char* name;
+    ArrayBinary binary[2][ARRAY_BINARY_OPS];
+    ArrayReduce dot[2];
+    ArrayReduce sum[2];
+    ArrayScan prefix[2];
+    MemoryCopy copy, move;
+    MemoryFill fill;
+    MemoryCompare compare;
+    MemoryScan find, count;
+} ArrayKernels;
+
+#define SCALAR_BINARY(name, T, expr) \
+    static void name(void* dst, const void* a, const void* b, int n) { \
+        T* d = dst; \
+        const T* x = a; \
+        const T* y = b; \
+        for (int i = 0; i < n; i++) d[i] = (expr); \
+    }
+
+SCALAR_BINARY(scalar_add_i64, int64_t, x[i] + y[i])
+SCALAR_BINARY(scalar_sub_i64, int64_t, x[i] - y[i])
+SCALAR_BINARY(scalar_mul_i64, int64_t, (int64_t)((uint64_t)x[i] * (uint64_t)y[i]))
+SCALAR_BINARY(scalar_min_i64, int64_t, x[i] < y[i] ? x[i] : y[i])
+SCALAR_BINARY(scalar_max_i64, int64_t, x[i] > y[i] ? x[i] : y[i])
+SCALAR_BINARY(scalar_lt_i64, int64_t, x[i] < y[i])
+SCALAR_BINARY(scalar_eq_i64, int64_t, x[i] == y[i])
+SCALAR_BINARY(scalar_add_f64, double, x[i] + y[i])
+SCALAR_BINARY(scalar_sub_f64, double, x[i] - y[i])
+SCALAR_BINARY(scalar_mul_f64, double, x[i] * y[i])
+SCALAR_BINARY(scalar_min_f64, double, x[i] < y[i] ? x[i] : y[i])
+SCALAR_BINARY(scalar_max_f64, double, x[i] > y[i] ? x[i] : y[i])
+SCALAR_BINARY(scalar_lt_f64, double, x[i] < y[i])
+SCALAR_BINARY(scalar_eq_f64, double, x[i] == y[i])
+
+static union StackValue scalar_dot_i64(const void* a, const void* b, int n) {
+    const int64_t* x = a;
+    const int64_t* y = b;
+    uint64_t total = 0;
+    for (int i = 0; i < n; i++) total += (uint64_t)x[i] * (uint64_t)y[i];
+    return (union StackValue){ .i64 = (int64_t)total };
+}
+
+static union StackValue scalar_dot_f64(const void* a, const void* b, int n) {
+    const double* x = a;
+    const double* y = b;
+    double total = 0;
+    for (int i = 0; i < n; i++) total += x[i] * y[i];
+    return (union StackValue){ .f64 = total };
+}
+
+static union StackValue scalar_sum_i64(const void* a, const void* b, int n) {
+    (void)b;
+    const int64_t* x = a;
+    uint64_t total = 0;
+    for (int i = 0; i < n; i++) total += (uint64_t)x[i];
+    return (union StackValue){ .i64 = (int64_t)total };
+}
+
+static union StackValue scalar_sum_f64(const void* a, const void* b, int n) {
+    (void)b;
+    const double* x = a;
+    double total = 0;
+    for (int i = 0; i < n; i++) total += x[i];
+    return (union StackValue){ .f64 = total };
+}
+
+static void scalar_prefix_i64(void* dst, const void* a, int n) {
+    int64_t* d = dst;
+    const int64_t* x = a;
+    uint64_t total = 0;
+    for (int i = 0; i < n; i++) d[i] = (int64_t)(total += (uint64_t)x[i]);
+}
+
+static void scalar_prefix_f64(void* dst, const void* a, int n) {
+    double* d = dst;
+    const double* x = a;
+    double total = 0;
+    for (int i = 0; i < n; i++) d[i] = total += x[i];
+}
+
+static void scalar_copy(unsigned char* dst, const unsigned char* src, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = src[i];
+}
+
+static void scalar_move(unsigned char* dst, const unsigned char* src, size_t n) {
+    if (dst <= src) scalar_copy(dst, src, n);
+    else for (size_t i = n; i > 0; i--) dst[i - 1] = src[i - 1];
+}
+
+static void scalar_fill(unsigned char* dst, int byte, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = (unsigned char)byte;
+}
+
+static int scalar_compare(const unsigned char* a, const unsigned char* b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static int64_t scalar_find(const unsigned char* a, int byte, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] == (unsigned char)byte) return (int64_t)i;
+    }
+    return -1;
+}
+
+static int64_t scalar_count(const unsigned char* a, int byte, size_t n) {
+    int64_t total = 0;
+    for (size_t i = 0; i < n; i++) total += a[i] == (unsigned char)byte;
+    return total;
+}
+
+const ArrayKernels scalar_kernels = {
+    "scalar",
+    { { scalar_add_i64, scalar_sub_i64, scalar_mul_i64, scalar_min_i64, scalar_max_i64, scalar_lt_i64, scalar_eq_i64 },
+      { scalar_add_f64, scalar_sub_f64, scalar_mul_f64, scalar_min_f64, scalar_max_f64, scalar_lt_f64, scalar_eq_f64 } },
+    { scalar_dot_i64, scalar_dot_f64 },
+    { scalar_sum_i64, scalar_sum_f64 },
+    { scalar_prefix_i64, scalar_prefix_f64 },
+    scalar_copy, scalar_move, scalar_fill, scalar_compare, scalar_find, scalar_count
+};
+
+#if defined(__x86_64__)
+/* Element-wise kernels run whole vectors and finish the tail with the scalar kernel. */
+#define SIMD_BINARY(name, attr, T, width, load, store, op, tail) \
+    attr static void name(void* dst, const void* a, const void* b, int n) { \
+        T* d = dst; \
+        const T* x = a; \
+        const T* y = b; \
+        int i = 0; \
+        for (; i + (width) <= n; i += (width)) store((void*)(d + i), op(load((const void*)(x + i)), load((const void*)(y + i)))); \
+        tail(d + i, x + i, y + i, n - i); \
+    }
+
+/* Byte kernels compare whole vectors and locate lanes through the byte mask; counts are
+   summed in 8-bit lanes and widened with SAD before they can overflow. */
+#define SIMD_MEMORY(prefix, attr, V, width, load, store, set1, zero, cmpeq, movemask, sub8, sad) \
+    attr static void prefix##_copy(unsigned char* dst, const unsigned char* src, size_t n) { \
+        size_t i = 0; \
+        for (; i + (width) <= n; i += (width)) store((V*)(dst + i), load((const V*)(src + i))); \
+        scalar_copy(dst + i, src + i, n - i); \
+    } \
+    attr static void prefix##_move(unsigned char* dst, const unsigned char* src, size_t n) { \
+        if (dst <= src || dst >= src + n) { \
+            prefix##_copy(dst, src, n); \
+            return; \
+        } \
+        size_t i = n; \
+        for (; i >= (width); i -= (width)) store((V*)(dst + i - (width)), load((const V*)(src + i - (width)))); \
+        scalar_move(dst, src, i); \
+    } \
+    attr static void prefix##_fill(unsigned char* dst, int byte, size_t n) { \
+        V value = set1((char)byte); \
+        size_t i = 0; \
+        for (; i + (width) <= n; i += (width)) store((V*)(dst + i), value); \
+        scalar_fill(dst + i, byte, n - i); \
+    } \
+    attr static int prefix##_compare(const unsigned char* a, const unsigned char* b, size_t n) { \
+        const unsigned int all = (unsigned int)(((uint64_t)1 << (width)) - 1); \
+        size_t i = 0; \
+        for (; i + (width) <= n; i += (width)) { \
+            unsigned int equal = (unsigned int)movemask(cmpeq(load((const V*)(a + i)), load((const V*)(b + i)))); \
+            if (equal != all) { \
+                size_t k = i + __builtin_ctz(~equal); \
+                return a[k] < b[k] ? -1 : 1; \
+            } \
+        } \
+        return scalar_compare(a + i, b + i, n - i); \
+    } \
+    attr static int64_t prefix##_find(const unsigned char* a, int byte, size_t n) { \
+        V needle = set1((char)byte); \
+        size_t i = 0; \
+        for (; i + (width) <= n; i += (width)) { \
+            unsigned int hits = (unsigned int)movemask(cmpeq(load((const V*)(a + i)), needle)); \
+            if (hits) return (int64_t)(i + __builtin_ctz(hits)); \
+        } \
+        int64_t rest = scalar_find(a + i, byte, n - i); \
+        return rest < 0 ? -1 : (int64_t)i + rest; \
+    } \
+    attr static int64_t prefix##_count(const unsigned char* a, int byte, size_t n) { \
+        V needle = set1((char)byte); \
+        int64_t total = 0; \
+        size_t i = 0; \
+        while (i + (width) <= n) { \
+            V counts = zero(); \
+            for (int k = 0; k < 255 && i + (width) <= n; k++, i += (width)) { \
+                counts = sub8(counts, cmpeq(load((const V*)(a + i)), needle)); \
+            } \
+            uint64_t lanes[(width) / 8]; \
+            store((V*)lanes, sad(counts, zero())); \
+            for (int k = 0; k < (width) / 8; k++) total += (int64_t)lanes[k]; \
+        } \
+        return total + scalar_count(a + i, byte, n - i); \
+    }
+
+static inline __m128i sse2_mul_epi64(__m128i a, __m128i b) {
+    __m128i cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), b), _mm_mul_epu32(a, _mm_srli_epi64(b, 32)));
+    return _mm_add_epi64(_mm_mul_epu32(a, b), _mm_slli_epi64(cross, 32));
+}
+
+static inline __m128i sse2_eq_epi64(__m128i a, __m128i b) {
+    __m128i equal = _mm_cmpeq_epi32(a, b);
+    equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_and_si128(equal, _mm_set1_epi64x(1));
+}
+
+static inline __m128d sse2_lt_pd(__m128d a, __m128d b) {
+    return _mm_and_pd(_mm_cmplt_pd(a, b), _mm_set1_pd(1.0));
+}
+
+static inline __m128d sse2_eq_pd(__m128d a, __m128d b) {
+    return _mm_and_pd(_mm_cmpeq_pd(a, b), _mm_set1_pd(1.0));
+}
+
+SIMD_BINARY(sse2_add_i64, , int64_t, 2, _mm_loadu_si128, _mm_storeu_si128, _mm_add_epi64, scalar_add_i64)
+SIMD_BINARY(sse2_sub_i64, , int64_t, 2, _mm_loadu_si128, _mm_storeu_si128, _mm_sub_epi64, scalar_sub_i64)
+SIMD_BINARY(sse2_mul_i64, , int64_t, 2, _mm_loadu_si128, _mm_storeu_si128, sse2_mul_epi64, scalar_mul_i64)
+SIMD_BINARY(sse2_eq_i64, , int64_t, 2, _mm_loadu_si128, _mm_storeu_si128, sse2_eq_epi64, scalar_eq_i64)
+SIMD_BINARY(sse2_add_f64, , double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd, scalar_add_f64)
+SIMD_BINARY(sse2_sub_f64, , double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_sub_pd, scalar_sub_f64)
+SIMD_BINARY(sse2_mul_f64, , double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_mul_pd, scalar_mul_f64)
+SIMD_BINARY(sse2_min_f64, , double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_min_pd, scalar_min_f64)
+SIMD_BINARY(sse2_max_f64, , double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_max_pd, scalar_max_f64)
+SIMD_BINARY(sse2_lt_f64, , double, 2, _mm_loadu_pd, _mm_storeu_pd, sse2_lt_pd, scalar_lt_f64)
+SIMD_BINARY(sse2_eq_f64, , double, 2, _mm_loadu_pd, _mm_storeu_pd, sse2_eq_pd, scalar_eq_f64)
+
+static union StackValue sse2_dot_i64(const void* a, const void* b, int n) {
+    const int64_t* x = a;
+    const int64_t* y = b;
+    __m128i total = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        total = _mm_add_epi64(total, sse2_mul_epi64(_mm_loadu_si128((const __m128i*)(x + i)), _mm_loadu_si128((const __m128i*)(y + i))));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, total);
+    return (union StackValue){ .i64 = lanes[0] + lanes[1] + scalar_dot_i64(x + i, y + i, n - i).i64 };
+}
+
+static union StackValue sse2_dot_f64(const void* a, const void* b, int n) {
+    const double* x = a;
+    const double* y = b;
+    __m128d total = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 2 <= n; i += 2) total = _mm_add_pd(total, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+    double lanes[2];
+    _mm_storeu_pd(lanes, total);
+    return (union StackValue){ .f64 = lanes[0] + lanes[1] + scalar_dot_f64(x + i, y + i, n - i).f64 };
+}
+
+static union StackValue sse2_sum_i64(const void* a, const void* b, int n) {
+    const int64_t* x = a;
+    __m128i total = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 2 <= n; i += 2) total = _mm_add_epi64(total, _mm_loadu_si128((const __m128i*)(x + i)));
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, total);
+    return (union StackValue){ .i64 = lanes[0] + lanes[1] + scalar_sum_i64(x + i, b, n - i).i64 };
+}
+
+static union StackValue sse2_sum_f64(const void* a, const void* b, int n) {
+    const double* x = a;
+    __m128d total = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 2 <= n; i += 2) total = _mm_add_pd(total, _mm_loadu_pd(x + i));
+    double lanes[2];
+    _mm_storeu_pd(lanes, total);
+    return (union StackValue){ .f64 = lanes[0] + lanes[1] + scalar_sum_f64(x + i, b, n - i).f64 };
+}
+
+static void sse2_prefix_i64(void* dst, const void* a, int n) {
+    int64_t* d = dst;
+    const int64_t* x = a;
+    __m128i carry = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(x + i));
+        v = _mm_add_epi64(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi64(v, carry);
+        _mm_storeu_si128((__m128i*)(d + i), v);
+        carry = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    for (int64_t total = i > 0 ? d[i - 1] : 0; i < n; i++) d[i] = total = (int64_t)((uint64_t)total + (uint64_t)x[i]);
+}
+
+static void sse2_prefix_f64(void* dst, const void* a, int n) {
+    double* d = dst;
+    const double* x = a;
+    __m128d carry = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d v = _mm_loadu_pd(x + i);
+        v = _mm_add_pd(v, _mm_castsi128_pd(_mm_slli_si128(_mm_castpd_si128(v), 8)));
+        v = _mm_add_pd(v, carry);
+        _mm_storeu_pd(d + i, v);
+        carry = _mm_unpackhi_pd(v, v);
+    }
+    for (double total = i > 0 ? d[i - 1] : 0; i < n; i++) d[i] = total += x[i];
+}
+
+SIMD_MEMORY(sse2, , __m128i, 16, _mm_loadu_si128, _mm_storeu_si128, _mm_set1_epi8, _mm_setzero_si128,
+            _mm_cmpeq_epi8, _mm_movemask_epi8, _mm_sub_epi8, _mm_sad_epu8)
+
+const ArrayKernels sse2_kernels = {
+    "SSE2",
+    { { sse2_add_i64, sse2_sub_i64, sse2_mul_i64, scalar_min_i64, scalar_max_i64, scalar_lt_i64, sse2_eq_i64 },
+      { sse2_add_f64, sse2_sub_f64, sse2_mul_f64, sse2_min_f64, sse2_max_f64, sse2_lt_f64, sse2_eq_f64 } },
+    { sse2_dot_i64, sse2_dot_f64 },
+    { sse2_sum_i64, sse2_sum_f64 },
+    { sse2_prefix_i64, sse2_prefix_f64 },
+    sse2_copy, sse2_move, sse2_fill, sse2_compare, sse2_find, sse2_count
+};
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx2_mul_epi64(__m256i a, __m256i b) {
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+
+AVX2 static inline __m256i avx2_min_epi64(__m256i a, __m256i b) {
+    return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+}
+
+AVX2 static inline __m256i avx2_max_epi64(__m256i a, __m256i b) {
+    return _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(a, b));
+}
+
+AVX2 static inline __m256i avx2_lt_epi64(__m256i a, __m256i b) {
+    return _mm256_and_si256(_mm256_cmpgt_epi64(b, a), _mm256_set1_epi64x(1));
+}
+
+AVX2 static inline __m256i avx2_eq_epi64(__m256i a, __m256i b) {
+    return _mm256_and_si256(_mm256_cmpeq_epi64(a, b), _mm256_set1_epi64x(1));
+}
+
+AVX2 static inline __m256d avx2_lt_pd(__m256d a, __m256d b) {
+    return _mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ), _mm256_set1_pd(1.0));
+}
+
+AVX2 static inline __m256d avx2_eq_pd(__m256d a, __m256d b) {
+    return _mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_EQ_OQ), _mm256_set1_pd(1.0));
+}
+
+SIMD_BINARY(avx2_add_i64, AVX2, int64_t, 4, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_add_epi64, scalar_add_i64)
+SIMD_BINARY(avx2_sub_i64, AVX2, int64_t, 4, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_sub_epi64, scalar_sub_i64)
+SIMD_BINARY(avx2_mul_i64, AVX2, int64_t, 4, _mm256_loadu_si256, _mm256_storeu_si256, avx2_mul_epi64, scalar_mul_i64)
+SIMD_BINARY(avx2_min_i64, AVX2, int64_t, 4, _mm256_loadu_si256, _mm256_storeu_si256, avx2_min_epi64, scalar_min_i64)
+SIMD_BINARY(avx2_max_i64, AVX2, int64_t, 4, _mm256_loadu_si256, _mm256_storeu_si256, avx2_max_epi64, scalar_max_i64)
+SIMD_BINARY(avx2_lt_i64, AVX2, int64_t, 4, _mm256_loadu_si256, _mm256_storeu_si256, avx2_lt_epi64, scalar_lt_i64)
+SIMD_BINARY(avx2_eq_i64, AVX2, int64_t, 4, _mm256_loadu_si256, _mm256_storeu_si256, avx2_eq_epi64, scalar_eq_i64)
+SIMD_BINARY(avx2_add_f64, AVX2, double, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_add_pd, scalar_add_f64)
+SIMD_BINARY(avx2_sub_f64, AVX2, double, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_sub_pd, scalar_sub_f64)
+SIMD_BINARY(avx2_mul_f64, AVX2, double, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_mul_pd, scalar_mul_f64)
+SIMD_BINARY(avx2_min_f64, AVX2, double, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_min_pd, scalar_min_f64)
+SIMD_BINARY(avx2_max_f64, AVX2, double, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_max_pd, scalar_max_f64)
+SIMD_BINARY(avx2_lt_f64, AVX2, double, 4, _mm256_loadu_pd, _mm256_storeu_pd, avx2_lt_pd, scalar_lt_f64)
+SIMD_BINARY(avx2_eq_f64, AVX2, double, 4, _mm256_loadu_pd, _mm256_storeu_pd, avx2_eq_pd, scalar_eq_f64)
+
+AVX2 static union StackValue avx2_dot_i64(const void* a, const void* b, int n) {
+    const int64_t* x = a;
+    const int64_t* y = b;
+    __m256i total = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        total = _mm256_add_epi64(total, avx2_mul_epi64(_mm256_loadu_si256((const __m256i*)(x + i)), _mm256_loadu_si256((const __m256i*)(y + i))));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, total);
+    return (union StackValue){ .i64 = lanes[0] + lanes[1] + lanes[2] + lanes[3] + scalar_dot_i64(x + i, y + i, n - i).i64 };
+}
+
+AVX2 static union StackValue avx2_dot_f64(const void* a, const void* b, int n) {
+    const double* x = a;
+    const double* y = b;
+    __m256d total = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) total = _mm256_add_pd(total, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, total);
+    return (union StackValue){ .f64 = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + scalar_dot_f64(x + i, y + i, n - i).f64 };
+}
+
+AVX2 static union StackValue avx2_sum_i64(const void* a, const void* b, int n) {
+    const int64_t* x = a;
+    __m256i total = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) total = _mm256_add_epi64(total, _mm256_loadu_si256((const __m256i*)(x + i)));
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, total);
+    return (union StackValue){ .i64 = lanes[0] + lanes[1] + lanes[2] + lanes[3] + scalar_sum_i64(x + i, b, n - i).i64 };
+}
+
+AVX2 static union StackValue avx2_sum_f64(const void* a, const void* b, int n) {
+    const double* x = a;
+    __m256d total = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) total = _mm256_add_pd(total, _mm256_loadu_pd(x + i));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, total);
+    return (union StackValue){ .f64 = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + scalar_sum_f64(x + i, b, n - i).f64 };
+}
+
+/* In-register scan: add the vector shifted by one lane, then by two, then the running carry. */
+AVX2 static void avx2_prefix_i64(void* dst, const void* a, int n) {
+    int64_t* d = dst;
+    const int64_t* x = a;
+    __m256i carry = _mm256_setzero_si256();
+    __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(x + i));
+        v = _mm256_add_epi64(v, _mm256_slli_si256(v, 8));
+        v = _mm256_add_epi64(v, _mm256_blend_epi32(zero, _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 1, 0, 0)), 0xF0));
+        v = _mm256_add_epi64(v, carry);
+        _mm256_storeu_si256((__m256i*)(d + i), v);
+        carry = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    for (int64_t total = i > 0 ? d[i - 1] : 0; i < n; i++) d[i] = total = (int64_t)((uint64_t)total + (uint64_t)x[i]);
+}
+
+AVX2 static void avx2_prefix_f64(void* dst, const void* a, int n) {
+    double* d = dst;
+    const double* x = a;
+    __m256d carry = _mm256_setzero_pd();
+    __m256d zero = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(x + i);
+        v = _mm256_add_pd(v, _mm256_blend_pd(zero, _mm256_permute_pd(v, 0x0), 0xA));
+        v = _mm256_add_pd(v, _mm256_blend_pd(zero, _mm256_permute4x64_pd(v, _MM_SHUFFLE(1, 1, 0, 0)), 0xC));
+        v = _mm256_add_pd(v, carry);
+        _mm256_storeu_pd(d + i, v);
+        carry = _mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    for (double total = i > 0 ? d[i - 1] : 0; i < n; i++) d[i] = total += x[i];
+}
+
+SIMD_MEMORY(avx2, AVX2, __m256i, 32, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_set1_epi8, _mm256_setzero_si256,
+            _mm256_cmpeq_epi8, _mm256_movemask_epi8, _mm256_sub_epi8, _mm256_sad_epu8)
+
+const ArrayKernels avx2_kernels = {
+    "AVX2",
+    { { avx2_add_i64, avx2_sub_i64, avx2_mul_i64, avx2_min_i64, avx2_max_i64, avx2_lt_i64, avx2_eq_i64 },
+      { avx2_add_f64, avx2_sub_f64, avx2_mul_f64, avx2_min_f64, avx2_max_f64, avx2_lt_f64, avx2_eq_f64 } },
+    { avx2_dot_i64, avx2_dot_f64 },
+    { avx2_sum_i64, avx2_sum_f64 },
+    { avx2_prefix_i64, avx2_prefix_f64 },
+    avx2_copy, avx2_move, avx2_fill, avx2_compare, avx2_find, avx2_count
+};
+#endif
+
+const ArrayKernels* array_kernels = &scalar_kernels;
+uint32_t crc32c_table[256];
+bool crc32c_hardware = false;
+
+void crc32c_init_table() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0x82F63B78u & -(crc & 1));
+        crc32c_table[i] = crc;
+    }
+}
+
+/* Picks the widest kernel set the CPU and OS support, capped by --simd. */
+const char* array_select_kernels() {
+    array_kernels = &scalar_kernels;
+    crc32c_hardware = false;
+    crc32c_init_table();
+#if defined(__x86_64__)
+    unsigned int eax, ebx, ecx, edx;
+    if (simd_limit < 1 || !__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(edx & bit_SSE2)) return array_kernels->name;
+    array_kernels = &sse2_kernels;
+    crc32c_hardware = (ecx & bit_SSE4_2) != 0;
+    
+    if (simd_limit < 2 || !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) return array_kernels->name;
+    uint32_t xcr0_low, xcr0_high;
+    __asm__ volatile ("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+    if ((xcr0_low & 6) == 6 && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2)) {
+        array_kernels = &avx2_kernels;
+    }
+#endif
+    return array_kernels->name;
+}
+
+void object_index_insert(int record) {
+    unsigned int slot = (object_registry[record].address * 2654435761u) & (OBJECT_INDEX_SIZE - 1);
+    int expected = 0;
+    while (!atomic_compare_exchange_strong(&object_index[slot], &expected, record + 1)) {
+        expected = 0;
+        slot = (slot + 1) & (OBJECT_INDEX_SIZE - 1);
+    }
+}
+
+void object_index_rebuild(int count) {
+    for (int i = 0; i < OBJECT_INDEX_SIZE; i++) atomic_store_explicit(&object_index[i], 0, memory_order_relaxed);
+    atomic_store(&object_count, count);
+    for (int i = 0; i < count; i++) object_index_insert(i);
+}
+
+unsigned int object_register(unsigned int address, ObjectKind kind, int type, uint32_t length, uint32_t layout) {
+    int record = atomic_fetch_add(&object_count, 1);
+    if (record >= MAX_OBJECTS) {
+        atomic_fetch_sub(&object_count, 1);
+        runtime_error(EXC_OUT_OF_MEMORY, "[OUT OF MEMORY] More than %d arrays and structs at line %d\n", MAX_OBJECTS, vm->current_line);
+    }
+    object_registry[record] = (ObjectRecord){ address, (uint16_t)kind, (uint16_t)type, length, layout };
+    object_index_insert(record);
+    return address;
+}
+
+/* The heap never hands out an address twice, so a handle names at most one record. */
+ObjectRecord* object_at(int64_t handle) {
+    if (handle <= 0 || handle >= memory_size) return NULL;
+    unsigned int slot = ((unsigned int)handle * 2654435761u) & (OBJECT_INDEX_SIZE - 1);
+    for (;;) {
+        int record = atomic_load_explicit(&object_index[slot], memory_order_acquire);
+        if (record == 0) return NULL;
+        if (object_registry[record - 1].address == handle) return &object_registry[record - 1];
+        slot = (slot + 1) & (OBJECT_INDEX_SIZE - 1);
+    }
+}
+
+ObjectRecord* array_at(int64_t handle) {
+    ObjectRecord* array = object_at(handle);
+    if (!array || array->kind != OBJECT_ARRAY) {
+        runtime_error(EXC_TYPE, "[TYPE ERROR] Invalid array 0x%lx at line %d\n", handle, vm->current_line);
+    }
+    return array;
+}
+
+void* array_data(ObjectRecord* array) {
+    return memory + array->address;
+}
+
+int64_t array_new(int64_t length, int64_t element) {
+    if (element != ARRAY_INT64 && element != ARRAY_FLOAT64) {
+        runtime_error(EXC_TYPE, "[TYPE ERROR] Arrays hold int64 or float64 elements at line %d\n", vm->current_line);
+    }
+    if (length < 0 || length > MEMORY_SIZE / 8) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Invalid array length %ld at line %d\n", length, vm->current_line);
+    }
+    unsigned int size = length > 0 ? (unsigned int)length * 8 : 8;
+    unsigned int addr = malloc_sosu_aligned(size, 32);
+    memset(memory + addr, 0, size);
+    return object_register(addr, OBJECT_ARRAY, (int)element, (uint32_t)length, 0);
+}
+
+void array_declare(const char* type_str, const char* name) {
+    const char* open = strchr(type_str, '[');
+    char element[32];
+    snprintf(element, sizeof(element), "%.*s", (int)(open - type_str), type_str);
+    DataType type = parse_type(element);
+    if (type != TYPE_INT64 && type != TYPE_FLOAT64) {
+        runtime_error(EXC_TYPE, "[TYPE ERROR] Arrays hold int64 or float64 elements at line %d\n", vm->current_line);
+    }
+    
+    declare_variable(name, TYPE_ARRAY, false, false, false);
+    int64_t* slot = (int64_t*)(memory + find_variable(name)->address);
+    if (*slot == 0) *slot = array_new(atoll(open + 1), type == TYPE_INT64 ? ARRAY_INT64 : ARRAY_FLOAT64);
+}
+
+int64_t array_index(ObjectRecord* array, int64_t index) {
+    if (index < 0 || index >= array->length) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Array index %ld out of bounds (length %u) at line %d\n",
+                      index, array->length, vm->current_line);
+    }
+    return index;
+}
+
+void array_check_pair(ObjectRecord* a, ObjectRecord* b) {
+    if (a->type != b->type) {
+        runtime_error(EXC_TYPE, "[TYPE ERROR] Array element types differ at line %d\n", vm->current_line);
+    }
+    if (a->length != b->length) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Array lengths differ (%u and %u) at line %d\n",
+                      a->length, b->length, vm->current_line);
+    }
+}
+
+void push_element(ObjectRecord* array, union StackValue value) {
+    if (array->type == ARRAY_FLOAT64) push_float64(value.f64);
+    else push_int64(value.i64);
+}
+
+void array_call(int64_t op) {
+    if (op >= ARRAY_ADD && op < ARRAY_ADD + ARRAY_BINARY_OPS) {
+        ObjectRecord* b = array_at(pop_int64());
+        ObjectRecord* a = array_at(pop_int64());
+        ObjectRecord* dst = array_at(pop_int64());
+        array_check_pair(a, b);
+        array_check_pair(dst, a);
+        array_kernels->binary[a->type][op - ARRAY_ADD](array_data(dst), array_data(a), array_data(b), a->length);
+    } else if (op == ARRAY_NEW) {
+        int64_t element = pop_int64();
+        push_int64(array_new(pop_int64(), element));
+    } else if (op == ARRAY_LENGTH) {
+        push_int64(array_at(pop_int64())->length);
+    } else if (op == ARRAY_GET) {
+        int64_t index = pop_int64();
+        ObjectRecord* array = array_at(pop_int64());
+        push_element(array, ((union StackValue*)array_data(array))[array_index(array, index)]);
+    } else if (op == ARRAY_SET || op == ARRAY_FILL) {
+        bool is_float = vm->sp > 0 && vm->stack_types[vm->sp - 1] == TYPE_FLOAT64;
+        union StackValue value = pop_value();
+        int64_t index = op == ARRAY_SET ? pop_int64() : 0;
+        ObjectRecord* array = array_at(pop_int64());
+        if (array->type == ARRAY_FLOAT64 && !is_float) value.f64 = (double)value.i64;
+        else if (array->type == ARRAY_INT64 && is_float) value.i64 = (int64_t)value.f64;
+        
+        union StackValue* data = array_data(array);
+        if (op == ARRAY_SET) data[array_index(array, index)] = value;
+        else for (uint32_t i = 0; i < array->length; i++) data[i] = value;
+    } else if (op == ARRAY_DOT) {
+        ObjectRecord* b = array_at(pop_int64());
+        ObjectRecord* a = array_at(pop_int64());
+        array_check_pair(a, b);
+        push_element(a, array_kernels->dot[a->type](array_data(a), array_data(b), a->length));
+    } else if (op == ARRAY_SUM) {
+        ObjectRecord* a = array_at(pop_int64());
+        push_element(a, array_kernels->sum[a->type](array_data(a), NULL, a->length));
+    } else if (op == ARRAY_PREFIX_SUM) {
+        ObjectRecord* a = array_at(pop_int64());
+        ObjectRecord* dst = array_at(pop_int64());
+        array_check_pair(dst, a);
+        array_kernels->prefix[a->type](array_data(dst), array_data(a), a->length);
+    } else {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Unknown array operation %ld at line %d\n", op, vm->current_line);
+    }
+}
+
+/* One bounds check per bulk operation; the sealed string pool is never a destination. */
+unsigned char* memory_range(int64_t address, int64_t length, bool write) {
+    if (address < 0 || length < 0 || address > memory_size - length) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Memory range (0x%lx, %ld) out of bounds at line %d\n",
+                      address, length, vm->current_line);
+    }
+    if (write && length > 0 && address < STRING_POOL_BASE + (int64_t)string_pool_sealed && address + length > STRING_POOL_BASE) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Write to read-only string pool (0x%lx) at line %d\n", address, vm->current_line);
+    }
+    return memory + address;
+}
+
+/* Arguments follow the C library: dst src n, dst byte n, a b n, src byte n. */
+void memory_call(int64_t op) {
+    int64_t length = pop_int64();
+    int64_t second = pop_int64();
+    int64_t first = pop_int64();
+    
+    if (op == MEM_COPY || op == MEM_MOVE) {
+        unsigned char* src = memory_range(second, length, false);
+        unsigned char* dst = memory_range(first, length, true);
+        if (op == MEM_COPY && dst < src + length && src < dst + length) {
+            runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Overlapping copy (use move) at line %d\n", vm->current_line);
+        }
+        if (op == MEM_COPY) array_kernels->copy(dst, src, length);
+        else array_kernels->move(dst, src, length);
+    } else if (op == MEM_FILL) {
+        array_kernels->fill(memory_range(first, length, true), (int)second, length);
+    } else if (op == MEM_COMPARE) {
+        push_int64(array_kernels->compare(memory_range(first, length, false), memory_range(second, length, false), length));
+    } else if (op == MEM_FIND) {
+        push_int64(array_kernels->find(memory_range(first, length, false), (int)second, length));
+    } else if (op == MEM_COUNT) {
+        push_int64(array_kernels->count(memory_range(first, length, false), (int)second, length));
+    } else {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Unknown memory operation %ld at line %d\n", op, vm->current_line);
+    }
+}
+
+uint32_t crc32c_software(uint32_t crc, const unsigned char* data, size_t n) {
+    for (size_t i = 0; i < n; i++) crc = (crc >> 8) ^ crc32c_table[(crc ^ data[i]) & 0xFF];
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) uint32_t crc32c_sse42(uint32_t crc, const unsigned char* data, size_t n) {
+    uint64_t wide = crc;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = (uint32_t)wide;
+    for (; i < n; i++) crc = _mm_crc32_u8(crc, data[i]);
+    return crc;
+}
+#endif
+
+uint32_t crc32c(const unsigned char* data, size_t n) {
+#if defined(__x86_64__)
+    if (crc32c_hardware) return ~crc32c_sse42(~0u, data, n);
+#endif
+    return ~crc32c_software(~0u, data, n);
+}
+
+#define XXH_PRIME1 11400714785074694791ULL
+#define XXH_PRIME2 14029467366897019727ULL
+#define XXH_PRIME3 1609587929392839161ULL
+#define XXH_PRIME4 9650029242287828579ULL
+#define XXH_PRIME5 2870177450012600261ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char* p) {
+    uint64_t value;
+    memcpy(&value, p, 8);
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char* p) {
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+    return rotl64(acc + input * XXH_PRIME2, 31) * XXH_PRIME1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t lane) {
+    return (acc ^ xxh64_round(0, lane)) * XXH_PRIME1 + XXH_PRIME4;
+}
+
+/* Four independent lanes per 32-byte stripe keep the multiplier busy; the tail is folded in 8, 4 and 1 byte steps. */
+uint64_t xxhash64(const unsigned char* data, size_t n, uint64_t seed) {
+    const unsigned char* p = data;
+    const unsigned char* end = data + n;
+    uint64_t hash;
+    
+    if (n >= 32) {
+        uint64_t v1 = seed + XXH_PRIME1 + XXH_PRIME2, v2 = seed + XXH_PRIME2, v3 = seed, v4 = seed - XXH_PRIME1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = xxh64_round(v1, read64(p));
+            v2 = xxh64_round(v2, read64(p + 8));
+            v3 = xxh64_round(v3, read64(p + 16));
+            v4 = xxh64_round(v4, read64(p + 24));
+        }
+        hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        hash = xxh64_merge(hash, v1);
+        hash = xxh64_merge(hash, v2);
+        hash = xxh64_merge(hash, v3);
+        hash = xxh64_merge(hash, v4);
+    } else {
+        hash = seed + XXH_PRIME5;
+    }
+    hash += n;
+    
+    for (; p + 8 <= end; p += 8) hash = rotl64(hash ^ xxh64_round(0, read64(p)), 27) * XXH_PRIME1 + XXH_PRIME4;
+    if (p + 4 <= end) {
+        hash = rotl64(hash ^ (read32(p) * XXH_PRIME1), 23) * XXH_PRIME2 + XXH_PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++) hash = rotl64(hash ^ (*p * XXH_PRIME5), 11) * XXH_PRIME1;
+    
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static inline uint32_t rotr32(uint32_t x, int r) {
+    return (x >> r) | (x << (32 - r));
+}
+
+static inline uint32_t read_be32(const unsigned char* p) {
+    return __builtin_bswap32(read32(p));
+}
+
+static void sha256_block(uint32_t state[8], const unsigned char* block) {
+    uint32_t w[64];
+    for (int t = 0; t < 16; t++) w[t] = read_be32(block + 4 * t);
+    for (int t = 16; t < 64; t++) {
+        uint32_t s0 = rotr32(w[t - 15], 7) ^ rotr32(w[t - 15], 18) ^ (w[t - 15] >> 3);
+        uint32_t s1 = rotr32(w[t - 2], 17) ^ rotr32(w[t - 2], 19) ^ (w[t - 2] >> 10);
+        w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+    }
+    
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int t = 0; t < 64; t++) {
+        uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[t] + w[t];
+        uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+/* Builds the padded final block(s) of an n-byte message; returns how many (1 or 2). */
+static int sha256_pad(unsigned char tail[128], const unsigned char* data, size_t n) {
+    size_t rest = n % 64;
+    int blocks = rest < 56 ? 1 : 2;
+    memset(tail, 0, 128);
+    memcpy(tail, data + n - rest, rest);
+    tail[rest] = 0x80;
+    uint64_t bits = (uint64_t)n * 8;
+    for (int i = 0; i < 8; i++) tail[blocks * 64 - 1 - i] = (unsigned char)(bits >> (8 * i));
+    return blocks;
+}
+
+void sha256(unsigned char digest[32], const unsigned char* data, size_t n) {
+    uint32_t state[8];
+    memcpy(state, sha256_iv, sizeof(state));
+    for (size_t i = 0; i + 64 <= n; i += 64) sha256_block(state, data + i);
+    
+    unsigned char tail[128];
+    int blocks = sha256_pad(tail, data, n);
+    for (int i = 0; i < blocks; i++) sha256_block(state, tail + 64 * i);
+    for (int i = 0; i < 8; i++) {
+        uint32_t word = __builtin_bswap32(state[i]);
+        memcpy(digest + 4 * i, &word, 4);
+    }
+}
+
+#if defined(__x86_64__)
+AVX2 static inline __m256i avx2_rotr32(__m256i x, int r) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, r), _mm256_slli_epi32(x, 32 - r));
+}
+
+/* One block of each of 8 messages, one message per 32-bit lane. */
+AVX2 static void sha256_block_x8(__m256i state[8], const unsigned char* blocks[8]) {
+    __m256i w[64];
+    for (int t = 0; t < 16; t++) {
+        w[t] = _mm256_set_epi32((int)read_be32(blocks[7] + 4 * t), (int)read_be32(blocks[6] + 4 * t),
+                                (int)read_be32(blocks[5] + 4 * t), (int)read_be32(blocks[4] + 4 * t),
+                                (int)read_be32(blocks[3] + 4 * t), (int)read_be32(blocks[2] + 4 * t),
+                                (int)read_be32(blocks[1] + 4 * t), (int)read_be32(blocks[0] + 4 * t));
+    }
+    for (int t = 16; t < 64; t++) {
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(avx2_rotr32(w[t - 15], 7), avx2_rotr32(w[t - 15], 18)), _mm256_srli_epi32(w[t - 15], 3));
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(avx2_rotr32(w[t - 2], 17), avx2_rotr32(w[t - 2], 19)), _mm256_srli_epi32(w[t - 2], 10));
+        w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0), _mm256_add_epi32(w[t - 7], s1));
+    }
+    
+    __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+    __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int t = 0; t < 64; t++) {
+        __m256i sigma1 = _mm256_xor_si256(_mm256_xor_si256(avx2_rotr32(e, 6), avx2_rotr32(e, 11)), avx2_rotr32(e, 25));
+        __m256i choose = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, sigma1), _mm256_add_epi32(choose, _mm256_add_epi32(_mm256_set1_epi32((int)sha256_k[t]), w[t])));
+        __m256i sigma0 = _mm256_xor_si256(_mm256_xor_si256(avx2_rotr32(a, 2), avx2_rotr32(a, 13)), avx2_rotr32(a, 22));
+        __m256i majority = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(t1, _mm256_add_epi32(sigma0, majority));
+    }
+    state[0] = _mm256_add_epi32(state[0], a); state[1] = _mm256_add_epi32(state[1], b);
+    state[2] = _mm256_add_epi32(state[2], c); state[3] = _mm256_add_epi32(state[3], d);
+    state[4] = _mm256_add_epi32(state[4], e); state[5] = _mm256_add_epi32(state[5], f);
+    state[6] = _mm256_add_epi32(state[6], g); state[7] = _mm256_add_epi32(state[7], h);
+}
+
+/* Hashes up to 8 equal-length messages together; missing lanes repeat the last message. */
+AVX2 static void sha256_x8(unsigned char* digests, const unsigned char* data, size_t n, int lanes) {
+    const unsigned char* messages[8];
+    const unsigned char* blocks[8];
+    unsigned char tails[8][128];
+    __m256i state[8];
+    for (int l = 0; l < 8; l++) messages[l] = data + (l < lanes ? l : lanes - 1) * n;
+    for (int i = 0; i < 8; i++) state[i] = _mm256_set1_epi32((int)sha256_iv[i]);
+    
+    for (size_t offset = 0; offset + 64 <= n; offset += 64) {
+        for (int l = 0; l < 8; l++) blocks[l] = messages[l] + offset;
+        sha256_block_x8(state, blocks);
+    }
+    int tail_blocks = 0;
+    for (int l = 0; l < 8; l++) tail_blocks = sha256_pad(tails[l], messages[l], n);
+    for (int i = 0; i < tail_blocks; i++) {
+        for (int l = 0; l < 8; l++) blocks[l] = tails[l] + 64 * i;
+        sha256_block_x8(state, blocks);
+    }
+    
+    uint32_t words[8][8];
+    for (int i = 0; i < 8; i++) _mm256_storeu_si256((__m256i*)words[i], state[i]);
+    for (int l = 0; l < lanes; l++) {
+        for (int i = 0; i < 8; i++) {
+            uint32_t word = __builtin_bswap32(words[i][l]);
+            memcpy(digests + 32 * l + 4 * i, &word, 4);
+        }
+    }
+}
+#endif
+
+/* count messages of n bytes each, back to back; digests are written back to back as well. */
+void sha256_multi(unsigned char* digests, const unsigned char* data, size_t n, size_t count) {
+    size_t i = 0;
+#if defined(__x86_64__)
+    if (array_kernels == &avx2_kernels) {
+        for (; i + 1 < count; i += 8) {
+            int lanes = count - i < 8 ? (int)(count - i) : 8;
+            sha256_x8(digests + 32 * i, data + n * i, n, lanes);
+        }
+    }
+#endif
+    for (; i < count; i++) sha256(digests + 32 * i, data + n * i, n);
+}
+
+/* Sources are (address, length) ranges of VM memory; SHA-256 digests go to a destination range. */
+void crypto_call(int64_t op) {
+    if (op == CRYPTO_CRC32C || op == CRYPTO_XXHASH64) {
+        int64_t length = pop_int64();
+        unsigned char* data = memory_range(pop_int64(), length, false);
+        if (op == CRYPTO_CRC32C) push_int64(crc32c(data, length));
+        else push_int64((int64_t)xxhash64(data, length, 0));
+    } else if (op == CRYPTO_SHA256) {
+        int64_t length = pop_int64();
+        unsigned char* data = memory_range(pop_int64(), length, false);
+        unsigned char digest[32];
+        sha256(digest, data, length);
+        memcpy(memory_range(pop_int64(), 32, true), digest, 32);
+    } else if (op == CRYPTO_SHA256_MULTI) {
+        int64_t count = pop_int64();
+        int64_t length = pop_int64();
+        int64_t source = pop_int64();
+        int64_t target = pop_int64();
+        if (count < 0 || count > memory_size / 32 || (length > 0 && count > memory_size / length)) {
+            runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Invalid message count %ld at line %d\n", count, vm->current_line);
+        }
+        unsigned char* data = memory_range(source, length * count, false);
+        unsigned char* digests = memory_range(target, 32 * count, true);
+        if (digests < data + length * count && data < digests + 32 * count) {
+            runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Digests overlap the messages at line %d\n", vm->current_line);
+        }
+        sha256_multi(digests, data, length, count);
+    } else {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Unknown crypto operation %ld at line %d\n", op, vm->current_line);
+    }
+}
+
+#define LAYOUT_AOS      0
+#define LAYOUT_SOA      1
+
+unsigned int struct_alignment(int struct_id) {
+    unsigned int align = 1;
+    for (int i = 0; i < structs[struct_id].field_count; i++) {
+        unsigned int size = type_size(structs[struct_id].field_types[i]);
+        if (size > align) align = size;
+    }
+    return align;
+}
+
+int find_field(int struct_id, const char* name) {
+    for (int i = 0; i < structs[struct_id].field_count; i++) {
+        if (strcmp(structs[struct_id].field_names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+/* Resolves a declaration head like "Point", "Point[100]" or "soa Point[100]" to its struct. */
+int struct_named(const char* text) {
+    char name[128];
+    snprintf(name, sizeof(name), "%.*s", (int)strcspn(text, "["), text);
+    return find_struct(name);
+}
+
+/* Byte offset of a field's record 0 in a collection; SoA columns start on their own cache line. */
+uint64_t collection_column(int struct_id, int layout, uint64_t length, int field) {
+    Struct* layout_info = &structs[struct_id];
+    if (layout != LAYOUT_SOA) return layout_info->field_offsets[field];
+    uint64_t column = 0;
+    for (int i = 0; i < field; i++) column = ((column + 63) & ~(uint64_t)63) + length * type_size(layout_info->field_types[i]);
+    return (column + 63) & ~(uint64_t)63;
+}
+
+int64_t struct_new(int struct_id, int64_t length, int layout) {
+    Struct* layout_info = &structs[struct_id];
+    if (length < 0) {
+        unsigned int size = layout_info->total_size > 0 ? layout_info->total_size : 1;
+        unsigned int addr = malloc_sosu_aligned(size, 8);
+        memset(memory + addr, 0, size);
+        return object_register(addr, OBJECT_STRUCT, struct_id, 0, LAYOUT_AOS);
+    }
+    
+    uint64_t size = layout == LAYOUT_SOA ?
+        collection_column(struct_id, layout, length, layout_info->field_count) :
+        (uint64_t)length * layout_info->total_size;
+    if (length > MEMORY_SIZE || size > MEMORY_SIZE) {
+        runtime_error(EXC_OUT_OF_MEMORY, "[OUT OF MEMORY] Cannot allocate %ld %s records at line %d\n",
+                      length, layout_info->name, vm->current_line);
+    }
+    if (size == 0) size = 1;
+    
+    unsigned int addr = malloc_sosu_aligned((unsigned int)size, 64);
+    memset(memory + addr, 0, size);
+    return object_register(addr, OBJECT_COLLECTION, struct_id, (uint32_t)length, (uint32_t)layout);
+}
+
+void struct_declare(char tokens[][LINE_SIZE], int token_count) {
+    bool soa = strcmp(tokens[0], "soa") == 0;
+    if (token_count < 2 + soa) return;
+    
+    const char* type = tokens[soa];
+    const char* open = strchr(type, '[');
+    int struct_id = struct_named(type);
+    if (struct_id < 0 || (soa && !open)) {
+        runtime_error(EXC_TYPE, "[TYPE ERROR] Unknown struct collection '%s' at line %d\n", type, vm->current_line);
+    }
+    
+    const char* name = tokens[1 + soa];
+    declare_variable(name, TYPE_POINTER, false, false, false);
+    int64_t* slot = (int64_t*)(memory + find_variable(name)->address);
+    if (*slot == 0) *slot = struct_new(struct_id, open ? atoll(open + 1) : -1, soa ? LAYOUT_SOA : LAYOUT_AOS);
+}
+
+ObjectRecord* struct_object(int64_t handle) {
+    ObjectRecord* object = object_at(handle);
+    if (!object || (object->kind != OBJECT_STRUCT && object->kind != OBJECT_COLLECTION)) {
+        runtime_error(EXC_TYPE, "[TYPE ERROR] 0x%lx is not a struct at line %d\n", handle, vm->current_line);
+    }
+    return object;
+}
+
+int64_t struct_handle(ProgramLine* line) {
+    if (line->link >= 0) return vm->stack[frame_base() + line->link].i64;
+    const char* text = line->line + strspn(line->line, " \t");
+    char name[256];
+    snprintf(name, sizeof(name), "%.*s", (int)strcspn(text, "."), text);
+    return *(int64_t*)(memory + get_variable_address(name));
+}
+
+/* Looks the member of a dynamic site up by struct id. Up to INLINE_CACHE_WAYS struct ids are
+   remembered per site; further ones always take the name search. */
+int inline_cache_lookup(ProgramLine* line, int struct_id, bool method) {
+    InlineCache* cache = &inline_caches[line->jump];
+    for (int w = 0; w < INLINE_CACHE_WAYS; w++) {
+        uint64_t entry = atomic_load_explicit(&cache->entries[w], memory_order_relaxed);
+        if (entry >> 32 == (uint64_t)struct_id + 1) {
+            if (profiling_enabled) profile_thread()->cache_hits++;
+            return (int)(uint32_t)entry;
+        }
+        if (entry == 0) break;
+    }
+    if (profiling_enabled) profile_thread()->cache_misses++;
+    
+    const char* member = strchr(line->line, '.') + 1;
+    char name[256];
+    if (method) snprintf(name, sizeof(name), "%s.%.*s", structs[struct_id].name, (int)strcspn(member, "( \t"), member);
+    else snprintf(name, sizeof(name), "%.*s", (int)strcspn(member, " \t"), member);
+    int target = method ? find_function(name) : find_field(struct_id, name);
+    if (target < 0) {
+        runtime_error(EXC_TYPE, "[TYPE ERROR] %s has no %s '%s' at line %d\n", structs[struct_id].name,
+                      method ? "method" : "field", method ? name + strlen(structs[struct_id].name) + 1 : name, vm->current_line);
+    }
+    
+    uint64_t fresh = ((uint64_t)struct_id + 1) << 32 | (uint32_t)target;
+    for (int w = 0; w < INLINE_CACHE_WAYS; w++) {
+        uint64_t expected = 0;
+        if (atomic_compare_exchange_strong(&cache->entries[w], &expected, fresh) || expected == fresh) return target;
+    }
+    atomic_store_explicit(&cache->megamorphic, true, memory_order_relaxed);
+    return target;
+}
+
+unsigned int field_address(ProgramLine* line, DataType* type) {
+    int64_t handle = struct_handle(line);
+    ObjectRecord* object = struct_object(handle);
+    bool collection = object->kind == OBJECT_COLLECTION;
+    int struct_id, field;
+    if (line->flow == FLOW_FIELD_DYNAMIC || line->flow == FLOW_FIELD_DYNAMIC_STORE) {
+        struct_id = object->type;
+        field = inline_cache_lookup(line, struct_id, false);
+    } else {
+        struct_id = line->jump / MAX_FIELDS;
+        field = line->jump % MAX_FIELDS;
+        bool element = line->flow == FLOW_ELEMENT || line->flow == FLOW_ELEMENT_STORE;
+        if (object->type != struct_id || collection != element) {
+            runtime_error(EXC_TYPE, "[TYPE ERROR] 0x%lx is not a %s%s at line %d\n", handle,
+                          structs[struct_id].name, element ? " collection" : "", vm->current_line);
+        }
+    }
+    Struct* layout = &structs[struct_id];
+    *type = layout->field_types[field];
+    uint64_t address = object->address + (uint64_t)layout->field_offsets[field];
+    if (collection) {
+        int64_t index = pop_int64();
+        if (index < 0 || index >= object->length) {
+            runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Index %ld out of bounds (length %u) at line %d\n",
+                          index, object->length, vm->current_line);
+        }
+        uint64_t stride = object->layout == LAYOUT_SOA ? type_size(*type) : layout->total_size;
+        address = object->address + collection_column(struct_id, object->layout, object->length, field) + (uint64_t)index * stride;
+    }
+    if (address + type_size(*type) > (uint64_t)memory_size) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Field address 0x%lx out of bounds at line %d\n", address, vm->current_line);
+    }
+    return (unsigned int)address;
+}
+
+/* Puts the receiver under the arguments of "obj.method()" and returns the cached target. */
+int method_prepare(ProgramLine* line) {
+    int64_t handle = struct_handle(line);
+    int function_id = inline_cache_lookup(line, struct_object(handle)->type, true);
+    int argc = functions[function_id].param_count - 1;
+    if (argc < 0 || vm->sp < argc) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Method '%s' expects %d arguments at line %d\n",
+                      functions[function_id].name, argc, vm->current_line);
+    }
+    
+    push_int64(0);
+    int slot = vm->sp - 1 - argc;
+    memmove(vm->stack + slot + 1, vm->stack + slot, argc * sizeof(union StackValue));
+    memmove(vm->stack_types + slot + 1, vm->stack_types + slot, argc * sizeof(DataType));
+    vm->stack[slot].i64 = handle;
+    vm->stack_types[slot] = TYPE_INT64;
+    return function_id;
+}
+
+void string_pool_protect(bool read_only) {
+    unsigned int size = read_only ? (string_pool_used + 4095) & ~4095u : string_pool_sealed;
+    if (size == 0) return;
+    mprotect(memory + STRING_POOL_BASE, size, read_only ? PROT_READ : PROT_READ | PROT_WRITE);
+    string_pool_sealed = read_only ? size : 0;
+}
+
+unsigned char* string_at(int64_t address, int64_t length) {
+    if (address < 0 || length < 0 || address + length > memory_size) {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Invalid string (0x%lx, %ld) at line %d\n", address, length, vm->current_line);
+    }
+    return memory + address;
+}
+
+void push_string(unsigned int address, unsigned int length) {
+    push_int64(length);
+    push_int64(address);
+}
+
+/* Strings travel as two stack values: the length below the address. */
+void string_call(int64_t op) {
+    int64_t b_address = pop_int64();
+    int64_t b_length = pop_int64();
+    unsigned char* b = string_at(b_address, b_length);
+    int64_t a_address = pop_int64();
+    int64_t a_length = pop_int64();
+    unsigned char* a = string_at(a_address, a_length);
+    
+    if (op == STR_COMPARE) {
+        int order = 0;
+        if (a != b || a_length != b_length) {
+            order = memcmp(a, b, a_length < b_length ? a_length : b_length);
+            if (order == 0) order = a_length < b_length ? -1 : a_length > b_length;
+        }
+        push_int64(order < 0 ? -1 : order > 0);
+    } else if (op == STR_EQUALS) {
+        push_bool(a_length == b_length && (a == b || memcmp(a, b, a_length) == 0));
+    } else if (op == STR_CONCAT) {
+        unsigned int address = malloc_sosu((unsigned int)(a_length + b_length + 1));
+        memcpy(memory + address, a, a_length);
+        memcpy(memory + address + a_length, b, b_length);
+        memory[address + a_length + b_length] = '\0';
+        push_string(address, (unsigned int)(a_length + b_length));
+    } else if (op == STR_FIND) {
+        int64_t found = b_length == 0 ? 0 : -1;
+        for (unsigned char* p = a; b_length > 0 && found < 0 && p + b_length <= a + a_length; p++) {
+            p = memchr(p, b[0], a + a_length - b_length + 1 - p);
+            if (!p) break;
+            if (memcmp(p, b, b_length) == 0) found = p - a;
+        }
+        push_int64(found);
+    } else {
+        runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Unknown string operation %ld at line %d\n", op, vm->current_line);
+    }
+}
+
+bool system_call(int64_t call_num) {
+    switch (call_num) {
+        case SYS_EXIT:
+            {
+                int64_t exit_code = pop_int64();
+                printf("[SYSTEM] Process terminated with code %ld\n", exit_code);
+                if (profiling_enabled) profile_report();
+                exit((int)exit_code);
+                break;
+            }
+        case SYS_PRINT:
+            {
+                int64_t addr = pop_int64();
+                int64_t len = pop_int64();
+                if (len > 0 && addr + len <= memory_size) {
+                    for (int64_t i = 0; i < len; i++) {
+                        putchar(memory[addr + i]);
+                    }
+                    fflush(stdout);
+                }
+                break;
+            }
+        case SYS_PUTCHAR:
+            {
+                char ch = (char)pop_int64();
+                putchar(ch);
+                fflush(stdout);
+                break;
+            }
+        case SYS_GETCHAR:
+            {
+                int ch = getchar();
+                push_int64(ch);
+                break;
+            }
+        case SYS_MALLOC:
+            {
+                int64_t size = pop_int64();
+                unsigned int addr = malloc_sosu((unsigned int)size);
+                push_int64((int64_t)addr);
+                break;
+            }
+        case SYS_FREE:
+            {
+                unsigned int addr = (unsigned int)pop_int64();
+                free_sosu(addr);
+                break;
+            }
+        case SYS_TIME:
+            {
+                push_int64((int64_t)time(NULL));
+                break;
+            }
+        case SYS_SLEEP:
+            {
+                int64_t seconds = pop_int64();
+                sleep((unsigned int)seconds);
+                break;
+            }
+        case SYS_RANDOM:
+            {
+                push_int64((int64_t)(vm_random() & 0x7fffffff));
+                break;
+            }
+        case SYS_MUTEX:
+            {
+                int64_t op = pop_int64();
+                if (op == MUTEX_INIT) {
+                    push_int64(sync_create(SYNC_MUTEX, 0));
+                } else if (op == MUTEX_LOCK) {
+                    mutex_lock(sync_object(pop_int64()));
+                } else if (op == MUTEX_UNLOCK) {
+                    mutex_unlock(sync_object(pop_int64()));
+                } else if (op == MUTEX_TRYLOCK) {
+                    push_bool(mutex_trylock(sync_object(pop_int64())));
+                } else {
+                    runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Unknown mutex operation %ld at line %d\n", op, vm->current_line);
+                }
+                break;
+            }
+        case SYS_SEMAPHORE:
+            {
+                int64_t op = pop_int64();
+                if (op == SEM_INIT) {
+                    int64_t initial = pop_int64();
+                    push_int64(sync_create(SYNC_SEMAPHORE, initial > 0 ? (unsigned int)initial : 0));
+                } else if (op == SEM_WAIT) {
+                    semaphore_wait(sync_object(pop_int64()));
+                } else if (op == SEM_POST) {
+                    semaphore_post(sync_object(pop_int64()));
+                } else if (op == SEM_TRYWAIT) {
+                    push_bool(semaphore_trywait(sync_object(pop_int64())));
+                } else if (op == SEM_VALUE) {
+                    push_int64(atomic_load(&sync_object(pop_int64())->word));
+                } else {
+                    runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Unknown semaphore operation %ld at line %d\n", op, vm->current_line);
+                }
+                break;
+            }
+        case SYS_CONDVAR:
+            {
+                int64_t op = pop_int64();
+                if (op == COND_INIT) {
+                    push_int64(sync_create(SYNC_CONDVAR, 0));
+                } else if (op == COND_WAIT) {
+                    SyncObject* mutex = sync_object(pop_int64());
+                    SyncObject* cond = sync_object(pop_int64());
+                    condvar_wait(cond, mutex);
+                } else if (op == COND_SIGNAL) {
+                    condvar_signal(sync_object(pop_int64()), 1);
+                } else if (op == COND_BROADCAST) {
+                    condvar_signal(sync_object(pop_int64()), INT_MAX);
+                } else {
+                    runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Unknown condition variable operation %ld at line %d\n", op, vm->current_line);
+                }
+                break;
+            }
+        case SYS_FORK:
+            {
+                int64_t op = pop_int64();
+                if (op == FORK_PROCESS) {
+                    push_int64(fork_process());
+                } else if (op == FORK_POOL_START) {
+                    int count = (int)pop_int64();
+                    int func_idx = pop_function();
+                    push_int64(pool_start(func_idx, count));
+                } else if (op == FORK_POOL_SUBMIT) {
+                    DataType type = vm->sp > 0 ? vm->stack_types[vm->sp - 1] : TYPE_INT64;
+                    union StackValue value = pop_value();
+                    pool_submit(value, type);
+                } else if (op == FORK_POOL_COLLECT) {
+                    pool_collect();
+                } else if (op == FORK_POOL_STOP) {
+                    pool_stop();
+                } else {
+                    runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Unknown fork operation %ld at line %d\n", op, vm->current_line);
+                }
+                break;
+            }
+        case SYS_COROUTINE:
+            {
+                int64_t op = pop_int64();
+                if (op == CO_CREATE) {
+                    int argc = (int)pop_int64();
+                    int func_idx = pop_function();
+                    push_int64(create_coroutine(func_idx, argc));
+                } else if (op == CO_RESUME) {
+                    resume_coroutine(pop_int64());
+                } else if (op == CO_DONE) {
+                    push_bool(get_coroutine(pop_int64())->finished);
+                } else if (op == CO_DESTROY) {
+                    destroy_coroutine(pop_int64());
+                } else {
+                    runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Unknown coroutine operation %ld at line %d\n", op, vm->current_line);
+                }
+                break;
+            }
+        case SYS_ARRAY:
+            array_call(pop_int64());
+            break;
+        case SYS_STRING:
+            string_call(pop_int64());
+            break;
+        case SYS_MEMORY:
+            memory_call(pop_int64());
+            break;
+        case SYS_CRYPTO:
+            crypto_call(pop_int64());
+            break;
+        case SYS_TASK:
+            {
+                int64_t op = pop_int64();
+                if (op == TASK_SPAWN) {
+                    int argc = (int)pop_int64();
+                    int func_idx = pop_function();
+                    push_int64(spawn_task(func_idx, argc));
+                } else if (op == TASK_JOIN) {
+                    join_task(pop_int64());
+                } else if (op == TASK_WORKER) {
+                    push_int64(current_worker ? current_worker->index : -1);
+                } else if (op == TASK_WORKERS) {
+                    push_int64(workers ? worker_count : requested_workers);
+                } else {
+                    runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Unknown task operation %ld at line %d\n", op, vm->current_line);
+                }
+                break;
+            }
+        case SYS_THREAD:
+            {
+                int64_t op = pop_int64();
+                if (op == THREAD_SPAWN) {
+                    int argc = (int)pop_int64();
+                    int func_idx = pop_function();
+                    push_int64(spawn_thread(func_idx, argc));
+                } else if (op == THREAD_JOIN) {
+                    join_thread(pop_int64());
+                } else if (op == THREAD_SELF) {
+                    push_int64(vm->id);
+                } else if (op == THREAD_YIELD) {
+                    sched_yield();
+                } else {
+                    runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Unknown thread operation %ld at line %d\n", op, vm->current_line);
+                }
+                break;
+            }
+        case SYS_GETENV:
+            {
+                int64_t addr = pop_int64();
+                char* env_var = getenv((char*)(memory + addr));
+                if (env_var) {
+                    push_int64((int64_t)malloc_sosu(strlen(env_var) + 1));
+                    strcpy((char*)(memory + vm->stack[vm->sp-1].i64), env_var);
+                } else {
+                    push_int64(0);
+                }
+                break;
+            }
+        default:
+            metrics_observe(metrics_syscall(call_num), 0);
+            fprintf(stderr, "[KERNEL PANIC] Unknown system call %ld at line %d\n", call_num, vm->current_line);
+            profile_report();
+            exit(1);
+    }
+    return true;
+}
+
+DataType parse_type(const char* type_str) {
+    if (strcmp(type_str, "void") == 0) return TYPE_VOID;
+    if (strcmp(type_str, "int8") == 0 || strcmp(type_str, "byte") == 0) return TYPE_INT8;
+    if (strcmp(type_str, "int16") == 0 || strcmp(type_str, "short") == 0) return TYPE_INT16;
+    if (strcmp(type_str, "int32") == 0 || strcmp(type_str, "int") == 0) return TYPE_INT32;
+    if (strcmp(type_str, "int64") == 0 || strcmp(type_str, "long") == 0) return TYPE_INT64;
+    if (strcmp(type_str, "uint8") == 0 || strcmp(type_str, "ubyte") == 0) return TYPE_UINT8;
+    if (strcmp(type_str, "uint16") == 0 || strcmp(type_str, "ushort") == 0) return TYPE_UINT16;
+    if (strcmp(type_str, "uint32") == 0 || strcmp(type_str, "uint") == 0) return TYPE_UINT32;
+    if (strcmp(type_str, "uint64") == 0 || strcmp(type_str, "ulong") == 0) return TYPE_UINT64;
+    if (strcmp(type_str, "float32") == 0 || strcmp(type_str, "float") == 0) return TYPE_FLOAT32;
+    if (strcmp(type_str, "float64") == 0 || strcmp(type_str, "double") == 0) return TYPE_FLOAT64;
+    if (strcmp(type_str, "char") == 0) return TYPE_CHAR;
+    if (strcmp(type_str, "bool") == 0) return TYPE_BOOL;
+    if (strstr(type_str, "*") != NULL) return TYPE_POINTER;
+    if (strstr(type_str, "[") != NULL) return TYPE_ARRAY;
+    
+    int struct_idx = find_struct(type_str);
+    if (struct_idx != -1) return TYPE_STRUCT;
+    
+    return TYPE_VOID;
+}
+
+int switch_target(int index, int64_t value) {
+    SwitchTable* table = &switch_tables[index];
+    if (table->dense) {
+        uint64_t slot = (uint64_t)(value - table->low);
+        return slot < (uint64_t)table->count ? switch_cases[table->first + slot].target : table->fallback;
+    }
+    int low = table->first, high = table->first + table->count - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (switch_cases[middle].value == value) return switch_cases[middle].target;
+        if (switch_cases[middle].value < value) low = middle + 1;
+        else high = middle - 1;
+    }
+    return table->fallback;
+}
+
+void leave_scopes(int count) {
+    vm->current_scope = vm->current_scope > count ? vm->current_scope - count : 0;
+}
+
+int execute_flow(ProgramLine* line) {
+    switch (line->flow) {
+        case FLOW_IF:
+            if (pop_bool()) {
+                vm->current_scope++;
+            } else {
+                vm->pc = line->link + 1;
+                if (program[line->link].flow == FLOW_ELSE) vm->current_scope++;
+            }
+            break;
+        case FLOW_ELSE:
+        case FLOW_CATCH:
+        case FLOW_LOOP_END:
+            leave_scopes(1);
+            vm->pc = line->jump;
+            break;
+        case FLOW_WHILE:
+            if (pop_bool()) vm->current_scope++;
+            else vm->pc = line->jump;
+            break;
+        case FLOW_LOOP:
+            vm->current_scope++;
+            break;
+        case FLOW_TRY:
+            enter_try((int)(line - program));
+            break;
+        case FLOW_FOR_TEST:
+            if (pop_bool()) {
+                vm->current_scope++;
+                vm->pc = line->link + 1;
+            } else {
+                vm->pc = line->jump;
+            }
+            break;
+        case FLOW_FOR_NEXT:
+            vm->pc = line->jump;
+            break;
+        case FLOW_BREAK:
+        case FLOW_CONTINUE:
+            leave_scopes(line->link);
+            vm->pc = line->jump;
+            break;
+        case FLOW_SWITCH:
+            vm->current_scope++;
+            vm->pc = switch_target(line->jump, pop_int64());
+            break;
+        case FLOW_CALL:
+            call_function(line->jump, line->line_number);
+            break;
+        case FLOW_TAIL_CALL:
+            if (!tail_call(line->jump, line->line_number)) call_function(line->jump, line->line_number);
+            break;
+        case FLOW_PARAM: {
+            int slot = frame_base() + line->link;
+            push_value(vm->stack[slot], vm->stack_types[slot]);
+            break;
+        }
+        case FLOW_PARAM_STORE: {
+            int slot = frame_base() + line->link;
+            DataType type = vm->stack_types[vm->sp - 1];
+            vm->stack[slot] = pop_value();
+            vm->stack_types[slot] = type;
+            coerce_argument(slot, functions[line->function_id].param_types[line->link]);
+            break;
+        }
+        case FLOW_STRUCT:
+            vm->pc = line->jump;
+            break;
+        case FLOW_FIELD:
+        case FLOW_ELEMENT:
+        case FLOW_FIELD_DYNAMIC: {
+            DataType type;
+            unsigned int address = field_address(line, &type);
+            push_typed(address, type);
+            break;
+        }
+        case FLOW_FIELD_STORE:
+        case FLOW_ELEMENT_STORE:
+        case FLOW_FIELD_DYNAMIC_STORE: {
+            DataType value_type = vm->stack_types[vm->sp - 1];
+            union StackValue value = pop_value();
+            DataType type;
+            unsigned int address = field_address(line, &type);
+            push_value(value, value_type);
+            store_typed(address, type);
+            break;
+        }
+        case FLOW_METHOD:
+            call_function(method_prepare(line), line->line_number);
+            break;
+        case FLOW_STRING:
+            push_string(line->jump, line->link);
+            break;
+        case FLOW_PRINTS:
+            fwrite(memory + line->jump, 1, line->link, stdout);
+            putchar('\n');
+            break;
+        case FLOW_RETURN:
+            if (line->link >= 0) {
+                int slot = frame_base() + line->link;
+                push_value(vm->stack[slot], vm->stack_types[slot]);
+            }
+            return function_return();
+    }
+    return 1;
+}
+
+int execute_command(char* line, int line_number) {
+    char command[LINE_SIZE];
+    char tokens[16][LINE_SIZE];
+    int token_count = 0;
+    
+    vm->current_line = line_number;
+    metrics_count_instruction();
+    if (tracing) trace_event(TRACE_LINE, line_number, 0);
+    
+    if (line_number >= 0 && line_number < program_size && line == program[line_number].line &&
+        program[line_number].flow != FLOW_NONE) {
+        return execute_flow(&program[line_number]);
+    }
+    
+    while (*line == ' ' || *line == '\t') line++;
+    
+    if (*line == '\0' || *line == ';' || (*line == '/' && *(line+1) == '/')) return 1;
+    if (strncmp(line, "/*", 2) == 0) return 1;
+    if (strncmp(line, "*/", 2) == 0) return 1;
+    
+    char buffer[LINE_SIZE];
+    char* saveptr;
+    strncpy(buffer, line, LINE_SIZE - 1);
+    buffer[LINE_SIZE - 1] = '\0';
+    
+    char* token = strtok_r(buffer, " \t\n\r", &saveptr);
+    while (token != NULL && token_count < 16) {
+        size_t len = strlen(token);
+        if (len > 0 && token[len-1] == ';') token[--len] = '\0';
+        if (len > 0) {
+            strcpy(tokens[token_count], token);
+            token_count++;
+        }
+        token = strtok_r(NULL, " \t\n\r", &saveptr);
+    }
+    
+    if (token_count == 0) return 1;
+    
+    strcpy(command, tokens[0]);
+    
+    if (jit_count < 256 && vm_random() % 100 < 5) {
+        jit_compile_function(command);
+    }
+    
+    if (vm_random() % 1000 < 10) {
+        gc_collect();
+    }
+    
+    if (strcmp(command, "namespace") == 0) {
+        if (token_count >= 2) {
+        }
+    }
+    else if (strcmp(command, "using") == 0) {
+        if (token_count >= 2) {
+        }
+    }
+    else if (strcmp(command, "enum") == 0) {
+        if (token_count >= 2) {
+        }
+    }
+    else if (strcmp(command, "public") == 0 || strcmp(command, "private") == 0 || 
+             strcmp(command, "protected") == 0 || strcmp(command, "static") == 0) {
+        if (token_count >= 2) {
+            char new_line[LINE_SIZE] = "";
+            for (int i = 1; i < token_count; i++) {
+                strcat(new_line, tokens[i]);
+                if (i < token_count - 1) strcat(new_line, " ");
+            }
+            return execute_command(new_line, line_number);
+        }
+    }
+    else if (strcmp(command, "extern") == 0) {
+        if (token_count >= 3) {
+            DataType return_type = parse_type(tokens[1]);
+            declare_function(tokens[2], line_number, return_type, true, false);
+        }
+    }
+    else if (strcmp(command, "inline") == 0) {
+        if (token_count >= 3) {
+            DataType return_type = parse_type(tokens[1]);
+            declare_function(tokens[2], line_number, return_type, false, true);
+        }
+    }
+    else if (strcmp(command, "int8") == 0 || strcmp(command, "int16") == 0 || 
+             strcmp(command, "int32") == 0 || strcmp(command, "int64") == 0 ||
+             strcmp(command, "uint8") == 0 || strcmp(command, "uint16") == 0 ||
+             strcmp(command, "uint32") == 0 || strcmp(command, "uint64") == 0 ||
+             strcmp(command, "float32") == 0 || strcmp(command, "float64") == 0 ||
+             strcmp(command, "char") == 0 || strcmp(command, "bool") == 0 ||
+             strcmp(command, "void") == 0) {
+        DataType type = parse_type(command);
+        if (token_count >= 2) {
+            for (int i = 1; i < token_count; i++) {
+                if (strcmp(tokens[i], ";") == 0) break;
+                if (strcmp(tokens[i], ",") == 0) continue;
+                
+                char* equals = strchr(tokens[i], '=');
+                if (equals) {
+                    *equals = '\0';
+                    char var_name[256];
+                    strcpy(var_name, tokens[i]);
+                    declare_variable(var_name, type, false, false, false);
+                    
+                    char* value_str = equals + 1;
+                    if (isdigit(value_str[0]) || value_str[0] == '-') {
+                        if (type >= TYPE_INT8 && type <= TYPE_INT64) {
+                            push_int64(atoll(value_str));
+                        } else if (type >= TYPE_UINT8 && type <= TYPE_UINT64) {
+                            push_int64(atoll(value_str));
+                        } else if (type == TYPE_FLOAT32 || type == TYPE_FLOAT64) {
+                            push_float64(atof(value_str));
+                        } else if (type == TYPE_BOOL) {
+                            push_bool(strcmp(value_str, "true") == 0 || atoi(value_str) != 0);
+                        }
+                        
+                        store_variable(find_variable(var_name));
+                    }
+                } else {
+                    if (tokens[i][0] != ';' && tokens[i][0] != ',') {
+                        declare_variable(tokens[i], type, false, false, false);
+                    }
+                }
+            }
+        }
+    }
+    else if (struct_count > 0 && (strcmp(command, "soa") == 0 || struct_named(command) != -1)) {
+        struct_declare(tokens, token_count);
+    }
+    else if (strchr(command, '[') && parse_type(command) == TYPE_ARRAY) {
+        if (token_count >= 2) {
+            array_declare(command, tokens[1]);
+        }
+    }
+    else if (strcmp(command, "const") == 0) {
+        if (token_count >= 3) {
+            DataType type = parse_type(tokens[1]);
+            declare_variable(tokens[2], type, false, true, false);
+        }
+    }
+    else if (strcmp(command, "{") == 0) {
+        vm->current_scope++;
+    }
+    else if (strcmp(command, "}") == 0) {
+        if (vm->current_scope > 0) vm->current_scope--;
+    }
+    else if (find_variable(command)) {
+        if (token_count == 1) {
+            push_variable(find_variable(command));
+        }
+        else if (token_count == 2 && strcmp(tokens[1], "=") == 0) {
+            store_variable(find_variable(command));
+        }
+        else if (token_count >= 3 && strcmp(tokens[1], "=") == 0) {
+            unsigned int addr = get_variable_address(command);
+            DataType var_type = get_variable_type(command);
+            
+            if (isdigit(tokens[2][0]) || tokens[2][0] == '-') {
+                switch (var_type) {
+                    case TYPE_INT8: memory[addr] = (int8_t)atoll(tokens[2]); break;
+                    case TYPE_INT16: *(int16_t*)(memory + addr) = (int16_t)atoll(tokens[2]); break;
+                    case TYPE_INT32: *(int32_t*)(memory + addr) = (int32_t)atoll(tokens[2]); break;
+                    case TYPE_INT64: *(int64_t*)(memory + addr) = atoll(tokens[2]); break;
+                    case TYPE_FLOAT32: *(float*)(memory + addr) = (float)atof(tokens[2]); break;
+                    case TYPE_FLOAT64: *(double*)(memory + addr) = atof(tokens[2]); break;
+                    case TYPE_BOOL: memory[addr] = (strcmp(tokens[2], "true") == 0); break;
+                    default: break;
+                }
+            } else if (find_variable(tokens[2])) {
+                unsigned int src_addr = get_variable_address(tokens[2]);
+                DataType src_type = get_variable_type(tokens[2]);
+                memcpy(memory + addr, memory + src_addr, find_variable(command)->size);
+            }
+        }
+    }
+    else if (strcmp(command, "new") == 0) {
+        if (token_count >= 2) {
+            bool soa = strcmp(tokens[1], "soa") == 0 && token_count >= 3;
+            const char* type = tokens[1 + soa];
+            const char* open = strchr(type, '[');
+            int struct_id = struct_named(type);
+            if (struct_id < 0) {
+                runtime_error(EXC_TYPE, "[TYPE ERROR] Unknown struct '%s' at line %d\n", type, vm->current_line);
+            }
+            push_int64(struct_new(struct_id, open ? atoll(open + 1) : -1, soa ? LAYOUT_SOA : LAYOUT_AOS));
+        }
+    }
+    else if (strcmp(command, "delete") == 0) {
+    }
+    else if (strcmp(command, "sizeof") == 0) {
+        if (token_count >= 2) {
+            int struct_id = find_struct(tokens[1]);
+            push_int64(struct_id >= 0 ? structs[struct_id].total_size : type_size(parse_type(tokens[1])));
+        }
+    }
+    else if (strcmp(command, "typeof") == 0) {
+    }
+    else if (strcmp(command, "cast") == 0) {
+    }
+    else if (strcmp(command, "import") == 0) {
+    }
+    else if (strcmp(command, "export") == 0) {
+    }
+    else if (strcmp(command, "async") == 0) {
+        if (token_count >= 2) {
+            int func_idx = find_function(tokens[1]);
+            if (func_idx != -1) {
+                int argc = token_count >= 3 ? atoi(tokens[2]) : 0;
+                push_int64(spawn_task(func_idx, argc));
+            } else if (strcmp(tokens[1], "join") == 0) {
+                join_task(pop_int64());
+            } else {
+                runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Undefined function '%s' at line %d\n", tokens[1], line_number);
+            }
+        }
+    }
+    else if (strcmp(command, "thread") == 0) {
+        if (token_count >= 2) {
+            int func_idx = find_function(tokens[1]);
+            if (func_idx != -1) {
+                int argc = token_count >= 3 ? atoi(tokens[2]) : 0;
+                push_int64(spawn_thread(func_idx, argc));
+            } else if (strcmp(tokens[1], "join") == 0) {
+                join_thread(pop_int64());
+            } else {
+                runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Undefined function '%s' at line %d\n", tokens[1], line_number);
+            }
+        }
+    }
+    else if (strcmp(command, "lock") == 0) {
+        mutex_lock(token_count >= 2 ? lock_variable(tokens[1]) : sync_object(pop_int64()));
+    }
+    else if (strcmp(command, "unlock") == 0) {
+        mutex_unlock(token_count >= 2 ? lock_variable(tokens[1]) : sync_object(pop_int64()));
+    }
+    else if (strcmp(command, "unsafe") == 0) {
+    }
+    else if (strcmp(command, "fixed") == 0) {
+    }
+    else if (strcmp(command, "stackalloc") == 0) {
+    }
+    else if (strcmp(command, "yield") == 0) {
+        if (!in_coroutine()) {
+            runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] yield outside of a coroutine at line %d\n", line_number);
+        }
+        leave_coroutine(false);
+    }
+    else if (strcmp(command, "coroutine") == 0) {
+        if (token_count >= 2) {
+            int func_idx = find_function(tokens[1]);
+            if (func_idx == -1) {
+                runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Undefined function '%s' at line %d\n", tokens[1], line_number);
+            }
+            int argc = token_count >= 3 ? atoi(tokens[2]) : 0;
+            push_int64(create_coroutine(func_idx, argc));
+        }
+    }
+    else if (strcmp(command, "resume") == 0) {
+        if (token_count >= 2) push_variable(require_variable(tokens[1]));
+        resume_coroutine(pop_int64());
+    }
+    else if (strcmp(command, "await") == 0) {
+        if (token_count >= 2) push_variable(require_variable(tokens[1]));
+        await_handle(pop_int64());
+    }
+    else if (strcmp(command, "using") == 0) {
+    }
+    else if (strcmp(command, "throw") == 0) {
+        int64_t code = pop_int64();
+        runtime_error(code, "[UNCAUGHT EXCEPTION] %lld at line %d\n", (long long)code, line_number);
+    }
+    else if (strcmp(command, "assert") == 0) {
+        bool condition = pop_bool();
+        if (!condition) {
+            runtime_error(EXC_ASSERTION, "[ASSERTION FAILED] at line %d\n", line_number);
+        }
+    }
+    else if (strcmp(command, "debug") == 0) {
+        if (tracing) {
+            trace_event(TRACE_MARK, line_number, 0);
+        } else {
+            printf("[DEBUG] Line %d: %s\n", line_number, line);
+        }
+    }
+    else if (strcmp(command, "trace") == 0) {
+        if (token_count >= 2 && strcmp(tokens[1], "dump") == 0) {
+            if (!trace_dump()) {
+                fprintf(stderr, "[TRACE] Cannot write '%s': %s\n", trace_path, strerror(errno));
+            }
+        } else if (token_count >= 2 && strcmp(tokens[1], "on") == 0) {
+            if (!tracing) {
+                tracing = true;
+                trace_start();
+            }
+        } else if (token_count >= 2 && strcmp(tokens[1], "off") == 0) {
+            tracing = false;
+        } else if (tracing) {
+            trace_event(TRACE_MARK, line_number, vm->call_stack_ptr);
+        } else {
+            printf("[TRACE] Function: %s, Line: %d\n", 
+                   vm->call_stack_ptr > 0 ? functions[vm->call_stack[vm->call_stack_ptr-1].function].name : "main", 
+                   line_number);
+        }
+    }
+    else if (strcmp(command, "benchmark") == 0) {
+        profiling_enabled = !profiling_enabled;
+        if (profiling_enabled) profile_resume(line_number);
+        printf("[BENCHMARK] Profiling %s\n", profiling_enabled ? "enabled" : "disabled");
+    }
+    else if (strcmp(command, "gc") == 0) {
+        if (token_count >= 2) {
+            if (strcmp(tokens[1], "collect") == 0) {
+                gc_collect();
+            } else if (strcmp(tokens[1], "enable") == 0) {
+                gc_enabled = true;
+            } else if (strcmp(tokens[1], "disable") == 0) {
+                gc_enabled = false;
+            }
+        }
+    }
+    else if (strcmp(command, "jit") == 0) {
+        if (token_count >= 2) {
+            if (strcmp(tokens[1], "enable") == 0) {
+            } else if (strcmp(tokens[1], "disable") == 0) {
+                jit_count = 0;
+            }
+        }
+    }
+    else if (strcmp(command, "print") == 0) {
+        if (vm->sp > 0) {
+            DataType type = vm->stack_types[vm->sp-1];
+            switch (type) {
+                case TYPE_INT8: printf("%d\n", (int)pop_int64()); break;
+                case TYPE_INT16: printf("%d\n", (int)pop_int64()); break;
+                case TYPE_INT32: printf("%d\n", (int)pop_int64()); break;
+                case TYPE_INT64: printf("%ld\n", pop_int64()); break;
+                case TYPE_UINT8: printf("%u\n", (unsigned int)pop_int64()); break;
+                case TYPE_UINT16: printf("%u\n", (unsigned int)pop_int64()); break;
+                case TYPE_UINT32: printf("%u\n", (unsigned int)pop_int64()); break;
+                case TYPE_UINT64: printf("%lu\n", (unsigned long)pop_int64()); break;
+                case TYPE_FLOAT32: printf("%f\n", (float)pop_float64()); break;
+                case TYPE_FLOAT64: printf("%f\n", pop_float64()); break;
+                case TYPE_CHAR: printf("%c\n", (char)pop_int64()); break;
+                case TYPE_BOOL: printf("%s\n", pop_bool() ? "true" : "false"); break;
+                default: printf("<unknown>\n"); pop_value(); break;
+            }
+        }
+    }
+    else if (strcmp(command, "prints") == 0) {
+        int64_t address = pop_int64();
+        int64_t length = pop_int64();
+        fwrite(string_at(address, length), 1, length, stdout);
+        putchar('\n');
+    }
+    else if (strcmp(command, "syscall") == 0) {
+        int64_t syscall_num = pop_int64();
+        uint64_t start = metrics_now();
+        if (tracing) trace_event(TRACE_SYSCALL_ENTER, line_number, (int)syscall_num);
+        bool result = system_call(syscall_num);
+        if (tracing) trace_event(TRACE_SYSCALL_EXIT, line_number, (int)syscall_num);
+        metrics_observe(metrics_syscall(syscall_num), metrics_now() - start);
+        return result;
+    }
+    else if (strcmp(command, "asm") == 0) {
+    }
+    else if (strcmp(command, "halt") == 0 || strcmp(command, "hlt") == 0) {
+        running = false;
+        return -1;
+    }
+    else if (strcmp(command, "nop") == 0) {
+    }
+    else if (strcmp(command, "break") == 0) {
+        printf("[BREAKPOINT] Execution paused at line %d\n", line_number);
+    }
+    else if (strcmp(command, "continue") == 0) {
+    }
+    else if (strcmp(command, "return") == 0) {
+        if (token_count >= 2) {
+            if (isdigit(tokens[1][0]) || (tokens[1][0] == '-' && isdigit(tokens[1][1]))) {
+                if (strchr(tokens[1], '.') != NULL) push_float64(atof(tokens[1]));
+                else push_int64(atoll(tokens[1]));
+            } else {
+                push_variable(require_variable(tokens[1]));
+            }
+        }
+        return function_return();
+    }
+    else if (strchr(command, ':') != NULL) {
+        command[strlen(command) - 1] = '\0';
+        if (find_label(command) == -1) {
+            add_label(command, line_number);
+        }
+    }
+    else {
+        if (isdigit(command[0]) || (command[0] == '-' && isdigit(command[1]))) {
+            if (strchr(command, '.') != NULL) {
+                push_float64(atof(command));
+            } else {
+                push_int64(atoll(command));
+            }
+        }
+        else if (command[0] == '&' && isalpha(command[1])) {
+            int func_idx = find_function(command + 1);
+            if (func_idx == -1) {
+                runtime_error(EXC_RUNTIME, "[RUNTIME ERROR] Undefined function '%s' at line %d\n", command + 1, line_number);
+            }
+            push_function(func_idx);
+        }
+        else if (strcmp(command, "+") == 0) {
+            DataType type1 = vm->stack_types[vm->sp-1];
+            DataType type2 = vm->stack_types[vm->sp-2];
+            
+            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
+                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
+                double b = pop_float64();
+                double a = pop_float64();
+                push_float64(a + b);
+            } else {
+                int64_t b = pop_int64();
+                int64_t a = pop_int64();
+                push_int64(a + b);
+            }
+        }
+        else if (strcmp(command, "-") == 0) {
+            DataType type1 = vm->stack_types[vm->sp-1];
+            DataType type2 = vm->stack_types[vm->sp-2];
+            
+            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
+                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
+                double b = pop_float64();
+                double a = pop_float64();
+                push_float64(a - b);
+            } else {
+                int64_t b = pop_int64();
+                int64_t a = pop_int64();
+                push_int64(a - b);
+            }
+        }
+        else if (strcmp(command, "*") == 0) {
+            DataType type1 = vm->stack_types[vm->sp-1];
+            DataType type2 = vm->stack_types[vm->sp-2];
+            
+            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
+                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
+                double b = pop_float64();
+                double a = pop_float64();
+                push_float64(a * b);
+            } else {
+                int64_t b = pop_int64();
+                int64_t a = pop_int64();
+                push_int64(a * b);
+            }
+        }
+        else if (strcmp(command, "/") == 0) {
+            DataType type1 = vm->stack_types[vm->sp-1];
+            DataType type2 = vm->stack_types[vm->sp-2];
+            
+            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
+                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
+                double b = pop_float64();
+                double a = pop_float64();
+                if (b == 0.0) {
+                    runtime_error(EXC_DIVISION_BY_ZERO, "[DIVISION BY ZERO] at line %d\n", line_number);
+                }
+                push_float64(a / b);
+            } else {
+                int64_t b = pop_int64();
+                int64_t a = pop_int64();
+                if (b == 0) {
+                    runtime_error(EXC_DIVISION_BY_ZERO, "[DIVISION BY ZERO] at line %d\n", line_number);
+                }
+                push_int64(a / b);
+            }
+        }
+        else if (strcmp(command, "%") == 0) {
+            int64_t b = pop_int64();
+            int64_t a = pop_int64();
+            if (b == 0) {
+                runtime_error(EXC_DIVISION_BY_ZERO, "[DIVISION BY ZERO] at line %d\n", line_number);
+            }
+            push_int64(a % b);
+        }
+        else if (strcmp(command, "==") == 0) {
+            DataType type1 = vm->stack_types[vm->sp-1];
+            DataType type2 = vm->stack_types[vm->sp-2];
+            
+            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
+                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
+                double b = pop_float64();
+                double a = pop_float64();
+                push_bool(a == b);
+            } else {
+                int64_t b = pop_int64();
+                int64_t a = pop_int64();
+                push_bool(a == b);
+            }
+        }
+        else if (strcmp(command, "!=") == 0) {
+            DataType type1 = vm->stack_types[vm->sp-1];
+            DataType type2 = vm->stack_types[vm->sp-2];
+            
+            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
+                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
+                double b = pop_float64();
+                double a = pop_float64();
+                push_bool(a != b);
+            } else {
+                int64_t b = pop_int64();
+                int64_t a = pop_int64();
+                push_bool(a != b);
+            }
+        }
+        else if (strcmp(command, "<") == 0) {
+            DataType type1 = vm->stack_types[vm->sp-1];
+            DataType type2 = vm->stack_types[vm->sp-2];
+            
+            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
+                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
+                double b = pop_float64();
+                double a = pop_float64();
+                push_bool(a < b);
+            } else {
+                int64_t b = pop_int64();
+                int64_t a = pop_int64();
+                push_bool(a < b);
+            }
+        }
+        else if (strcmp(command, ">") == 0) {
+            DataType type1 = vm->stack_types[vm->sp-1];
+            DataType type2 = vm->stack_types[vm->sp-2];
+            
+            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
+                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
+                double b = pop_float64();
+                double a = pop_float64();
+                push_bool(a > b);
+            } else {
+                int64_t b = pop_int64();
+                int64_t a = pop_int64();
+                push_bool(a > b);
+            }
+        }
+        else if (strcmp(command, "<=") == 0) {
+            DataType type1 = vm->stack_types[vm->sp-1];
+            DataType type2 = vm->stack_types[vm->sp-2];
+            
+            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
+                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
+                double b = pop_float64();
+                double a = pop_float64();
+                push_bool(a <= b);
+            } else {
+                int64_t b = pop_int64();
+                int64_t a = pop_int64();
+                push_bool(a <= b);
+            }
+        }
+        else if (strcmp(command, ">=") == 0) {
+            DataType type1 = vm->stack_types[vm->sp-1];
+            DataType type2 = vm->stack_types[vm->sp-2];
+            
+            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
+                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
+                double b = pop_float64();
+                double a = pop_float64();
+                push_bool(a >= b);
+            } else {
+                int64_t b = pop_int64();
+                int64_t a = pop_int64();
+                push_bool(a >= b);
+            }
+        }
+        else if (strcmp(command, "&&") == 0) {
+            bool b = pop_bool();
+            bool a = pop_bool();
+            push_bool(a && b);
+        }
+        else if (strcmp(command, "||") == 0) {
+            bool b = pop_bool();
+            bool a = pop_bool();
+            push_bool(a || b);
+        }
+        else if (strcmp(command, "!") == 0) {
+            bool a = pop_bool();
+            push_bool(!a);
+        }
+        else if (strcmp(command, "&") == 0) {
+            int64_t b = pop_int64();
+            int64_t a = pop_int64();
+            push_int64(a & b);
+        }
+        else if (strcmp(command, "|") == 0) {
+            int64_t b = pop_int64();
+            int64_t a = pop_int64();
+            push_int64(a | b);
+        }
+        else if (strcmp(command, "^") == 0) {
+            int64_t b = pop_int64();
+            int64_t a = pop_int64();
+            push_int64(a ^ b);
+        }
+        else if (strcmp(command, "~") == 0) {
+            int64_t a = pop_int64();
+            push_int64(~a);
+        }
+        else if (strcmp(command, "<<") == 0) {
+            int64_t b = pop_int64();
+            int64_t a = pop_int64();
+            push_int64(a << b);
+        }
+        else if (strcmp(command, ">>") == 0) {
+            int64_t b = pop_int64();
+            int64_t a = pop_int64();
+            push_int64(a >> b);
+        }
     }
-    else if (strchr(command, ':') != NULL) {
-        command[strlen(command) - 1] = '\0';
-        add_label(command, line_number);
+    
+    return 1;
+}
+
+int brace_delta(const char* line) {
+    int delta = 0;
+    bool in_string = false;
+    for (const char* p = line; *p; p++) {
+        if (*p == '"') in_string = !in_string;
+        else if (!in_string && *p == '{') delta++;
+        else if (!in_string && *p == '}') delta--;
+    }
+    return delta;
+}
+
+int tokenize_line(const char* line, char tokens[][256], int max_tokens) {
+    char buffer[LINE_SIZE];
+    char* saveptr;
+    int token_count = 0;
+    snprintf(buffer, sizeof(buffer), "%s", line);
+    char* token = strtok_r(buffer, " \t\n\r", &saveptr);
+    while (token != NULL && token_count < max_tokens) {
+        size_t len = strlen(token);
+        if (len > 0 && token[len-1] == ';') token[--len] = '\0';
+        if (len > 0) snprintf(tokens[token_count++], 256, "%s", token);
+        token = strtok_r(NULL, " \t\n\r", &saveptr);
+    }
+    return token_count;
+}
+
+typedef struct {
+    int kind;
+    int opener;
+    int head;
+    int separators[2];
+    int case_first;
+    int default_target;
+} Block;
+
+void compile_error(const char* message, int line) {
+    fprintf(stderr, "[COMPILE ERROR] %s at line %d\n", message, line);
+    profile_report();
+    exit(1);
+}
+
+int compare_switch_cases(const void* a, const void* b) {
+    const SwitchCase* x = a;
+    const SwitchCase* y = b;
+    return x->value < y->value ? -1 : x->value > y->value;
+}
+
+void build_switch(Block* block, int close) {
+    if (switch_count >= MAX_SWITCHES) compile_error("Too many switch statements", block->opener);
+    SwitchTable* table = &switch_tables[switch_count];
+    SwitchCase* cases = &switch_cases[block->case_first];
+    int count = switch_case_count - block->case_first;
+    int fallback = block->default_target >= 0 ? block->default_target : close;
+    
+    qsort(cases, count, sizeof(SwitchCase), compare_switch_cases);
+    for (int i = 1; i < count; i++) {
+        if (cases[i].value == cases[i - 1].value) compile_error("Duplicate case value", block->opener);
+    }
+    
+    table->fallback = fallback;
+    table->first = block->case_first;
+    table->count = count;
+    table->low = count > 0 ? cases[0].value : 0;
+    uint64_t range = count > 0 ? (uint64_t)(cases[count - 1].value - cases[0].value) + 1 : 0;
+    table->dense = count > 0 && range <= (uint64_t)count * 2 + 8 &&
+                   block->case_first + range <= MAX_SWITCH_CASES;
+    
+    if (table->dense) {
+        SwitchCase sparse[count];
+        memcpy(sparse, cases, count * sizeof(SwitchCase));
+        for (uint64_t slot = 0; slot < range; slot++) {
+            cases[slot].value = table->low + (int64_t)slot;
+            cases[slot].target = fallback;
+        }
+        for (int i = 0; i < count; i++) cases[sparse[i].value - table->low].target = sparse[i].target;
+        table->count = (int32_t)range;
+        switch_case_count = block->case_first + (int)range;
+    }
+    
+    program[block->opener].jump = switch_count++;
+}
+
+enum { BLOCK_PLAIN, BLOCK_IF, BLOCK_ELSE, BLOCK_WHILE, BLOCK_FOR, BLOCK_SWITCH, BLOCK_TRY, BLOCK_CATCH };
+
+const char* missing_brace[] = {
+    [BLOCK_IF] = "Expected '{' after if", [BLOCK_WHILE] = "Expected '{' after while condition",
+    [BLOCK_FOR] = "Expected '{' after for header", [BLOCK_SWITCH] = "Expected '{' after switch",
+    [BLOCK_TRY] = "Expected '{' after try"
+};
+
+/* Returns the line holding the '{' of an else/catch that continues the '}' at line i, or -1.
+   "} word {" may be split over several lines. */
+int continuation_line(int i, const char* word) {
+    const char* expected[3] = { "}", word, "{" };
+    char tokens[16][256];
+    int matched = 0;
+    for (int j = i; j < program_size; j++) {
+        if (program[j].opcode == OP_EMPTY) continue;
+        int token_count = tokenize_line(program[j].line, tokens, 16);
+        for (int t = 0; t < token_count; t++) {
+            if (matched == 3 || strcmp(tokens[t], expected[matched]) != 0) return -1;
+            matched++;
+        }
+        if (matched == 3) return j;
+    }
+    return -1;
+}
+
+void resolve_blocks() {
+    static Block stack[256];
+    int depth = 0;
+    int pending = -1;
+    Block header = { 0 };
+    char tokens[16][256];
+    
+    switch_count = 0;
+    switch_case_count = 0;
+    handler_count = 0;
+    
+    for (int i = 0; i < program_size; i++) {
+        const char* text = program[i].line + strspn(program[i].line, " \t");
+        if (pending == BLOCK_FOR && strcspn(text, " \t\r") == 1 && text[0] == ';') {
+            if (header.separators[1] >= 0) compile_error("Too many ';' in for header", i);
+            header.separators[header.separators[0] >= 0] = i;
+            continue;
+        }
+        if (*text == ';' || strncmp(text, "//", 2) == 0 || strncmp(text, "/*", 2) == 0 || strncmp(text, "*/", 2) == 0) continue;
+        
+        int token_count = tokenize_line(text, tokens, 16);
+        if (token_count == 0) continue;
+        const char* first = tokens[0];
+        const char* last = tokens[token_count - 1];
+        
+        int kind = -1;
+        bool loop = pending == BLOCK_WHILE || pending == BLOCK_FOR;
+        if (pending >= 0 && !loop) {
+            if (token_count != 1 || strcmp(first, "{") != 0) compile_error(missing_brace[pending], header.head);
+            kind = pending;
+            pending = -1;
+        } else if (pending >= 0) {
+            if (token_count == 1 && strcmp(first, "{") == 0) {
+                if (pending == BLOCK_FOR && header.separators[1] < 0) {
+                    compile_error("for needs 'init ; condition ; step' before '{'", i);
+                }
+                if (depth >= 256) compile_error("Blocks nested too deeply", i);
+                header.kind = pending;
+                header.opener = i;
+                program[i].flow = pending == BLOCK_WHILE ? FLOW_WHILE : FLOW_FOR_NEXT;
+                if (pending == BLOCK_FOR) {
+                    program[i].jump = header.separators[0] + 1;
+                    program[header.separators[1]].flow = FLOW_FOR_TEST;
+                    program[header.separators[1]].link = i;
+                }
+                stack[depth++] = header;
+                pending = -1;
+                continue;
+            }
+            if (brace_delta(program[i].line) != 0 || strchr(program[i].line, '{') != NULL) {
+                compile_error(missing_brace[pending], i);
+            }
+            continue;
+        }
+        
+        bool opens = strcmp(last, "{") == 0;
+        if (token_count == 1 && (strcmp(first, "while") == 0 || strcmp(first, "for") == 0 || strcmp(first, "if") == 0 ||
+                                 strcmp(first, "switch") == 0 || strcmp(first, "try") == 0)) {
+            pending = first[0] == 'w' ? BLOCK_WHILE : first[0] == 'f' ? BLOCK_FOR : first[0] == 'i' ? BLOCK_IF :
+                      first[0] == 's' ? BLOCK_SWITCH : BLOCK_TRY;
+            header = (Block){ pending, -1, i, { -1, -1 }, 0, -1 };
+            continue;
+        }
+        
+        if (kind < 0 && opens) {
+            if (strcmp(first, "if") == 0) kind = BLOCK_IF;
+            else if (strcmp(first, "while") == 0 || strcmp(first, "for") == 0) kind = BLOCK_WHILE;
+            else if (strcmp(first, "switch") == 0) kind = BLOCK_SWITCH;
+            else if (token_count == 2 && strcmp(first, "try") == 0) kind = BLOCK_TRY;
+        }
+        
+        if (kind == BLOCK_TRY) {
+            if (handler_count >= MAX_HANDLERS) compile_error("Too many try blocks", i);
+            int parent = handler_count - 1;
+            while (parent >= 0 && handlers[parent].end >= 0) parent = handlers[parent].parent;
+            int enclosing = 1;
+            int header = program[i].function_id >= 0 ? functions[program[i].function_id].line_number : -1;
+            for (int b = 0; b < depth; b++) {
+                if (stack[b].opener > header) enclosing++;
+            }
+            int nesting = parent >= 0 && handlers[parent].start > header ? handlers[parent].nesting + 1 : 0;
+            if (nesting >= MAX_TRY_NESTING) compile_error("Try blocks nested too deeply", i);
+            handlers[handler_count++] = (Handler){ i, -1, parent, enclosing, nesting };
+        }
+        if (kind >= 0) {
+            if (depth >= 256) compile_error("Blocks nested too deeply", i);
+            stack[depth++] = (Block){ kind, i, i, { -1, -1 }, switch_case_count, -1 };
+            program[i].flow = kind == BLOCK_IF ? FLOW_IF : kind == BLOCK_WHILE ? FLOW_LOOP :
+                              kind == BLOCK_TRY ? FLOW_TRY : FLOW_SWITCH;
+            continue;
+        }
+        
+        bool is_else = strcmp(first, "else") == 0 || (token_count >= 2 && strcmp(first, "}") == 0 && strcmp(tokens[1], "else") == 0);
+        bool is_catch = strcmp(first, "catch") == 0 || (token_count >= 2 && strcmp(first, "}") == 0 && strcmp(tokens[1], "catch") == 0);
+        int end = -1;
+        if (strcmp(first, "}") == 0 && depth > 0 && stack[depth - 1].kind == BLOCK_IF) end = continuation_line(i, "else");
+        if (strcmp(first, "}") == 0 && depth > 0 && stack[depth - 1].kind == BLOCK_TRY) end = continuation_line(i, "catch");
+        if (end < 0 && is_else) compile_error("'else' without matching 'if'", i);
+        if (end < 0 && is_catch) compile_error("'catch' without matching 'try'", i);
+        
+        if (end >= 0) {
+            Block* block = &stack[depth - 1];
+            bool is_if = block->kind == BLOCK_IF;
+            if (!is_if) {
+                int handler = handler_count - 1;
+                while (handlers[handler].end >= 0) handler = handlers[handler].parent;
+                handlers[handler].end = end;
+            }
+            program[block->opener].link = end;
+            program[i].flow = program[end].flow = is_if ? FLOW_ELSE : FLOW_CATCH;
+            *block = (Block){ is_if ? BLOCK_ELSE : BLOCK_CATCH, end, i, { -1, -1 }, 0, -1 };
+            i = end;
+            continue;
+        }
+        
+        bool is_case = strcmp(first, "case") == 0;
+        if (is_case || strcmp(first, "default:") == 0 || (token_count == 2 && strcmp(first, "default") == 0)) {
+            if (depth == 0 || stack[depth - 1].kind != BLOCK_SWITCH) compile_error("case outside of switch", i);
+            Block* block = &stack[depth - 1];
+            program[i].flow = FLOW_CASE;
+            if (is_case) {
+                if (token_count < 2 || (!isdigit((unsigned char)tokens[1][0]) && tokens[1][0] != '-')) {
+                    compile_error("case needs an integer value", i);
+                }
+                if (switch_case_count >= MAX_SWITCH_CASES) compile_error("Too many switch cases", i);
+                switch_cases[switch_case_count].value = atoll(tokens[1]);
+                switch_cases[switch_case_count].target = i + 1;
+                switch_case_count++;
+            } else {
+                block->default_target = i + 1;
+            }
+            continue;
+        }
+        
+        if (token_count == 1 && (strcmp(first, "break") == 0 || strcmp(first, "continue") == 0)) {
+            bool is_break = first[0] == 'b';
+            for (int b = depth - 1; b >= 0; b--) {
+                if (stack[b].kind == BLOCK_WHILE || stack[b].kind == BLOCK_FOR ||
+                    (is_break && stack[b].kind == BLOCK_SWITCH)) {
+                    program[i].flow = is_break ? FLOW_BREAK : FLOW_CONTINUE;
+                    program[i].jump = stack[b].opener;
+                    program[i].link = depth - b - (is_break ? 0 : 1);
+                    break;
+                }
+            }
+            continue;
+        }
+        
+        int delta = brace_delta(program[i].line);
+        if (strcmp(first, "}") == 0 && depth > 0 && delta < 0) {
+            Block* block = &stack[--depth];
+            program[block->opener].link = i;
+            if (block->kind == BLOCK_WHILE) {
+                program[block->opener].jump = i + 1;
+                program[i].flow = FLOW_LOOP_END;
+                program[i].jump = program[block->opener].flow == FLOW_LOOP ? block->opener : block->head + 1;
+            } else if (block->kind == BLOCK_FOR) {
+                program[block->separators[1]].jump = i + 1;
+                program[i].flow = FLOW_LOOP_END;
+                program[i].jump = block->separators[1] + 1;
+            } else if (block->kind == BLOCK_ELSE || block->kind == BLOCK_CATCH) {
+                program[block->opener].jump = i + 1;
+                program[block->head].jump = i + 1;
+            } else if (block->kind == BLOCK_TRY) {
+                compile_error("'try' without 'catch'", block->opener);
+            } else if (block->kind == BLOCK_SWITCH) {
+                build_switch(block, i);
+            }
+            delta++;
+        }
+        for (; delta > 0; delta--) {
+            if (depth >= 256) compile_error("Blocks nested too deeply", i);
+            stack[depth++] = (Block){ BLOCK_PLAIN, i, i, { -1, -1 }, 0, -1 };
+        }
+        for (; delta < 0 && depth > 0; delta++) depth--;
+    }
+    
+    if (pending >= 0) compile_error("Loop header without a body", header.head);
+    
+    for (int i = 0; i < program_size; i++) {
+        if (program[i].flow == FLOW_BREAK) program[i].jump = program[program[i].jump].link + 1;
+        else if (program[i].flow == FLOW_CONTINUE) program[i].jump = program[program[i].jump].link;
+    }
+}
+
+void parse_parameters(Function* function, const char* line, int line_number) {
+    const char* open = strchr(line, '(');
+    const char* close = open ? strchr(open, ')') : NULL;
+    if (!close) return;
+    
+    char list[LINE_SIZE];
+    snprintf(list, sizeof(list), "%.*s", (int)(close - open - 1), open + 1);
+    char* saveptr;
+    for (char* param = strtok_r(list, ",", &saveptr); param; param = strtok_r(NULL, ",", &saveptr)) {
+        char words[2][256];
+        int count = tokenize_line(param, words, 2);
+        if (count == 0 || (count == 1 && strcmp(words[0], "void") == 0)) continue;
+        if (function->param_count >= 64) compile_error("Too many parameters", line_number);
+        
+        int index = function->param_count++;
+        DataType type = count == 2 ? parse_type(words[0]) : TYPE_INT64;
+        function->param_types[index] = type == TYPE_VOID ? TYPE_INT64 : type;
+        snprintf(function->param_names[index], sizeof(function->param_names[index]), "%s", words[count - 1]);
+    }
+}
+
+int find_parameter(int function_id, const char* name) {
+    if (function_id < 0) return -1;
+    for (int i = 0; i < functions[function_id].param_count; i++) {
+        if (strcmp(functions[function_id].param_names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+void resolve_calls() {
+    char tokens[16][256];
+    for (int i = 0; i < program_size; i++) {
+        ProgramLine* line = &program[i];
+        if (line->flow != FLOW_NONE) continue;
+        if (line->opcode != OP_IDENTIFIER && strcmp(opcode_names[line->opcode], "return") != 0) continue;
+        
+        int token_count = tokenize_line(line->line, tokens, 16);
+        if (token_count == 0) continue;
+        
+        if (line->opcode != OP_IDENTIFIER) {
+            int param = token_count == 2 ? find_parameter(line->function_id, tokens[1]) : -1;
+            if (token_count == 1 || param >= 0) {
+                line->flow = FLOW_RETURN;
+                line->link = param;
+            }
+            continue;
+        }
+        
+        int param = find_parameter(line->function_id, tokens[0]);
+        if (param >= 0 && (token_count == 1 || (token_count == 2 && strcmp(tokens[1], "=") == 0))) {
+            line->flow = token_count == 1 ? FLOW_PARAM : FLOW_PARAM_STORE;
+            line->link = param;
+            continue;
+        }
+        
+        char* paren = strchr(tokens[0], '(');
+        if (paren || (token_count >= 2 && tokens[1][0] == '(')) {
+            if (paren) *paren = '\0';
+            int function_id = find_function(tokens[0]);
+            if (function_id != -1) {
+                line->flow = FLOW_CALL;
+                line->jump = function_id;
+            }
+        }
+    }
+    
+    for (int i = 0; i < program_size; i++) {
+        if (program[i].flow != FLOW_CALL) continue;
+        int next = i + 1;
+        while (next < program_size && program[next].opcode == OP_EMPTY) next++;
+        if (next < program_size && program[next].flow == FLOW_RETURN && program[next].link < 0 &&
+            program[next].function_id == program[i].function_id && find_handler(i) < 0) {
+            program[i].flow = FLOW_TAIL_CALL;
+        }
+    }
+}
+
+void declare_field(int struct_id, const char* type_name, const char* name, int line_number) {
+    Struct* layout = &structs[struct_id];
+    DataType type = parse_type(type_name);
+    if (type == TYPE_VOID || type == TYPE_ARRAY) compile_error("Unsupported field type", line_number);
+    if (layout->field_count >= MAX_FIELDS) compile_error("Too many fields", line_number);
+    for (int i = 0; i < layout->field_count; i++) {
+        if (strcmp(layout->field_names[i], name) == 0) compile_error("Duplicate field", line_number);
+    }
+    
+    unsigned int size = type_size(type);
+    unsigned int offset = (layout->total_size + size - 1) & ~(size - 1);
+    int index = layout->field_count++;
+    snprintf(layout->field_names[index], sizeof(layout->field_names[index]), "%s", name);
+    layout->field_types[index] = type;
+    layout->field_offsets[index] = offset;
+    layout->total_size = offset + size;
+}
+
+typedef struct {
+    char name[256];
+    int function_id;
+    int struct_id;
+    bool collection;
+} StructBinding;
+
+/* Binds "p.x" lines to a field offset using the declared struct of p (variable or parameter).
+   Sites whose struct is only known at run time, and method calls, get an inline cache. */
+void resolve_fields() {
+    static StructBinding bindings[1024];
+    int binding_count = 0;
+    char tokens[16][256];
+    inline_cache_count = 0;
+    if (struct_count == 0) return;
+    
+    for (int i = 0; i < program_size; i++) {
+        ProgramLine* line = &program[i];
+        int function_id = line->function_id;
+        if (line->flow != FLOW_NONE) continue;
+        int token_count = tokenize_line(line->line, tokens, 16);
+        if (token_count == 0) continue;
+        
+        if (function_id >= 0 && functions[function_id].line_number == i && strchr(line->line, '(')) {
+            const char* dot = strchr(functions[function_id].name, '.');
+            char owner[128];
+            snprintf(owner, sizeof(owner), "%.*s", dot ? (int)(dot - functions[function_id].name) : 0, functions[function_id].name);
+            if (dot && find_struct(owner) >= 0 && functions[function_id].param_count > 0) {
+                if (binding_count >= 1024) compile_error("Too many struct variables", i);
+                bindings[binding_count] = (StructBinding){ "", function_id, find_struct(owner), false };
+                snprintf(bindings[binding_count++].name, 256, "%s", functions[function_id].param_names[0]);
+            }
+            char list[LINE_SIZE];
+            const char* open = strchr(line->line, '(');
+            snprintf(list, sizeof(list), "%.*s", (int)strcspn(open + 1, ")"), open + 1);
+            char* saveptr;
+            for (char* param = strtok_r(list, ",", &saveptr); param; param = strtok_r(NULL, ",", &saveptr)) {
+                char words[2][256];
+                if (tokenize_line(param, words, 2) != 2 || find_struct(words[0]) < 0) continue;
+                if (binding_count >= 1024) compile_error("Too many struct variables", i);
+                bindings[binding_count] = (StructBinding){ "", function_id, find_struct(words[0]), false };
+                snprintf(bindings[binding_count++].name, 256, "%s", words[1]);
+            }
+            continue;
+        }
+        
+        bool soa = strcmp(tokens[0], "soa") == 0;
+        if (token_count >= 2 + soa && struct_named(tokens[soa]) >= 0) {
+            if (binding_count >= 1024) compile_error("Too many struct variables", i);
+            bindings[binding_count] = (StructBinding){ "", function_id, struct_named(tokens[soa]), strchr(tokens[soa], '[') != NULL };
+            snprintf(bindings[binding_count++].name, 256, "%s", tokens[1 + soa]);
+            continue;
+        }
+        
+        char* dot = strchr(tokens[0], '.');
+        char* paren = strchr(tokens[0], '(');
+        bool store = token_count == 2 && strcmp(tokens[1], "=") == 0;
+        if (!dot || line->opcode != OP_IDENTIFIER || (token_count != 1 && !store && !paren)) continue;
+        *dot = '\0';
+        
+        StructBinding* binding = NULL;
+        for (int b = binding_count - 1; b >= 0 && !binding; b--) {
+            if (strcmp(bindings[b].name, tokens[0]) == 0 &&
+                (bindings[b].function_id == function_id || bindings[b].function_id == -1)) {
+                binding = &bindings[b];
+            }
+        }
+        for (int b = binding_count - 1; b >= 0 && binding && binding->function_id == -1; b--) {
+            if (strcmp(bindings[b].name, tokens[0]) == 0 && bindings[b].function_id == function_id) binding = &bindings[b];
+        }
+        
+        if (paren || !binding) {
+            if (paren) *paren = '\0';
+            bool known = false;
+            for (int f = 0; f < function_count && paren && !known; f++) {
+                const char* method = strchr(functions[f].name, '.');
+                known = method && strcmp(method + 1, dot + 1) == 0;
+            }
+            for (int t = 0; t < struct_count && !paren && !known; t++) known = find_field(t, dot + 1) >= 0;
+            if (!known) {
+                if (binding) compile_error(paren ? "Unknown method" : "Unknown field", i);
+                continue;
+            }
+            if (inline_cache_count >= MAX_INLINE_CACHES) compile_error("Too many field and method sites", i);
+            line->flow = paren ? FLOW_METHOD : store ? FLOW_FIELD_DYNAMIC_STORE : FLOW_FIELD_DYNAMIC;
+            line->jump = inline_cache_count++;
+            line->link = find_parameter(function_id, tokens[0]);
+            continue;
+        }
+        
+        int field = find_field(binding->struct_id, dot + 1);
+        if (field < 0) compile_error("Unknown field", i);
+        line->flow = binding->collection ? (store ? FLOW_ELEMENT_STORE : FLOW_ELEMENT) : (store ? FLOW_FIELD_STORE : FLOW_FIELD);
+        line->jump = binding->struct_id * MAX_FIELDS + field;
+        line->link = find_parameter(function_id, tokens[0]);
+    }
+}
+
+uint64_t image_hash(const char* data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* Decodes the literal that starts at the opening quote; returns its length or -1 if unterminated. */
+int decode_literal(const char* quote, char* out) {
+    int length = 0;
+    const char* p = quote + 1;
+    for (; *p && *p != '"'; p++) {
+        char c = *p;
+        if (c == '\\' && p[1]) {
+            c = *++p;
+            if (c == 'n') c = '\n';
+            else if (c == 't') c = '\t';
+            else if (c == 'r') c = '\r';
+            else if (c == '0') c = '\0';
+        }
+        out[length++] = c;
+    }
+    return *p == '"' ? length : -1;
+}
+
+void intern_string(ProgramLine* line, const char* quote, int line_number) {
+    char text[LINE_SIZE];
+    int length = decode_literal(quote, text);
+    if (length < 0) compile_error("Unterminated string literal", line_number);
+    
+    unsigned int slot = image_hash(text, length) % STRING_TABLE_SIZE;
+    while (string_table[slot].address != 0) {
+        StringConstant* constant = &string_table[slot];
+        if (constant->length == (uint32_t)length && memcmp(memory + constant->address, text, length) == 0) {
+            line->jump = constant->address;
+            line->link = length;
+            return;
+        }
+        slot = (slot + 1) % STRING_TABLE_SIZE;
+    }
+    if (string_constant_count >= STRING_TABLE_SIZE / 2) compile_error("Too many string constants", line_number);
+    if (string_pool_used + length + 1 > STRING_POOL_SIZE) compile_error("String pool full", line_number);
+    
+    unsigned int address = STRING_POOL_BASE + string_pool_used;
+    memcpy(memory + address, text, length);
+    memory[address + length] = '\0';
+    string_pool_used += length + 1;
+    string_table[slot] = (StringConstant){ address, (uint32_t)length };
+    string_constant_count++;
+    line->jump = address;
+    line->link = length;
+}
+
+/* Writes the literals of a mapped image back into the pool and makes the pool read-only. */
+void string_pool_seal() {
+    char text[LINE_SIZE];
+    string_pool_protect(false);
+    for (int i = 0; i < program_size; i++) {
+        if (program[i].flow != FLOW_STRING && program[i].flow != FLOW_PRINTS) continue;
+        int length = decode_literal(strchr(program[i].line, '"'), text);
+        memcpy(memory + program[i].jump, text, length);
+        memory[program[i].jump + length] = '\0';
+        unsigned int end = (unsigned int)(program[i].jump + length + 1 - STRING_POOL_BASE);
+        if (end > string_pool_used) string_pool_used = end;
+    }
+    string_pool_protect(true);
+}
+
+void first_pass() {
+    printf("[COMPILER] First pass started...\n");
+    
+    string_pool_protect(false);
+    memset(string_table, 0, sizeof(string_table));
+    string_constant_count = 0;
+    string_pool_used = 0;
+    
+    int current_function = -1;
+    int current_struct = -1;
+    int struct_line = -1;
+    int depth = 0;
+    bool body_opened = false;
+    
+    for (int i = 0; i < program_size; i++) {
+        char* line = program[i].line;
+        program[i].function_id = current_function;
+        program[i].opcode = decode_opcode(line);
+        program[i].flow = FLOW_NONE;
+        program[i].jump = -1;
+        program[i].link = -1;
+        
+        while (*line == ' ' || *line == '\t') line++;
+        
+        if (*line == '\0' || *line == ';' || (*line == '/' && *(line+1) == '/')) continue;
+        if (strncmp(line, "/*", 2) == 0) continue;
+        if (strncmp(line, "*/", 2) == 0) continue;
+        
+        if (*line == '"' || strncmp(line, "prints \"", 8) == 0) {
+            program[i].flow = *line == '"' ? FLOW_STRING : FLOW_PRINTS;
+            intern_string(&program[i], strchr(line, '"'), i);
+            continue;
+        }
+        
+        if (strchr(line, ':') != NULL && strncmp(line, "case ", 5) != 0 && strncmp(line, "default", 7) != 0) {
+            char temp_line[LINE_SIZE];
+            strcpy(temp_line, line);
+            char* colon = strchr(temp_line, ':');
+            if (colon) {
+                *colon = '\0';
+                add_label(temp_line, i);
+            }
+        }
+        
+        char tokens[32][256];
+        int token_count = 0;
+        char buffer[LINE_SIZE];
+        char* saveptr;
+        strcpy(buffer, line);
+        char* token = strtok_r(buffer, " \t\n\r", &saveptr);
+        while (token != NULL && token_count < 32) {
+            snprintf(tokens[token_count], sizeof(tokens[token_count]), "%s", token);
+            token_count++;
+            token = strtok_r(NULL, " \t\n\r", &saveptr);
+        }
+        
+        if (current_struct >= 0) {
+            program[i].flow = FLOW_STRUCT;
+            if (strcmp(tokens[0], "}") == 0) {
+                Struct* layout = &structs[current_struct];
+                unsigned int align = struct_alignment(current_struct);
+                layout->total_size = (layout->total_size + align - 1) & ~(align - 1);
+                for (int j = struct_line; j <= i; j++) {
+                    if (program[j].flow == FLOW_STRUCT) program[j].jump = i + 1;
+                }
+                current_struct = -1;
+                continue;
+            }
+            for (int t = 1; t < token_count; t++) {
+                tokens[t][strcspn(tokens[t], ",")] = '\0';
+                if (tokens[t][0]) declare_field(current_struct, tokens[0], tokens[t], i);
+            }
+            continue;
+        }
+        if (token_count >= 2 && (strcmp(tokens[0], "struct") == 0 || strcmp(tokens[0], "class") == 0)) {
+            if (current_function != -1) compile_error("Structs must be declared at top level", i);
+            if (find_struct(tokens[1]) != -1) compile_error("Struct already declared", i);
+            declare_struct(tokens[1]);
+            program[i].flow = FLOW_STRUCT;
+            program[i].jump = i + 1;
+            if (strcmp(tokens[token_count - 1], "{") == 0) {
+                current_struct = struct_count - 1;
+                struct_line = i;
+            }
+            continue;
+        }
+        
+        bool is_inline = token_count >= 3 && strcmp(tokens[0], "inline") == 0;
+        if (is_inline) {
+            for (int t = 1; t < token_count; t++) strcpy(tokens[t - 1], tokens[t]);
+            token_count--;
+        }
+        
+        if (token_count >= 2) {
+            if ((strcmp(tokens[0], "void") == 0 || strcmp(tokens[0], "function") == 0 ||
+                 parse_type(tokens[0]) != TYPE_VOID) && 
+                strchr(tokens[1], '(') != NULL) {
+                char func_name[256];
+                strcpy(func_name, tokens[1]);
+                char* paren = strchr(func_name, '(');
+                if (paren) *paren = '\0';
+                DataType return_type = parse_type(tokens[0]);
+                declare_function(func_name, i, return_type, false, is_inline);
+                add_label(func_name, i);
+                current_function = function_count - 1;
+                parse_parameters(&functions[current_function], line, i);
+                program[i].function_id = current_function;
+                depth = 0;
+                body_opened = false;
+            }
+        }
+        
+        if (current_function != -1) {
+            depth += brace_delta(line);
+            if (depth > 0) body_opened = true;
+            if (body_opened && depth <= 0) {
+                current_function = -1;
+                depth = 0;
+            }
+        }
+    }
+    
+    if (current_struct >= 0) compile_error("Struct without closing '}'", struct_line);
+    resolve_blocks();
+    resolve_calls();
+    resolve_fields();
+    
+    printf("[COMPILER] First pass completed. Found %d labels, %d functions\n", 
+           label_count, function_count);
+}
+
+static bool image_section(const ImageHeader* header, uint64_t offset, uint64_t count, size_t record) {
+    return offset >= sizeof(ImageHeader) && offset <= header->image_size &&
+           count <= (header->image_size - offset) / record;
+}
+
+static bool image_text(const char* text, size_t size) {
+    return memchr(text, '\0', size) != NULL;
+}
+
+static bool image_type(DataType type) {
+    return (unsigned int)type <= TYPE_FUNCTION_PTR;
+}
+
+static bool image_slot(const Function* functions_in, const ProgramLine* line) {
+    return line->link == -1 ||
+           (line->function_id >= 0 && line->link >= 0 && line->link < functions_in[line->function_id].param_count);
+}
+
+/* Every offset, count, id and jump target in a mapped image is checked before any of it is used. */
+bool image_valid(const ImageHeader* header, const char* base) {
+    if (header->program_offset % 8 != 0 ||
+        !image_section(header, header->program_offset, header->program_size, sizeof(ProgramLine)) ||
+        !image_section(header, header->label_offset, header->label_count, sizeof(Label)) ||
+        !image_section(header, header->function_offset, header->function_count, sizeof(Function)) ||
+        !image_section(header, header->struct_offset, header->struct_count, sizeof(Struct)) ||
+        !image_section(header, header->switch_offset, header->switch_count, sizeof(SwitchTable)) ||
+        !image_section(header, header->switch_case_offset, header->switch_case_count, sizeof(SwitchCase)) ||
+        !image_section(header, header->handler_offset, header->handler_count, sizeof(Handler))) {
+        return false;
+    }
+    
+    int lines = header->program_size;
+    const Label* label = (const Label*)(base + header->label_offset);
+    for (uint32_t i = 0; i < header->label_count; i++) {
+        if (!image_text(label[i].name, sizeof(label[i].name)) || label[i].line_number < 0 || label[i].line_number >= lines) return false;
+    }
+    const Function* function = (const Function*)(base + header->function_offset);
+    for (uint32_t i = 0; i < header->function_count; i++) {
+        if (!image_text(function[i].name, sizeof(function[i].name)) || function[i].line_number < 0 ||
+            function[i].line_number >= lines || function[i].param_count < 0 || function[i].param_count > 64 ||
+            !image_type(function[i].return_type)) {
+            return false;
+        }
+        for (int p = 0; p < function[i].param_count; p++) {
+            if (!image_text(function[i].param_names[p], 64) || !image_type(function[i].param_types[p])) return false;
+        }
     }
-    else {
-        if (isdigit(command[0]) || command[0] == '-') {
-            if (strchr(command, '.') != NULL) {
-                push_float64(atof(command));
-            } else {
-                push_int64(atoll(command));
+    const Struct* layout = (const Struct*)(base + header->struct_offset);
+    for (uint32_t i = 0; i < header->struct_count; i++) {
+        if (!image_text(layout[i].name, sizeof(layout[i].name)) || layout[i].field_count < 0 ||
+            layout[i].field_count > MAX_FIELDS || layout[i].total_size > MEMORY_SIZE) {
+            return false;
+        }
+        for (int f = 0; f < layout[i].field_count; f++) {
+            if (!image_text(layout[i].field_names[f], 64) || !image_type(layout[i].field_types[f]) ||
+                (uint64_t)layout[i].field_offsets[f] + type_size(layout[i].field_types[f]) > layout[i].total_size) {
+                return false;
             }
         }
-        else if (command[0] == '"') {
+    }
+    const SwitchTable* table = (const SwitchTable*)(base + header->switch_offset);
+    for (uint32_t i = 0; i < header->switch_count; i++) {
+        if (table[i].count < 0 || table[i].first < 0 || (uint32_t)table[i].first + table[i].count > header->switch_case_count ||
+            table[i].fallback < 0 || table[i].fallback > lines) {
+            return false;
         }
-        else if (strcmp(command, "+") == 0) {
-            DataType type1 = stack_types[sp-1];
-            DataType type2 = stack_types[sp-2];
-            
-            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
-                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
-                double b = pop_float64();
-                double a = pop_float64();
-                push_float64(a + b);
-            } else {
-                int64_t b = pop_int64();
-                int64_t a = pop_int64();
-                push_int64(a + b);
-            }
+    }
+    const SwitchCase* cases = (const SwitchCase*)(base + header->switch_case_offset);
+    for (uint32_t i = 0; i < header->switch_case_count; i++) {
+        if (cases[i].target < 0 || cases[i].target > lines) return false;
+    }
+    const Handler* handler = (const Handler*)(base + header->handler_offset);
+    for (uint32_t i = 0; i < header->handler_count; i++) {
+        if (handler[i].start < 0 || handler[i].end < handler[i].start || handler[i].end >= lines ||
+            handler[i].parent < -1 || handler[i].parent >= (int)i || handler[i].depth < 0) {
+            return false;
         }
-        else if (strcmp(command, "-") == 0) {
-            DataType type1 = stack_types[sp-1];
-            DataType type2 = stack_types[sp-2];
-            
-            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
-                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
-                double b = pop_float64();
-                double a = pop_float64();
-                push_float64(a - b);
-            } else {
-                int64_t b = pop_int64();
-                int64_t a = pop_int64();
-                push_int64(a - b);
+    }
+    
+    const ProgramLine* program_in = (const ProgramLine*)(base + header->program_offset);
+    char text[LINE_SIZE];
+    for (int i = 0; i < lines; i++) {
+        const ProgramLine* line = &program_in[i];
+        if (!image_text(line->line, LINE_SIZE) || line->line_number != i || line->function_id < -1 ||
+            line->function_id >= (int)header->function_count || line->opcode < 0 || line->opcode >= OP_COUNT ||
+            line->flow < FLOW_NONE || line->flow > FLOW_PRINTS) {
+            return false;
+        }
+        bool ok = true;
+        switch (line->flow) {
+            case FLOW_IF:
+                ok = line->link >= 0 && line->link < lines;
+                break;
+            case FLOW_FOR_TEST:
+                ok = line->link >= -1 && line->link < lines && line->jump >= 0 && line->jump <= lines;
+                break;
+            case FLOW_BREAK:
+            case FLOW_CONTINUE:
+                ok = line->link >= 0 && line->jump >= 0 && line->jump <= lines;
+                break;
+            case FLOW_ELSE:
+            case FLOW_CATCH:
+            case FLOW_LOOP_END:
+            case FLOW_WHILE:
+            case FLOW_FOR_NEXT:
+            case FLOW_STRUCT:
+                ok = line->jump >= 0 && line->jump <= lines;
+                break;
+            case FLOW_SWITCH:
+                ok = line->jump >= 0 && line->jump < (int)header->switch_count;
+                break;
+            case FLOW_CALL:
+            case FLOW_TAIL_CALL:
+                ok = line->jump >= 0 && line->jump < (int)header->function_count;
+                break;
+            case FLOW_PARAM:
+            case FLOW_PARAM_STORE:
+                ok = line->link >= 0 && image_slot(function, line);
+                break;
+            case FLOW_RETURN:
+                ok = image_slot(function, line);
+                break;
+            case FLOW_FIELD:
+            case FLOW_FIELD_STORE:
+            case FLOW_ELEMENT:
+            case FLOW_ELEMENT_STORE:
+                ok = line->jump >= 0 && line->jump / MAX_FIELDS < (int)header->struct_count &&
+                     line->jump % MAX_FIELDS < layout[line->jump / MAX_FIELDS].field_count &&
+                     image_slot(function, line);
+                break;
+            case FLOW_FIELD_DYNAMIC:
+            case FLOW_FIELD_DYNAMIC_STORE:
+            case FLOW_METHOD:
+                ok = line->jump >= 0 && line->jump < MAX_INLINE_CACHES && image_slot(function, line);
+                break;
+            case FLOW_STRING:
+            case FLOW_PRINTS: {
+                const char* quote = strchr(line->line, '"');
+                ok = quote && line->jump >= STRING_POOL_BASE && line->link >= 0 &&
+                     (int64_t)line->jump + line->link < STRING_POOL_BASE + STRING_POOL_SIZE &&
+                     decode_literal(quote, text) == line->link;
+                break;
             }
         }
-        else if (strcmp(command, "*") == 0) {
-            DataType type1 = stack_types[sp-1];
-            DataType type2 = stack_types[sp-2];
-            
-            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
-                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
-                double b = pop_float64();
-                double a = pop_float64();
-                push_float64(a * b);
-            } else {
-                int64_t b = pop_int64();
-                int64_t a = pop_int64();
-                push_int64(a * b);
+        if (!ok) return false;
+    }
+    return true;
+}
+
+/* The cached lines must be the source's lines, so the image never overrides what the user wrote. */
+bool image_matches_source(const ProgramLine* lines, int count, const char* data, size_t length) {
+    const char* end = data + length;
+    int index = 0;
+    while (data < end) {
+        const char* newline = memchr(data, '\n', end - data);
+        size_t size = newline ? (size_t)(newline - data) : (size_t)(end - data);
+        if (size > 0) {
+            size_t copy = size < LINE_SIZE - 1 ? size : LINE_SIZE - 1;
+            if (index >= count || strncmp(lines[index].line, data, copy) != 0 || lines[index].line[copy] != '\0') return false;
+            index++;
+        }
+        data += size + 1;
+    }
+    return index == count;
+}
+
+bool image_load(const char* path, const char* source, size_t source_size, uint64_t hash) {
+    int fd = open(path, O_RDONLY | O_NOFOLLOW);
+    if (fd < 0) return false;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() ||
+        (st.st_mode & (S_IWGRP | S_IWOTH)) || st.st_size < (off_t)sizeof(ImageHeader)) {
+        close(fd);
+        return false;
+    }
+    
+    void* base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return false;
+    
+    ImageHeader* header = base;
+    if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0 ||
+        strncmp(header->build, IMAGE_LAYOUT, sizeof(header->build)) != 0 ||
+        header->source_hash != hash || header->source_size != source_size ||
+        header->record_sizes[0] != sizeof(ProgramLine) || header->record_sizes[1] != sizeof(Label) ||
+        header->record_sizes[2] != sizeof(Function) || header->record_sizes[3] != sizeof(Struct) ||
+        header->record_sizes[4] != sizeof(SwitchTable) || header->record_sizes[5] != sizeof(SwitchCase) ||
+        header->record_sizes[6] != sizeof(Handler) || header->handler_count > MAX_HANDLERS ||
+        header->image_size != (uint64_t)st.st_size || header->program_size > MAX_PROGRAM_LINES ||
+        header->label_count > MAX_LABELS || header->function_count > MAX_FUNCTIONS ||
+        header->struct_count > MAX_STRUCTS || header->switch_count > MAX_SWITCHES ||
+        header->switch_case_count > MAX_SWITCH_CASES || !image_valid(header, base) ||
+        !image_matches_source((const ProgramLine*)((char*)base + header->program_offset), header->program_size,
+                              source, source_size)) {
+        munmap(base, st.st_size);
+        return false;
+    }
+    
+    program = (ProgramLine*)((char*)base + header->program_offset);
+    program_size = header->program_size;
+    memcpy(labels, (char*)base + header->label_offset, header->label_count * sizeof(Label));
+    memcpy(functions, (char*)base + header->function_offset, header->function_count * sizeof(Function));
+    memcpy(structs, (char*)base + header->struct_offset, header->struct_count * sizeof(Struct));
+    memcpy(switch_tables, (char*)base + header->switch_offset, header->switch_count * sizeof(SwitchTable));
+    memcpy(switch_cases, (char*)base + header->switch_case_offset, header->switch_case_count * sizeof(SwitchCase));
+    memcpy(handlers, (char*)base + header->handler_offset, header->handler_count * sizeof(Handler));
+    for (uint32_t i = 0; i < header->label_count; i++) labels[i].name[sizeof(labels[i].name) - 1] = '\0';
+    for (uint32_t i = 0; i < header->function_count; i++) {
+        functions[i].name[sizeof(functions[i].name) - 1] = '\0';
+        for (int p = 0; p < 64; p++) functions[i].param_names[p][63] = '\0';
+    }
+    for (uint32_t i = 0; i < header->struct_count; i++) {
+        structs[i].name[sizeof(structs[i].name) - 1] = '\0';
+        for (int f = 0; f < MAX_FIELDS; f++) structs[i].field_names[f][63] = '\0';
+    }
+    switch_count = header->switch_count;
+    switch_case_count = header->switch_case_count;
+    handler_count = header->handler_count;
+    atomic_store(&label_count, header->label_count);
+    atomic_store(&function_count, header->function_count);
+    atomic_store(&struct_count, header->struct_count);
+    
+    image_base = base;
+    image_length = st.st_size;
+    return true;
+}
+
+void image_save(const char* path, uint64_t hash, size_t source_size) {
+    ImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    snprintf(header.build, sizeof(header.build), "%s", IMAGE_LAYOUT);
+    header.source_hash = hash;
+    header.source_size = source_size;
+    header.record_sizes[0] = sizeof(ProgramLine);
+    header.record_sizes[1] = sizeof(Label);
+    header.record_sizes[2] = sizeof(Function);
+    header.record_sizes[3] = sizeof(Struct);
+    header.record_sizes[4] = sizeof(SwitchTable);
+    header.record_sizes[5] = sizeof(SwitchCase);
+    header.record_sizes[6] = sizeof(Handler);
+    header.program_size = program_size;
+    header.label_count = label_count;
+    header.function_count = function_count;
+    header.struct_count = struct_count;
+    header.switch_count = switch_count;
+    header.switch_case_count = switch_case_count;
+    header.handler_count = handler_count;
+    
+    long page = sysconf(_SC_PAGESIZE);
+    header.program_offset = (sizeof(header) + page - 1) / page * page;
+    header.label_offset = header.program_offset + (uint64_t)program_size * sizeof(ProgramLine);
+    header.function_offset = header.label_offset + (uint64_t)header.label_count * sizeof(Label);
+    header.struct_offset = header.function_offset + (uint64_t)header.function_count * sizeof(Function);
+    header.switch_offset = header.struct_offset + (uint64_t)header.struct_count * sizeof(Struct);
+    header.switch_case_offset = header.switch_offset + (uint64_t)header.switch_count * sizeof(SwitchTable);
+    header.handler_offset = header.switch_case_offset + (uint64_t)header.switch_case_count * sizeof(SwitchCase);
+    header.image_size = header.handler_offset + (uint64_t)header.handler_count * sizeof(Handler);
+    
+    char temp_path[PATH_MAX];
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", path, (int)getpid());
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    FILE* out = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!out) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+    
+    static const char padding[4096];
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(padding, header.program_offset - sizeof(header), 1, out) == 1;
+    if (ok && program_size > 0) ok = fwrite(program, sizeof(ProgramLine), program_size, out) == (size_t)program_size;
+    if (ok && header.label_count > 0) ok = fwrite(labels, sizeof(Label), header.label_count, out) == header.label_count;
+    if (ok && header.function_count > 0) ok = fwrite(functions, sizeof(Function), header.function_count, out) == header.function_count;
+    if (ok && header.struct_count > 0) ok = fwrite(structs, sizeof(Struct), header.struct_count, out) == header.struct_count;
+    if (ok && header.switch_count > 0) ok = fwrite(switch_tables, sizeof(SwitchTable), header.switch_count, out) == header.switch_count;
+    if (ok && header.switch_case_count > 0) {
+        ok = fwrite(switch_cases, sizeof(SwitchCase), header.switch_case_count, out) == header.switch_case_count;
+    }
+    if (ok && header.handler_count > 0) ok = fwrite(handlers, sizeof(Handler), header.handler_count, out) == header.handler_count;
+    
+    if (fclose(out) != 0 || !ok || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+    }
+}
+
+bool load_program(const char* data, size_t length) {
+    program_size = 0;
+    const char* end = data + length;
+    while (data < end) {
+        const char* newline = memchr(data, '\n', end - data);
+        size_t size = newline ? (size_t)(newline - data) : (size_t)(end - data);
+        if (size > 0) {
+            if (program_size >= MAX_PROGRAM_LINES - 1) {
+                fprintf(stderr, "[KERNEL PANIC] Kernel too large (max %d lines)\n", MAX_PROGRAM_LINES);
+                return false;
             }
+            size_t copy = size < LINE_SIZE - 1 ? size : LINE_SIZE - 1;
+            memcpy(program[program_size].line, data, copy);
+            program[program_size].line[copy] = '\0';
+            program[program_size].line_number = program_size;
+            program[program_size].module_id = 0;
+            program_size++;
         }
-        else if (strcmp(command, "/") == 0) {
-            DataType type1 = stack_types[sp-1];
-            DataType type2 = stack_types[sp-2];
-            
-            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
-                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
-                double b = pop_float64();
-                double a = pop_float64();
-                if (b == 0.0) {
-                    fprintf(stderr, "[DIVISION BY ZERO] at line %d\n", line_number);
-                    profile_report();
-                    exit(1);
-                }
-                push_float64(a / b);
-            } else {
-                int64_t b = pop_int64();
-                int64_t a = pop_int64();
-                if (b == 0) {
-                    fprintf(stderr, "[DIVISION BY ZERO] at line %d\n", line_number);
-                    profile_report();
-                    exit(1);
+        data += size + 1;
+    }
+    return true;
+}
+
+int vm_interpret() {
+    if (hotspots_enabled) {
+        while (vm->pc < program_size && running) {
+            int line = vm->pc++;
+            if (execute_counted(line) == -1) return -1;
+        }
+    } else {
+        while (vm->pc < program_size && running) {
+            int line = vm->pc++;
+            if (execute_command(program[line].line, line) == -1) return -1;
+        }
+    }
+    return 0;
+}
+
+int vm_run(int start_line) {
+    vm->pc = start_line;
+    
+    int function_id = start_line > 0 && start_line < program_size ? program[start_line].function_id : -1;
+    bool profiled = profiling_enabled;
+    if (profiled) profile_enter(function_id);
+    
+    jmp_buf unwind;
+    jmp_buf* outer = vm->unwind;
+    vm->unwind = &unwind;
+    
+    int result;
+    if (setjmp(unwind) != 0) {
+        result = vm_interpret();
+    } else if (function_id >= 0 && aot_functions[function_id] && !hotspots_enabled && !tracing &&
+               functions[function_id].line_number + 1 == start_line && vm->call_stack_ptr == 0) {
+        result = aot_functions[function_id]();
+    } else {
+        result = vm_interpret();
+    }
+    
+    vm->unwind = outer;
+    if (profiled) profile_exit();
+    metrics_flush();
+    return result;
+}
+
+void snapshot_header(SnapshotHeader* header) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+    snprintf(header->build, sizeof(header->build), "%s", IMAGE_LAYOUT);
+    header->source_hash = kernel_hash;
+    header->record_sizes[0] = sizeof(Variable);
+    header->record_sizes[1] = sizeof(Function);
+    header->record_sizes[2] = sizeof(Struct);
+    header->record_sizes[3] = sizeof(Label);
+    header->record_sizes[4] = sizeof(SyncRecord);
+    header->record_sizes[5] = sizeof(ObjectRecord);
+}
+
+size_t snapshot_tables_size(SnapshotHeader* header) {
+    return header->variable_count * sizeof(Variable) + header->function_count * sizeof(Function) +
+           header->struct_count * sizeof(Struct) + header->label_count * sizeof(Label) +
+           header->sync_count * sizeof(SyncRecord) + header->object_count * sizeof(ObjectRecord) +
+           header->sp * (sizeof(union StackValue) + sizeof(DataType));
+}
+
+bool snapshot_save(const char* path) {
+    SnapshotHeader header;
+    snapshot_header(&header);
+    header.heap_start = atomic_load(&heap_start);
+    header.variable_count = variable_count;
+    header.function_count = function_count;
+    header.struct_count = struct_count;
+    header.label_count = label_count;
+    header.sync_count = sync_count < MAX_SYNC_OBJECTS ? sync_count : MAX_SYNC_OBJECTS;
+    header.object_count = object_count;
+    header.sp = vm->sp;
+    header.current_scope = vm->current_scope;
+    
+    long page = sysconf(_SC_PAGESIZE);
+    header.memory_offset = (sizeof(header) + snapshot_tables_size(&header) + page - 1) / page * page;
+    header.memory_length = ((uint64_t)header.heap_start + page - 1) / page * page;
+    if (header.memory_length > MEMORY_SIZE) header.memory_length = MEMORY_SIZE;
+    header.snapshot_size = header.memory_offset + header.memory_length;
+    
+    char temp_path[PATH_MAX + 32];
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", path, (int)getpid());
+    FILE* out = fopen(temp_path, "wb");
+    if (!out) return false;
+    
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = ok && fwrite(variables, sizeof(Variable), header.variable_count, out) == header.variable_count;
+    ok = ok && fwrite(functions, sizeof(Function), header.function_count, out) == header.function_count;
+    ok = ok && fwrite(structs, sizeof(Struct), header.struct_count, out) == header.struct_count;
+    ok = ok && fwrite(labels, sizeof(Label), header.label_count, out) == header.label_count;
+    ok = ok && fwrite(sync_registry, sizeof(SyncRecord), header.sync_count, out) == header.sync_count;
+    ok = ok && fwrite(object_registry, sizeof(ObjectRecord), header.object_count, out) == header.object_count;
+    ok = ok && fwrite(vm->stack, sizeof(union StackValue), header.sp, out) == (size_t)header.sp;
+    ok = ok && fwrite(vm->stack_types, sizeof(DataType), header.sp, out) == (size_t)header.sp;
+    ok = ok && fseek(out, header.memory_offset, SEEK_SET) == 0;
+    ok = ok && fwrite(memory, 1, header.memory_length, out) == header.memory_length;
+    
+    if (fclose(out) != 0 || !ok || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+        return false;
+    }
+    return true;
+}
+
+bool snapshot_restore(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    
+    SnapshotHeader header, expected;
+    snapshot_header(&expected);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+        memcmp(header.build, expected.build, sizeof(header.build)) != 0 ||
+        memcmp(header.record_sizes, expected.record_sizes, sizeof(header.record_sizes)) != 0 ||
+        header.source_hash != kernel_hash || header.snapshot_size != (uint64_t)st.st_size ||
+        header.memory_length > MEMORY_SIZE || header.heap_start > header.memory_length ||
+        header.variable_count > MAX_VARIABLES || header.function_count > MAX_FUNCTIONS ||
+        header.struct_count > MAX_STRUCTS || header.label_count > MAX_LABELS ||
+        header.sync_count > MAX_SYNC_OBJECTS || header.object_count > MAX_OBJECTS || header.sp < 0 || header.sp > STACK_SIZE ||
+        sizeof(header) + snapshot_tables_size(&header) > header.memory_offset) {
+        close(fd);
+        return false;
+    }
+    
+    char* tables = mmap(NULL, header.memory_offset, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (tables == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    if (header.memory_length > 0 &&
+        mmap(memory, header.memory_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+             fd, header.memory_offset) == MAP_FAILED) {
+        munmap(tables, header.memory_offset);
+        close(fd);
+        return false;
+    }
+    close(fd);
+    
+    char* cursor = tables + sizeof(header);
+    memcpy(variables, cursor, header.variable_count * sizeof(Variable));
+    cursor += header.variable_count * sizeof(Variable);
+    memcpy(functions, cursor, header.function_count * sizeof(Function));
+    cursor += header.function_count * sizeof(Function);
+    memcpy(structs, cursor, header.struct_count * sizeof(Struct));
+    cursor += header.struct_count * sizeof(Struct);
+    memcpy(labels, cursor, header.label_count * sizeof(Label));
+    cursor += header.label_count * sizeof(Label);
+    memcpy(sync_registry, cursor, header.sync_count * sizeof(SyncRecord));
+    cursor += header.sync_count * sizeof(SyncRecord);
+    memcpy(object_registry, cursor, header.object_count * sizeof(ObjectRecord));
+    cursor += header.object_count * sizeof(ObjectRecord);
+    memcpy(vm->stack, cursor, header.sp * sizeof(union StackValue));
+    cursor += header.sp * sizeof(union StackValue);
+    memcpy(vm->stack_types, cursor, header.sp * sizeof(DataType));
+    munmap(tables, header.memory_offset);
+    
+    atomic_store(&variable_count, header.variable_count);
+    atomic_store(&function_count, header.function_count);
+    atomic_store(&struct_count, header.struct_count);
+    atomic_store(&label_count, header.label_count);
+    atomic_store(&sync_count, header.sync_count);
+    object_index_rebuild(header.object_count);
+    atomic_store(&heap_start, header.heap_start);
+    vm->sp = header.sp;
+    vm->current_scope = header.current_scope;
+    return true;
+}
+
+void second_pass() {
+    printf("[RUNTIME] Starting execution...\n");
+    
+    int main_idx = find_function("main");
+    int entry_line = 0;
+    if (main_idx != -1) {
+        if (snapshot_in[0] && snapshot_restore(snapshot_in)) {
+            string_pool_protect(true);
+            printf("[SNAPSHOT] Restored '%s' (%d variables, %u heap bytes)\n",
+                   snapshot_in, variable_count, atomic_load(&heap_start));
+        } else {
+            if (snapshot_in[0]) {
+                fprintf(stderr, "[SNAPSHOT] Cannot restore '%s', initializing normally\n", snapshot_in);
+            }
+            for (int i = 0; i < program_size && running; i++) {
+                if (program[i].function_id == -1) {
+                    if (hotspots_enabled) execute_counted(i);
+                    else execute_command(program[i].line, i);
                 }
-                push_int64(a / b);
             }
         }
-        else if (strcmp(command, "%") == 0) {
-            int64_t b = pop_int64();
-            int64_t a = pop_int64();
-            if (b == 0) {
-                fprintf(stderr, "[DIVISION BY ZERO] at line %d\n", line_number);
-                profile_report();
-                exit(1);
-            }
-            push_int64(a % b);
+        if (snapshot_out[0]) {
+            if (snapshot_save(snapshot_out)) printf("[SNAPSHOT] Saved '%s'\n", snapshot_out);
+            else fprintf(stderr, "[SNAPSHOT] Cannot write '%s': %s\n", snapshot_out, strerror(errno));
         }
-        else if (strcmp(command, "==") == 0) {
-            DataType type1 = stack_types[sp-1];
-            DataType type2 = stack_types[sp-2];
-            
-            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
-                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
-                double b = pop_float64();
-                double a = pop_float64();
-                push_bool(a == b);
-            } else {
-                int64_t b = pop_int64();
-                int64_t a = pop_int64();
-                push_bool(a == b);
-            }
+        entry_line = functions[main_idx].line_number + 1;
+    } else if (snapshot_in[0] || snapshot_out[0]) {
+        fprintf(stderr, "[SNAPSHOT] Snapshots need a main function; ignored\n");
+    }
+    
+    if (!workers) sched_init(requested_workers);
+    sample_start();
+    metrics_start();
+    trace_start();
+    
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    
+    vm_run(entry_line);
+    join_all_threads();
+    sched_shutdown();
+    if (pool_size > 0) pool_stop();
+    sample_stop();
+    metrics_shutdown();
+    trace_shutdown();
+    
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double execution_time = (end_time.tv_sec - start_time.tv_sec) +
+                            (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+    
+    printf("[RUNTIME] Execution completed in %.6f seconds\n", execution_time);
+}
+
+bool debug_mode = false;
+
+int64_t* aot_variable(const char* name, int line_number) {
+    vm->current_line = line_number;
+    return (int64_t*)(memory + require_variable(name)->address);
+}
+
+void aot_division_by_zero(int line_number, int call_site) {
+    vm->current_line = call_site;
+    runtime_error(EXC_DIVISION_BY_ZERO, "[DIVISION BY ZERO] at line %d\n", line_number);
+}
+
+/* Runs a function whose frame is already pushed: straight into its compiled body when there
+   is one, otherwise through the interpreter until the frame is popped. */
+int aot_enter(int function_id, int depth) {
+    if (aot_functions[function_id]) return aot_functions[function_id]() == -1 ? -1 : 1;
+    
+    while (running && vm->call_stack_ptr > depth && vm->pc < program_size) {
+        int line = vm->pc++;
+        if (execute_command(program[line].line, line) == -1) return -1;
+    }
+    return 1;
+}
+
+int aot_call(int function_id, int line_number) {
+    int depth = vm->call_stack_ptr;
+    call_function(function_id, line_number);
+    return aot_enter(function_id, depth);
+}
+
+int aot_int64_name(const char* name) {
+    if (!isalpha((unsigned char)name[0]) && name[0] != '_') return 0;
+    for (const char* p = name; *p; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '_') return 0;
+    }
+    if (find_function(name) != -1) return 0;
+    
+    int declared = 0;
+    char tokens[16][256];
+    for (int i = 0; i < program_size; i++) {
+        int token_count = tokenize_line(program[i].line, tokens, 16);
+        if (token_count < 2 || strchr(tokens[1], '(') != NULL) continue;
+        bool is_const = strcmp(tokens[0], "const") == 0;
+        if (!is_const && parse_type(tokens[0]) == TYPE_VOID && strcmp(tokens[0], "void") != 0) continue;
+        for (int j = 1; j < token_count; j++) {
+            char* equals = strchr(tokens[j], '=');
+            if (equals) *equals = '\0';
+            if (strcmp(tokens[j], name) != 0) continue;
+            if (is_const || strcmp(tokens[0], "int64") != 0) return 0;
+            declared++;
         }
-        else if (strcmp(command, "!=") == 0) {
-            DataType type1 = stack_types[sp-1];
-            DataType type2 = stack_types[sp-2];
-            
-            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
-                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
-                double b = pop_float64();
-                double a = pop_float64();
-                push_bool(a != b);
-            } else {
-                int64_t b = pop_int64();
-                int64_t a = pop_int64();
-                push_bool(a != b);
-            }
+    }
+    return declared;
+}
+
+typedef struct {
+    FILE* out;
+    int depth;
+    int max_depth;
+    bool is_bool[AOT_STACK];
+    int call_site;
+} AotStack;
+
+typedef struct {
+    char names[64][256];
+    bool shadowed[64];
+    int count;
+} AotNames;
+
+void aot_flush(AotStack* stack) {
+    for (int i = 0; i < stack->depth; i++) {
+        fprintf(stack->out, "    push_%s(t%d);\n", stack->is_bool[i] ? "bool" : "int64", i);
+    }
+    stack->depth = 0;
+}
+
+int aot_push(AotStack* stack, bool is_bool) {
+    if (stack->depth == AOT_STACK) aot_flush(stack);
+    stack->is_bool[stack->depth] = is_bool;
+    if (stack->depth + 1 > stack->max_depth) stack->max_depth = stack->depth + 1;
+    return stack->depth++;
+}
+
+void aot_condition(AotStack* stack, char* condition, size_t size, bool integer) {
+    if (stack->depth > 0) {
+        snprintf(condition, size, "t%d", --stack->depth);
+    } else {
+        snprintf(condition, size, integer ? "pop_int64()" : "pop_bool()");
+    }
+    if (stack->depth > 0) {
+        fprintf(stack->out, "    c = %s;\n", condition);
+        snprintf(condition, size, "c");
+    }
+    aot_flush(stack);
+}
+
+void aot_rebind(FILE* body, AotNames* names) {
+    for (int n = 0; n < names->count; n++) {
+        if (names->shadowed[n]) fprintf(body, "    v%d = NULL;\n", n);
+    }
+}
+
+int aot_name(AotNames* names, const char* name) {
+    for (int n = 0; n < names->count; n++) {
+        if (strcmp(names->names[n], name) == 0) return n;
+    }
+    int declarations = names->count < 64 ? aot_int64_name(name) : 0;
+    if (declarations == 0) return -1;
+    snprintf(names->names[names->count], sizeof(names->names[0]), "%s", name);
+    names->shadowed[names->count] = declarations > 1;
+    return names->count++;
+}
+
+/* Lowers a line that only moves int64 values between temps, variables and parameters.
+   args is the temp holding parameter 0 of an inlined call, or -1 to use frame slots;
+   nothing at or below floor may be consumed. */
+bool aot_simple(AotStack* stack, AotNames* names, int i, char tokens[][256], int token_count, int args, int floor) {
+    static const char* binary_ops[] = { "+", "-", "*", "/", "%", "&", "|", "^", "<<", ">>",
+                                        "==", "!=", "<", ">", "<=", ">=", "&&", "||" };
+    ProgramLine* line = &program[i];
+    const char* command = tokens[0];
+    FILE* body = stack->out;
+    
+    if (line->flow == FLOW_PARAM || line->flow == FLOW_PARAM_STORE) {
+        if (parameter_slot_type(functions[line->function_id].param_types[line->link]) != TYPE_INT64) return false;
+        if (line->flow == FLOW_PARAM) {
+            int t = aot_push(stack, false);
+            if (args >= 0) fprintf(body, "    t%d = t%d;\n", t, args + line->link);
+            else fprintf(body, "    t%d = vm->stack[base + %d].i64;\n", t, line->link);
+            return true;
         }
-        else if (strcmp(command, "<") == 0) {
-            DataType type1 = stack_types[sp-1];
-            DataType type2 = stack_types[sp-2];
-            
-            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
-                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
-                double b = pop_float64();
-                double a = pop_float64();
-                push_bool(a < b);
-            } else {
-                int64_t b = pop_int64();
-                int64_t a = pop_int64();
-                push_bool(a < b);
-            }
+        if (stack->depth <= floor) return false;
+        int t = --stack->depth;
+        if (args >= 0) {
+            fprintf(body, "    t%d = t%d;\n", args + line->link, t);
+            stack->is_bool[args + line->link] = false;
+        } else {
+            fprintf(body, "    vm->stack[base + %d].i64 = t%d;\n", line->link, t);
         }
-        else if (strcmp(command, ">") == 0) {
-            DataType type1 = stack_types[sp-1];
-            DataType type2 = stack_types[sp-2];
-            
-            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
-                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
-                double b = pop_float64();
-                double a = pop_float64();
-                push_bool(a > b);
-            } else {
-                int64_t b = pop_int64();
-                int64_t a = pop_int64();
-                push_bool(a > b);
-            }
+        return true;
+    }
+    if (line->flow != FLOW_NONE || token_count == 0) return false;
+    
+    if (line->opcode == OP_LITERAL && token_count == 1 && strchr(command, '.') == NULL) {
+        int t = aot_push(stack, false);
+        fprintf(body, "    t%d = %lldLL;\n", t, (long long)atoll(command));
+        return true;
+    }
+    
+    if (line->opcode == OP_IDENTIFIER && (token_count == 1 || (token_count == 2 && strcmp(tokens[1], "=") == 0))) {
+        int variable = aot_name(names, command);
+        if (variable < 0 || (args >= 0 && names->shadowed[variable])) return false;
+        if (token_count == 1) {
+            int t = aot_push(stack, false);
+            fprintf(body, "    t%d = *AOT_VAR(v%d, \"%s\", %d);\n", t, variable, command, i);
+            return true;
         }
-        else if (strcmp(command, "<=") == 0) {
-            DataType type1 = stack_types[sp-1];
-            DataType type2 = stack_types[sp-2];
-            
-            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
-                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
-                double b = pop_float64();
-                double a = pop_float64();
-                push_bool(a <= b);
-            } else {
-                int64_t b = pop_int64();
-                int64_t a = pop_int64();
-                push_bool(a <= b);
+        if (stack->depth <= floor) return false;
+        fprintf(body, "    *AOT_VAR(v%d, \"%s\", %d) = t%d;\n", variable, command, i, --stack->depth);
+        return true;
+    }
+    
+    if (token_count != 1) return false;
+    for (int b = 0; b < (int)(sizeof(binary_ops) / sizeof(binary_ops[0])); b++) {
+        if (strcmp(command, binary_ops[b]) != 0) continue;
+        if (stack->depth - 2 < floor) return false;
+        int x = stack->depth - 2, y = stack->depth - 1;
+        stack->depth -= 2;
+        if (b >= 16) {
+            fprintf(body, "    t%d = (t%d != 0) %s (t%d != 0);\n", x, x, command, y);
+        } else {
+            if (b == 3 || b == 4) {
+                int site = stack->call_site >= 0 ? stack->call_site : i;
+                fprintf(body, "    if (t%d == 0) aot_division_by_zero(%d, %d);\n", y, i, site);
             }
+            fprintf(body, "    t%d = t%d %s t%d;\n", x, x, command, y);
         }
-        else if (strcmp(command, ">=") == 0) {
-            DataType type1 = stack_types[sp-1];
-            DataType type2 = stack_types[sp-2];
-            
-            if (type1 == TYPE_FLOAT64 || type2 == TYPE_FLOAT64 ||
-                type1 == TYPE_FLOAT32 || type2 == TYPE_FLOAT32) {
-                double b = pop_float64();
-                double a = pop_float64();
-                push_bool(a >= b);
-            } else {
-                int64_t b = pop_int64();
-                int64_t a = pop_int64();
-                push_bool(a >= b);
+        aot_push(stack, b >= 10);
+        return true;
+    }
+    if ((strcmp(command, "!") == 0 || strcmp(command, "~") == 0) && stack->depth - 1 >= floor) {
+        int x = --stack->depth;
+        fprintf(body, command[0] == '!' ? "    t%d = !t%d;\n" : "    t%d = ~t%d;\n", x, x);
+        aot_push(stack, command[0] == '!');
+        return true;
+    }
+    return false;
+}
+
+/* Expands a call to a short straight-line function in place: the arguments stay in the
+   caller's temps and the result replaces them, with no frame or VM stack traffic. */
+bool aot_inline(AotStack* stack, AotNames* names, int callee, int caller, int call_site) {
+    Function* function = &functions[callee];
+    int argc = function->param_count;
+    if (callee == caller || stack->depth < argc) return false;
+    
+    int start = function->line_number + 1;
+    int end = start;
+    int lines = 0;
+    while (end < program_size && program[end].function_id == callee) {
+        if (program[end].opcode != OP_EMPTY) lines++;
+        end++;
+    }
+    if (lines > AOT_INLINE_LINES && !function->is_inline) return false;
+    
+    char* text = NULL;
+    size_t size = 0;
+    AotStack inner = *stack;
+    inner.out = open_memstream(&text, &size);
+    inner.call_site = call_site;
+    int args = stack->depth - argc;
+    int floor = stack->depth;
+    bool returned = false;
+    bool ok = true;
+    char tokens[16][256];
+    
+    for (int i = start; i < end && ok; i++) {
+        int token_count = tokenize_line(program[i].line, tokens, 16);
+        if (program[i].opcode == OP_EMPTY || token_count == 0) continue;
+        if (returned) {
+            ok = token_count == 1 && strcmp(tokens[0], "}") == 0;
+        } else if (inner.depth >= AOT_STACK) {
+            ok = false;
+        } else if (program[i].flow == FLOW_RETURN) {
+            if (program[i].link >= 0) {
+                ok = parameter_slot_type(function->param_types[program[i].link]) == TYPE_INT64;
+                fprintf(inner.out, "    t%d = t%d;\n", aot_push(&inner, false), args + program[i].link);
             }
+            returned = true;
+        } else {
+            ok = aot_simple(&inner, names, i, tokens, token_count, args, floor);
         }
-        else if (strcmp(command, "&&") == 0) {
-            bool b = pop_bool();
-            bool a = pop_bool();
-            push_bool(a && b);
-        }
-        else if (strcmp(command, "||") == 0) {
-            bool b = pop_bool();
-            bool a = pop_bool();
-            push_bool(a || b);
-        }
-        else if (strcmp(command, "!") == 0) {
-            bool a = pop_bool();
-            push_bool(!a);
+    }
+    fclose(inner.out);
+    
+    ok = ok && returned;
+    if (ok) {
+        fprintf(stack->out, "    /* inlined %s() */\n%s", function->name, text);
+        bool has_result = inner.depth > floor;
+        if (has_result) {
+            if (inner.depth - 1 != args) fprintf(stack->out, "    t%d = t%d;\n", args, inner.depth - 1);
+            inner.is_bool[args] = inner.is_bool[inner.depth - 1];
         }
-        else if (strcmp(command, "&") == 0) {
-            int64_t b = pop_int64();
-            int64_t a = pop_int64();
-            push_int64(a & b);
+        inner.depth = args + has_result;
+        inner.out = stack->out;
+        inner.call_site = stack->call_site;
+        *stack = inner;
+    }
+    free(text);
+    return ok;
+}
+
+/* C symbol for a compiled function; method names like "Point.norm" become "Point__norm". */
+const char* aot_symbol(int function_id) {
+    static char symbol[300];
+    char* out = symbol + snprintf(symbol, sizeof(symbol), "aot_");
+    for (const char* p = functions[function_id].name; *p && out < symbol + sizeof(symbol) - 3; p++) {
+        if (*p == '.') {
+            *out++ = '_';
+            *out++ = '_';
+        } else {
+            *out++ = *p;
         }
-        else if (strcmp(command, "|") == 0) {
-            int64_t b = pop_int64();
-            int64_t a = pop_int64();
-            push_int64(a | b);
+    }
+    *out = '\0';
+    return symbol;
+}
+
+bool emit_c_function(FILE* out, int function_id) {
+    int start = functions[function_id].line_number + 1;
+    int end = start;
+    while (end < program_size && program[end].function_id == function_id) end++;
+    
+    char tokens[16][256];
+    bool* entry = calloc(program_size + 1, sizeof(bool));
+    bool supported = true;
+    for (int i = start; i < end && supported; i++) {
+        ProgramLine* line = &program[i];
+        int token_count = tokenize_line(line->line, tokens, 16);
+        if (token_count > 0 && strcmp(tokens[0], "yield") == 0) supported = false;
+        
+        int targets[3] = { -1, -1, -1 };
+        switch (line->flow) {
+            case FLOW_IF: targets[0] = line->link + 1; break;
+            case FLOW_FOR_TEST: targets[0] = line->jump; targets[1] = line->link + 1; break;
+            case FLOW_SWITCH: targets[0] = switch_tables[line->jump].fallback; break;
+            case FLOW_NONE: case FLOW_LOOP: case FLOW_TRY: case FLOW_CASE: case FLOW_CALL: case FLOW_TAIL_CALL:
+            case FLOW_PARAM: case FLOW_PARAM_STORE: case FLOW_RETURN: case FLOW_FIELD: case FLOW_FIELD_STORE:
+            case FLOW_ELEMENT: case FLOW_ELEMENT_STORE: case FLOW_FIELD_DYNAMIC: case FLOW_FIELD_DYNAMIC_STORE:
+            case FLOW_METHOD: case FLOW_STRING: case FLOW_PRINTS: break;
+            default: targets[0] = line->jump; break;
         }
-        else if (strcmp(command, "^") == 0) {
-            int64_t b = pop_int64();
-            int64_t a = pop_int64();
-            push_int64(a ^ b);
+        if (line->flow == FLOW_SWITCH) {
+            SwitchTable* table = &switch_tables[line->jump];
+            for (int c = 0; c < table->count; c++) {
+                int target = switch_cases[table->first + c].target;
+                if (target < start || target > end) supported = false;
+                else entry[target] = true;
+            }
         }
-        else if (strcmp(command, "~") == 0) {
-            int64_t a = pop_int64();
-            push_int64(~a);
+        for (int t = 0; t < 3 && targets[t] >= 0; t++) {
+            if (targets[t] < start || targets[t] > end) supported = false;
+            else entry[targets[t]] = true;
         }
-        else if (strcmp(command, "<<") == 0) {
-            int64_t b = pop_int64();
-            int64_t a = pop_int64();
-            push_int64(a << b);
+    }
+    if (!supported) {
+        free(entry);
+        return false;
+    }
+    
+    char* body_text = NULL;
+    size_t body_size = 0;
+    AotStack stack = { open_memstream(&body_text, &body_size), 0, 0, { false }, -1 };
+    FILE* body = stack.out;
+    AotNames names = { .count = 0 };
+    char condition[64];
+    
+    for (int i = start; i <= end; i++) {
+        if (entry[i]) {
+            aot_flush(&stack);
+            fprintf(body, "P%d:\n    if (!running) return 0;\n", i);
         }
-        else if (strcmp(command, ">>") == 0) {
-            int64_t b = pop_int64();
-            int64_t a = pop_int64();
-            push_int64(a >> b);
+        if (i == end) break;
+        
+        ProgramLine* line = &program[i];
+        int token_count = tokenize_line(line->line, tokens, 16);
+        int opcode = line->opcode;
+        const char* command = tokens[0];
+        if (token_count > 0 && !strstr(line->line, "*/")) fprintf(body, "    /* %d: %s */\n", i + 1, line->line);
+        
+        if (line->flow == FLOW_IF) {
+            aot_condition(&stack, condition, sizeof(condition), false);
+            aot_rebind(body, &names);
+            if (program[line->link].flow == FLOW_ELSE) {
+                fprintf(body, "    vm->current_scope++;\n    if (!%s) goto P%d;\n", condition, line->link + 1);
+            } else {
+                fprintf(body, "    if (!%s) goto P%d;\n    vm->current_scope++;\n", condition, line->link + 1);
+            }
+        } else if (line->flow == FLOW_WHILE) {
+            aot_condition(&stack, condition, sizeof(condition), false);
+            aot_rebind(body, &names);
+            fprintf(body, "    if (!%s) goto P%d;\n    vm->current_scope++;\n", condition, line->jump);
+        } else if (line->flow == FLOW_FOR_TEST) {
+            aot_condition(&stack, condition, sizeof(condition), false);
+            aot_rebind(body, &names);
+            fprintf(body, "    if (!%s) goto P%d;\n    vm->current_scope++;\n    goto P%d;\n",
+                    condition, line->jump, line->link + 1);
+        } else if (line->flow == FLOW_SWITCH) {
+            SwitchTable* table = &switch_tables[line->jump];
+            aot_condition(&stack, condition, sizeof(condition), true);
+            aot_rebind(body, &names);
+            fprintf(body, "    vm->current_scope++;\n    switch (%s) {\n", condition);
+            for (int c = 0; c < table->count; c++) {
+                SwitchCase* item = &switch_cases[table->first + c];
+                if (item->target != table->fallback) {
+                    fprintf(body, "        case %lldLL: goto P%d;\n", (long long)item->value, item->target);
+                }
+            }
+            fprintf(body, "        default: goto P%d;\n    }\n", table->fallback);
+        } else if (line->flow == FLOW_CALL || line->flow == FLOW_TAIL_CALL) {
+            if (!aot_inline(&stack, &names, line->jump, function_id, i)) {
+                aot_flush(&stack);
+                if (line->flow == FLOW_TAIL_CALL) {
+                    fprintf(body, "    if (tail_call(%d, %d)) return aot_functions[%d] ? aot_functions[%d]() : "
+                                  "aot_enter(%d, vm->call_stack_ptr - 1);\n",
+                            line->jump, i, line->jump, line->jump, line->jump);
+                }
+                fprintf(body, "    if (aot_call(%d, %d) == -1) return -1;\n", line->jump, i);
+                aot_rebind(body, &names);
+            }
+        } else if (line->flow == FLOW_STRING) {
+            aot_flush(&stack);
+            fprintf(body, "    push_string(%d, %d);\n", line->jump, line->link);
+        } else if (line->flow == FLOW_METHOD) {
+            aot_flush(&stack);
+            fprintf(body, "    if (aot_call(method_prepare(&program[%d]), %d) == -1) return -1;\n", i, i);
+            aot_rebind(body, &names);
+        } else if (line->flow == FLOW_RETURN) {
+            aot_flush(&stack);
+            if (line->link >= 0) {
+                fprintf(body, "    push_value(vm->stack[base + %d], vm->stack_types[base + %d]);\n", line->link, line->link);
+            }
+            fprintf(body, "    return function_return();\n");
+        } else if (aot_simple(&stack, &names, i, tokens, token_count, -1, 0)) {
+        } else if (line->flow == FLOW_PARAM || line->flow == FLOW_PARAM_STORE || line->flow >= FLOW_FIELD) {
+            aot_flush(&stack);
+            fprintf(body, "    if (execute_command(program[%d].line, %d) == -1) return -1;\n", i, i);
+        } else if (line->flow != FLOW_NONE && line->flow != FLOW_CASE) {
+            aot_flush(&stack);
+            if (line->flow == FLOW_LOOP) {
+                fprintf(body, "    vm->current_scope++;\n");
+            } else if (line->flow == FLOW_TRY) {
+                fprintf(body, "    enter_try(%d);\n", i);
+            } else if (line->flow == FLOW_ELSE || line->flow == FLOW_CATCH || line->flow == FLOW_LOOP_END) {
+                fprintf(body, "    leave_scopes(1);\n");
+            } else if (line->flow == FLOW_BREAK || line->flow == FLOW_CONTINUE) {
+                fprintf(body, "    leave_scopes(%d);\n", line->link);
+            }
+            if (line->flow != FLOW_LOOP && line->flow != FLOW_TRY) fprintf(body, "    goto P%d;\n", line->jump);
+            aot_rebind(body, &names);
+        } else if (opcode == OP_EMPTY || opcode == OP_LABEL || line->flow == FLOW_CASE) {
+        } else {
+            aot_flush(&stack);
+            if (strcmp(command, "return") == 0) {
+                fprintf(body, "    return execute_command(program[%d].line, %d);\n", i, i);
+                continue;
+            }
+            fprintf(body, "    if (execute_command(program[%d].line, %d) == -1) return -1;\n", i, i);
+            if (strcmp(command, "{") == 0 || strcmp(command, "}") == 0 ||
+                parse_type(command) != TYPE_VOID || strcmp(command, "void") == 0 ||
+                strcmp(command, "soa") == 0 || find_struct(command) != -1) {
+                aot_rebind(body, &names);
+            }
         }
     }
+    aot_flush(&stack);
+    fprintf(body, "    vm->pc = %d;\n    return vm_interpret();\n", end);
+    fclose(body);
     
-    return 1;
+    fprintf(out, "static int %s(void) {\n", aot_symbol(function_id));
+    fprintf(out, "    int64_t c = 0;\n    int base = frame_base();\n");
+    for (int t = 0; t < stack.max_depth; t++) fprintf(out, "    int64_t t%d = 0;\n", t);
+    for (int n = 0; n < names.count; n++) fprintf(out, "    int64_t* v%d = NULL; /* %s */\n", n, names.names[n]);
+    fprintf(out, "    (void)c;\n    (void)base;\n%s}\n\n", body_text);
+    
+    free(body_text);
+    free(entry);
+    return true;
 }
 
-void first_pass() {
-    printf("[COMPILER] First pass started...\n");
+bool emit_c(const char* path, const char* source, size_t source_size) {
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "[COMPILER] Cannot write '%s': %s\n", path, strerror(errno));
+        return false;
+    }
     
-    for (int i = 0; i < program_size; i++) {
-        char* line = program[i].line;
-        
-        while (*line == ' ' || *line == '\t') line++;
-        
-        if (*line == '\0' || *line == ';' || (*line == '/' && *(line+1) == '/')) continue;
-        if (strncmp(line, "/*", 2) == 0) continue;
-        if (strncmp(line, "*/", 2) == 0) continue;
-        
-        if (strchr(line, ':') != NULL) {
-            char temp_line[LINE_SIZE];
-            strcpy(temp_line, line);
-            char* colon = strchr(temp_line, ':');
-            if (colon) {
-                *colon = '\0';
-                add_label(temp_line, i);
-            }
+    fprintf(out, "/* Generated by sosu --emit-c. Build: cc -O2 -pthread -I<sosu> %s -o prog -lm */\n", path);
+    fprintf(out, "#define SOSU_EMBEDDED\n#include \"kernel.c\"\n\n");
+    fprintf(out, "#define AOT_VAR(cache, name, line) ((cache) ? (cache) : ((cache) = aot_variable(name, line)))\n\n");
+    
+    bool compiled[MAX_FUNCTIONS] = { false };
+    int compiled_count = 0;
+    for (int f = 0; f < function_count; f++) {
+        if (functions[f].is_external) continue;
+        compiled[f] = emit_c_function(out, f);
+        if (compiled[f]) compiled_count++;
+    }
+    
+    fprintf(out, "static const char aot_source[] =\n    \"");
+    for (size_t i = 0; i < source_size; i++) {
+        unsigned char c = source[i];
+        if (c == '\n') fprintf(out, "\\n\"\n    \"");
+        else if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 32 || c >= 127) fprintf(out, "\\%03o", c);
+        else fputc(c, out);
+    }
+    fprintf(out, "\";\n\n");
+    
+    fprintf(out, "int main(int argc, char* argv[]) {\n");
+    fprintf(out, "    for (int i = 1; i < argc; i++) parse_option(argv[i]);\n");
+    fprintf(out, "    image_cache = false;\n    init_sosu_os();\n");
+    for (int f = 0; f < function_count; f++) {
+        if (compiled[f]) fprintf(out, "    aot_functions[%d] = %s;\n", f, aot_symbol(f));
+    }
+    fprintf(out, "    char* source = malloc(sizeof(aot_source));\n");
+    fprintf(out, "    memcpy(source, aot_source, sizeof(aot_source));\n");
+    fprintf(out, "    int code = boot_kernel(\"\", source, sizeof(aot_source) - 1);\n");
+    fprintf(out, "    free(source);\n    return code;\n}\n");
+    
+    bool ok = fclose(out) == 0;
+    printf("[COMPILER] Emitted C for %d of %d functions to '%s'\n", compiled_count, function_count, path);
+    return ok;
+}
+
+bool parse_option(const char* arg) {
+    if (strcmp(arg, "--profile") == 0 || strcmp(arg, "--profile=instrument") == 0) {
+        profiling_enabled = true;
+    } else if (strncmp(arg, "--profile=sample", 16) == 0) {
+        sample_hz = arg[16] == ':' ? atoi(arg + 17) : 1000;
+        if (sample_hz <= 0) sample_hz = 1000;
+    } else if (strncmp(arg, "--metrics-file=", 15) == 0) {
+        snprintf(metrics_path, sizeof(metrics_path), "%s", arg + 15);
+    } else if (strncmp(arg, "--metrics-interval=", 19) == 0) {
+        metrics_interval = atoi(arg + 19);
+    } else if (strcmp(arg, "--trace") == 0) {
+        tracing = true;
+    } else if (strncmp(arg, "--trace=", 8) == 0) {
+        tracing = true;
+        snprintf(trace_path, sizeof(trace_path), "%s", arg + 8);
+    } else if (strcmp(arg, "--hotspots") == 0) {
+        hotspots_enabled = true;
+    } else if (strncmp(arg, "--hotspots=", 11) == 0) {
+        hotspots_enabled = true;
+        hotspot_top = atoi(arg + 11) > 0 ? atoi(arg + 11) : 20;
+    } else if (strcmp(arg, "--hotspot-cycles") == 0) {
+        hotspots_enabled = true;
+        hotspot_cycles = true;
+    } else if (strncmp(arg, "--annotate=", 11) == 0) {
+        hotspots_enabled = true;
+        snprintf(annotate_path, sizeof(annotate_path), "%s", arg + 11);
+    } else if (strncmp(arg, "--profile-out=", 14) == 0) {
+        snprintf(sample_path, sizeof(sample_path), "%s", arg + 14);
+    } else if (strcmp(arg, "--no-gc") == 0) {
+        gc_enabled = false;
+    } else if (strcmp(arg, "--no-jit") == 0) {
+        jit_count = 0;
+    } else if (strcmp(arg, "--debug") == 0) {
+        debug_mode = true;
+    } else if (strncmp(arg, "--snapshot-out=", 15) == 0) {
+        snprintf(snapshot_out, sizeof(snapshot_out), "%s", arg + 15);
+    } else if (strncmp(arg, "--snapshot-in=", 14) == 0) {
+        snprintf(snapshot_in, sizeof(snapshot_in), "%s", arg + 14);
+    } else if (strncmp(arg, "--emit-c=", 9) == 0) {
+        snprintf(emit_c_path, sizeof(emit_c_path), "%s", arg + 9);
+    } else if (strcmp(arg, "--no-cache") == 0) {
+        image_cache = false;
+    } else if (strncmp(arg, "--workers=", 10) == 0) {
+        requested_workers = atoi(arg + 10);
+    } else if (strncmp(arg, "--simd=", 7) == 0) {
+        simd_limit = strcmp(arg + 7, "scalar") == 0 ? 0 : strcmp(arg + 7, "sse2") == 0 ? 1 : 2;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+char* read_source(FILE* file, size_t* size) {
+    size_t length = 0, capacity = 0;
+    char* source = NULL;
+    size_t chunk;
+    do {
+        if (length + LINE_SIZE > capacity) {
+            capacity = capacity ? capacity * 2 : 65536;
+            source = realloc(source, capacity);
         }
-        
-        char tokens[32][256];
-        int token_count = 0;
-        char* token = strtok(strdup(line), " \t\n\r");
-        while (token != NULL && token_count < 32) {
-            strcpy(tokens[token_count], token);
-            token_count++;
-            token = strtok(NULL, " \t\n\r");
+        chunk = fread(source + length, 1, capacity - length, file);
+        length += chunk;
+    } while (chunk > 0);
+    *size = length;
+    return source;
+}
+
+int boot_kernel(const char* image_path, char* source, size_t source_size) {
+    if (debug_mode) {
+        printf("[DEBUG] Debug mode enabled\n");
+    }
+    
+    uint64_t source_hash = image_hash(source, source_size);
+    kernel_hash = source_hash;
+    
+    if (image_cache && image_load(image_path, source, source_size, source_hash)) {
+        printf("[BOOT] Kernel image '%s' mapped (%d lines)\n", image_path, program_size);
+    } else {
+        if (!load_program(source, source_size)) {
+            profile_report();
+            return 1;
         }
+        printf("[BOOT] Kernel loaded (%d lines)\n", program_size);
         
-        if (token_count >= 2) {
-            if ((strcmp(tokens[0], "void") == 0 || strcmp(tokens[0], "int") == 0 ||
-                 strcmp(tokens[0], "float") == 0 || strcmp(tokens[0], "char") == 0 ||
-                 strcmp(tokens[0], "bool") == 0) && 
-                strchr(tokens[1], '(') != NULL) {
-                char func_name[256];
-                strcpy(func_name, tokens[1]);
-                char* paren = strchr(func_name, '(');
-                if (paren) *paren = '\0';
-                DataType return_type = parse_type(tokens[0]);
-                declare_function(func_name, i, return_type, false, false);
-                add_label(func_name, i);
+        first_pass();
+        if (image_cache) image_save(image_path, source_hash, source_size);
+    }
+    string_pool_seal();
+    
+    if (emit_c_path[0]) {
+        return emit_c(emit_c_path, source, source_size) ? 0 : 1;
+    }
+    
+    printf("[KERNEL] System ready\n");
+    printf("========================================\n");
+    
+    second_pass();
+    
+    printf("========================================\n");
+    
+    if (profiling_enabled) {
+        profile_report();
+    }
+    hotspot_report();
+    
+    printf("[SYSTEM] Shutdown complete\n");
+    
+    return 0;
+}
+
+/* Images of sources sent over the socket live in a private per-user directory, never a shared one. */
+bool serve_cache_dir(char* path, size_t size) {
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && runtime[0]) snprintf(path, size, "%s/sosu", runtime);
+    else snprintf(path, size, "/tmp/sosu-%d", (int)geteuid());
+    
+    struct stat st;
+    if (mkdir(path, 0700) != 0 && errno != EEXIST) return false;
+    return lstat(path, &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == geteuid() && (st.st_mode & 077) == 0;
+}
+
+void serve_request(int fd, int output) {
+    FILE* in = fdopen(dup(fd), "r");
+    if (!in) _exit(1);
+    
+    char request[PATH_MAX + 16];
+    char* source = NULL;
+    size_t source_size = 0;
+    char image_path[PATH_MAX + 32] = "";
+    
+    while (fgets(request, sizeof(request), in)) {
+        request[strcspn(request, "\r\n")] = '\0';
+        if (strncmp(request, "ARG ", 4) == 0) {
+            parse_option(request + 4);
+        } else if (strncmp(request, "RUN ", 4) == 0) {
+            FILE* file = fopen(request + 4, "r");
+            if (!file) {
+                dprintf(output, "[BOOT ERROR] Cannot load kernel '%s'\n", request + 4);
+                _exit(1);
+            }
+            source = read_source(file, &source_size);
+            fclose(file);
+            snprintf(image_path, sizeof(image_path), "%sc", request + 4);
+            break;
+        } else if (strncmp(request, "SOURCE ", 7) == 0) {
+            char* end;
+            errno = 0;
+            unsigned long long size = strtoull(request + 7, &end, 10);
+            if (errno || end == request + 7 || *end || request[7] == '-' || size > MAX_SOURCE_SIZE) {
+                dprintf(output, "[BOOT ERROR] Invalid kernel source size (at most %zu bytes)\n", MAX_SOURCE_SIZE);
+                _exit(1);
+            }
+            source_size = size;
+            source = malloc(source_size + 1);
+            if (!source || fread(source, 1, source_size, in) != source_size) {
+                dprintf(output, "[BOOT ERROR] Truncated kernel source\n");
+                _exit(1);
+            }
+            char directory[PATH_MAX];
+            if (serve_cache_dir(directory, sizeof(directory))) {
+                snprintf(image_path, sizeof(image_path), "%s/%016llx.sosuc", directory,
+                         (unsigned long long)image_hash(source, source_size));
+            } else {
+                image_cache = false;
             }
+            break;
         }
     }
+    fclose(in);
+    if (!source) _exit(1);
     
-    printf("[COMPILER] First pass completed. Found %d labels, %d functions\n", 
-           label_count, function_count);
+    dup2(output, STDOUT_FILENO);
+    dup2(output, STDERR_FILENO);
+    close(output);
+    close(fd);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    
+    int code = boot_kernel(image_path, source, source_size);
+    free(source);
+    exit(code);
 }
 
-void second_pass() {
-    printf("[RUNTIME] Starting execution...\n");
+/* Runs one request in a fresh VM and relays its output as "OUT <n>" frames, then "EXIT <status>". */
+void serve_client(int client) {
+    int pipe_fd[2];
+    if (pipe(pipe_fd) != 0) _exit(1);
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(pipe_fd[0]);
+        serve_request(client, pipe_fd[1]);
+    }
+    close(pipe_fd[1]);
+    
+    char buffer[65536];
+    ssize_t length;
+    while ((length = read(pipe_fd[0], buffer, sizeof(buffer))) > 0) {
+        dprintf(client, "OUT %zd\n", length);
+        if (write(client, buffer, length) != length) break;
+    }
+    close(pipe_fd[0]);
+    
+    int status = 0, code = 1;
+    if (pid > 0 && waitpid(pid, &status, 0) == pid) {
+        code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+    dprintf(client, "EXIT %d\n", code);
+    close(client);
+    _exit(0);
+}
+
+int serve(const char* path) {
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+    unlink(path);
+    
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listener, 128) != 0) {
+        fprintf(stderr, "[SERVE] Cannot listen on '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
     
-    int current_line = 0;
-    clock_t start_time = clock();
+    signal(SIGCHLD, SIG_IGN);
+    printf("[SERVE] Listening on '%s'\n", path);
+    fflush(NULL);
     
-    while (current_line < program_size && running) {
-        int result = execute_command(program[current_line].line, current_line);
-        if (result == -1) {
-            running = false;
+    while (running) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "[SERVE] accept failed: %s\n", strerror(errno));
             break;
         }
-        if (result > 0) {
-            current_line = result - 1;
+        
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listener);
+            signal(SIGCHLD, SIG_DFL);
+            serve_client(client);
+        }
+        if (pid < 0) {
+            dprintf(client, "[KERNEL PANIC] fork failed: %s\n", strerror(errno));
         }
-        current_line++;
+        close(client);
+    }
+    
+    close(listener);
+    unlink(path);
+    return 0;
+}
+
+int connect_kernel(const char* path, const char* kernel, int argc, char* argv[]) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "[SERVE] Cannot connect to '%s': %s\n", path, strerror(errno));
+        return 1;
     }
     
-    clock_t end_time = clock();
-    double execution_time = ((double)(end_time - start_time)) / CLOCKS_PER_SEC;
+    char resolved[PATH_MAX];
+    if (!realpath(kernel, resolved)) {
+        fprintf(stderr, "[BOOT ERROR] Cannot load kernel '%s'\n", kernel);
+        return 1;
+    }
+    for (int i = 0; i < argc; i++) {
+        if (strncmp(argv[i], "--connect", 9) != 0) dprintf(fd, "ARG %s\n", argv[i]);
+    }
+    dprintf(fd, "RUN %s\n", resolved);
     
-    printf("[RUNTIME] Execution completed in %.6f seconds\n", execution_time);
+    FILE* in = fdopen(fd, "r");
+    char header[64], buffer[65536];
+    int code = 1;
+    while (in && fgets(header, sizeof(header), in)) {
+        size_t length;
+        if (sscanf(header, "OUT %zu", &length) == 1 && length <= sizeof(buffer)) {
+            if (fread(buffer, 1, length, in) != length) break;
+            fwrite(buffer, 1, length, stdout);
+            fflush(stdout);
+        } else if (sscanf(header, "EXIT %d", &code) == 1) {
+            break;
+        } else {
+            code = 1;
+            break;
+        }
+    }
+    if (in) fclose(in);
+    else close(fd);
+    return code;
 }
 
+#ifndef SOSU_EMBEDDED
 int main(int argc, char* argv[]) {
     FILE* file;
-    char line[LINE_SIZE];
     
     if (argc < 2) {
         printf("SOSU Advanced OS Kernel v3.0\n");
         printf("Modern Operating System with C#/C++/Rust-inspired syntax\n");
         printf("Usage: %s <kernel.sosu> [options]\n", argv[0]);
+        printf("       %s --serve[=SOCKET]\n", argv[0]);
         printf("\nFeatures:\n");
         printf("  • Advanced type system (int8-64, uint8-64, float32/64)\n");
         printf("  • Object-oriented programming (structs, classes)\n");
@@ -1420,30 +7694,43 @@ int main(int argc, char* argv[]) {
         printf("  • Unsafe code blocks\n");
         printf("\nOptions:\n");
         printf("  --profile    Enable performance profiling\n");
+        printf("  --profile=sample:1000hz  Sample call stacks into folded flamegraph input\n");
+        printf("  --profile-out=FILE  Folded stack output file (default: sosu.folded)\n");
+        printf("  --metrics-file=FILE  Export runtime metrics on exit (.json for JSON, else Prometheus text)\n");
+        printf("  --metrics-interval=S  Also rewrite the metrics file every S seconds\n");
+        printf("  --trace[=FILE]  Record binary execution events, dumped on exit, crash or SIGUSR1\n");
+        printf("  --hotspots[=N]  Count executions per line and opcode, report the top N lines\n");
+        printf("  --hotspot-cycles  Also time every line with the cycle counter (slower)\n");
+        printf("  --annotate=FILE  Write source annotated with per-line counts (and cycles)\n");
         printf("  --no-gc      Disable garbage collection\n");
         printf("  --no-jit     Disable JIT compilation\n");
         printf("  --debug      Enable debug mode\n");
+        printf("  --workers=N  Task scheduler worker threads (default: CPU count)\n");
+        printf("  --simd=LEVEL Cap array kernels at scalar, sse2 or avx2 (default: best the CPU supports)\n");
+        printf("  --no-cache   Do not read or write the .sosuc kernel image\n");
+        printf("  --emit-c=FILE  Compile the kernel ahead of time to C (link with -I. kernel.c runtime)\n");
+        printf("  --snapshot-out=FILE  Save heap, globals and symbol tables after initialization\n");
+        printf("  --snapshot-in=FILE   Restore a snapshot instead of running initialization\n");
+        printf("  --serve[=SOCKET]     Keep a runtime resident and run kernels sent over a Unix socket\n");
+        printf("  --connect=SOCKET     Run the kernel on a --serve daemon and stream its output\n");
         return 1;
     }
     
-    bool debug_mode = false;
+    const char* connect_path = NULL;
     for (int i = 2; i < argc; i++) {
-        if (strcmp(argv[i], "--profile") == 0) {
-            profiling_enabled = true;
-        } else if (strcmp(argv[i], "--no-gc") == 0) {
-            gc_enabled = false;
-        } else if (strcmp(argv[i], "--no-jit") == 0) {
-            jit_count = 0;
-        } else if (strcmp(argv[i], "--debug") == 0) {
-            debug_mode = true;
-        }
+        if (strncmp(argv[i], "--connect=", 10) == 0) connect_path = argv[i] + 10;
+        else parse_option(argv[i]);
     }
     
-    init_sosu_os();
-    
-    if (debug_mode) {
-        printf("[DEBUG] Debug mode enabled\n");
+    if (connect_path) {
+        return connect_kernel(connect_path, argv[1], argc - 2, argv + 2);
     }
+    if (strncmp(argv[1], "--serve", 7) == 0) {
+        init_sosu_os();
+        return serve(argv[1][7] == '=' ? argv[1] + 8 : "/tmp/sosu.sock");
+    }
+    
+    init_sosu_os();
     
     file = fopen(argv[1], "r");
     if (!file) {
@@ -1453,42 +7740,15 @@ int main(int argc, char* argv[]) {
     
     printf("[BOOT] Loading kernel from '%s'...\n", argv[1]);
     
-    program_size = 0;
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\n")] = 0;
-        if (strlen(line) > 0) {
-            strncpy(program[program_size].line, line, LINE_SIZE - 1);
-            program[program_size].line[LINE_SIZE - 1] = '\0';
-            program[program_size].line_number = program_size;
-            program[program_size].module_id = 0;
-            program_size++;
-            if (program_size >= 8000) {
-                fprintf(stderr, "[KERNEL PANIC] Kernel too large (max 8000 lines)\n");
-                fclose(file);
-                profile_report();
-                return 1;
-            }
-        }
-    }
-    
+    size_t source_size;
+    char* source = read_source(file, &source_size);
     fclose(file);
     
-    printf("[BOOT] Kernel loaded (%d lines)\n", program_size);
+    char image_path[PATH_MAX];
+    snprintf(image_path, sizeof(image_path), "%sc", argv[1]);
+    int code = boot_kernel(image_path, source, source_size);
+    free(source);
     
-    first_pass();
-    
-    printf("[KERNEL] System ready\n");
-    printf("========================================\n");
-    
-    second_pass();
-    
-    printf("========================================\n");
-    
-    if (profiling_enabled) {
-        profile_report();
-    }
-    
-    printf("[SYSTEM] Shutdown complete\n");
-    
-    return 0;
-}
\ No newline at end of file
+    return code;
+}
+#endif
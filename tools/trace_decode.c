@@ -0,0 +1,156 @@
+#define SOSU_EMBEDDED
+#include "../kernel.c"
+
+static const char* kind_names[] = { "line", "syscall", "sysret", "gc", "mark" };
+
+static char (*source_lines)[LINE_SIZE] = NULL;
+static int source_count = 0;
+
+static int compare_events(const void* a, const void* b) {
+    const TraceEvent* x = a;
+    const TraceEvent* y = b;
+    if (x->timestamp != y->timestamp) return x->timestamp < y->timestamp ? -1 : 1;
+    return x->thread - y->thread;
+}
+
+static void load_source(const char* path) {
+    FILE* in = fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "Cannot open source '%s'\n", path);
+        return;
+    }
+    
+    char text[LINE_SIZE];
+    source_lines = malloc(MAX_PROGRAM_LINES * LINE_SIZE);
+    while (fgets(text, sizeof(text), in) && source_count < (int)(MAX_PROGRAM_LINES)) {
+        text[strcspn(text, "\n")] = 0;
+        if (strlen(text) == 0) continue;
+        char* start = text;
+        while (*start == ' ' || *start == '\t') start++;
+        snprintf(source_lines[source_count++], LINE_SIZE, "%s", start);
+    }
+    fclose(in);
+}
+
+static const char* source_text(int line) {
+    return source_lines && line >= 0 && line < source_count ? source_lines[line] : "";
+}
+
+static void json_string(FILE* out, const char* text) {
+    fputc('"', out);
+    for (; *text; text++) {
+        if (*text == '"' || *text == '\\') fputc('\\', out);
+        if ((unsigned char)*text >= 0x20) fputc(*text, out);
+    }
+    fputc('"', out);
+}
+
+static void print_text(TraceEvent* events, uint64_t count, double ns_per_tick) {
+    uint64_t base = count ? events[0].timestamp : 0;
+    for (uint64_t i = 0; i < count; i++) {
+        TraceEvent* event = &events[i];
+        printf("%14.3f us  T%-3u %-8s line %-5d %-12s sp=%-5d",
+               (event->timestamp - base) * ns_per_tick / 1000.0,
+               event->thread,
+               event->kind < 5 ? kind_names[event->kind] : "?",
+               event->line,
+               event->opcode < OP_COUNT ? opcode_names[event->opcode] : "?",
+               event->sp);
+        if (event->kind == TRACE_SYSCALL_ENTER || event->kind == TRACE_SYSCALL_EXIT) printf(" sys=%d", event->arg);
+        else if (event->kind == TRACE_GC) printf(" objects=%d", event->arg);
+        printf("  %s\n", source_text(event->line));
+    }
+}
+
+static bool chrome_first = true;
+
+static void chrome_separator() {
+    printf("%s", chrome_first ? "" : ",\n");
+    chrome_first = false;
+}
+
+static void chrome_line(TraceEvent* line, uint64_t end, uint64_t base, double ns_per_tick) {
+    const char* opcode = opcode_names[line->opcode < OP_COUNT ? line->opcode : 0];
+    chrome_separator();
+    printf("{\"name\": ");
+    json_string(stdout, source_text(line->line)[0] ? source_text(line->line) : opcode);
+    printf(", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"line\": %d, \"sp\": %d}}",
+           opcode, line->thread,
+           (line->timestamp - base) * ns_per_tick / 1000.0,
+           (end - line->timestamp) * ns_per_tick / 1000.0,
+           line->line, line->sp);
+}
+
+static void print_chrome(TraceEvent* events, uint64_t count, double ns_per_tick) {
+    uint64_t base = count ? events[0].timestamp : 0;
+    int64_t pending[256];
+    for (int i = 0; i < 256; i++) pending[i] = -1;
+    
+    printf("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    for (uint64_t i = 0; i < count; i++) {
+        TraceEvent* event = &events[i];
+        if (pending[event->thread] >= 0) {
+            chrome_line(&events[pending[event->thread]], event->timestamp, base, ns_per_tick);
+            pending[event->thread] = -1;
+        }
+        
+        double ts = (event->timestamp - base) * ns_per_tick / 1000.0;
+        if (event->kind == TRACE_LINE) {
+            pending[event->thread] = i;
+        } else if (event->kind == TRACE_SYSCALL_ENTER || event->kind == TRACE_SYSCALL_EXIT) {
+            chrome_separator();
+            printf("{\"name\": \"syscall %d\", \"cat\": \"syscall\", \"ph\": \"%s\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f}",
+                   event->arg, event->kind == TRACE_SYSCALL_ENTER ? "B" : "E", event->thread, ts);
+        } else {
+            const char* name = kind_names[event->kind < 5 ? event->kind : 4];
+            chrome_separator();
+            printf("{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"args\": {\"line\": %d, \"value\": %d}}",
+                   name, name, event->thread, ts, event->line, event->arg);
+        }
+    }
+    for (int t = 0; t < 256; t++) {
+        if (pending[t] >= 0) chrome_line(&events[pending[t]], events[pending[t]].timestamp, base, ns_per_tick);
+    }
+    printf("\n]}\n");
+}
+
+int main(int argc, char* argv[]) {
+    bool chrome = false;
+    const char* trace = NULL;
+    const char* source = NULL;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--chrome") == 0) chrome = true;
+        else if (!trace) trace = argv[i];
+        else source = argv[i];
+    }
+    if (!trace) {
+        fprintf(stderr, "Usage: %s [--chrome] <trace file> [kernel.sosu]\n", argv[0]);
+        return 1;
+    }
+    
+    FILE* in = fopen(trace, "rb");
+    if (!in) {
+        fprintf(stderr, "Cannot open trace '%s'\n", trace);
+        return 1;
+    }
+    
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.event_size != sizeof(TraceEvent)) {
+        fprintf(stderr, "'%s' is not a SOSU trace\n", trace);
+        return 1;
+    }
+    
+    TraceEvent* events = malloc((header.event_count ? header.event_count : 1) * sizeof(TraceEvent));
+    uint64_t count = fread(events, sizeof(TraceEvent), header.event_count, in);
+    fclose(in);
+    qsort(events, count, sizeof(TraceEvent), compare_events);
+    
+    if (source) load_source(source);
+    if (chrome) print_chrome(events, count, header.ns_per_tick);
+    else print_text(events, count, header.ns_per_tick);
+    
+    free(events);
+    return 0;
+}